@@ -1,5 +1,13 @@
 import statistics
 
+IMPLEMENTATIONS = ["top", "topology", "splay"]
+
+# Names of the tail latencies (p99 and p999 of every type of operation for every implementation) in the order
+# in which the experiments print them after the mean times
+def tail_fields(operations):
+	return ["{}_{}_{}".format(implementation, operation, percentile)
+		for implementation in IMPLEMENTATIONS for operation in operations for percentile in ["p99", "p999"]]
+
 def load_values(filename, variables, skip_fields=0):
 	values = {}
 	yerr = {}
@@ -39,3 +47,22 @@ def load_values(filename, variables, skip_fields=0):
 	compute_step()
 
 	return sizes, values, yerr
+
+# Graph of p99 (full line) and p999 (dashed line) latencies of the given operation for all implementations
+def plot_tail_latencies(plt, sizes, values, operation, filename):
+	plt.title("Comparison of implementations (tail latency of {})".format(operation.replace("_", " ")))
+
+	plt.ylabel("Latency of 1 operation (microseconds)")
+	plt.xlabel("Number of edges")
+	plt.xscale("log")
+	plt.yscale("log")
+
+	for implementation in IMPLEMENTATIONS:
+		line = plt.plot(sizes, values["{}_{}_p99".format(implementation, operation)])
+		plt.plot(sizes, values["{}_{}_p999".format(implementation, operation)], linestyle="--", color=line[0].get_color())
+
+	plt.legend(['Self adjusting trees p99', 'p999', 'Topology trees p99', 'p999', 'Splay top trees p99', 'p999'], loc='upper left')
+	plt.grid(True)
+
+	plt.savefig(filename, bbox_inches='tight')
+	plt.close()
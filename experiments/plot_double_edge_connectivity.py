@@ -3,7 +3,7 @@
 import matplotlib.pyplot as plt
 import sys
 
-from common import load_values
+from common import load_values, tail_fields, plot_tail_latencies
 
 (sizes, values, yerr) = load_values(
 	sys.argv[1], [
@@ -50,3 +50,9 @@ plt.grid(True)
 
 plt.savefig("double_edge_connectivity_construction.pdf", bbox_inches='tight')
 plt.close()
+
+# Tail latencies (logged after the 6 mean times)
+operations = ["insert", "delete", "query"]
+(sizes, values, yerr) = load_values(sys.argv[1], tail_fields(operations), skip_fields=10)
+for operation in operations:
+	plot_tail_latencies(plt, sizes, values, operation, "double_edge_connectivity_tail_{}.pdf".format(operation))
@@ -3,7 +3,7 @@
 import matplotlib.pyplot as plt
 import sys
 
-from common import load_values
+from common import load_values, tail_fields, plot_tail_latencies
 
 (sizes, values, yerr) = load_values(sys.argv[1], ["top_construction", "top_op", "topology_construction", "topology_op","splay_construction","splay_op"], skip_fields=3)
 
@@ -43,3 +43,10 @@ plt.legend(['Self adjusting tress', 'Topology trees', 'Splay top trees'], loc='u
 plt.grid(True)
 
 plt.savefig("experiment_construction.pdf", bbox_inches='tight')
+plt.close()
+
+# Tail latencies (logged after the 10 mean times)
+operations = ["add_edge", "remove_edge", "get_weight", "add_weight"]
+(sizes, values, yerr) = load_values(sys.argv[1], tail_fields(operations), skip_fields=13)
+for operation in operations:
+	plot_tail_latencies(plt, sizes, values, operation, "experiment_tail_{}.pdf".format(operation))
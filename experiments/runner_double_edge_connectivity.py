@@ -7,12 +7,15 @@ import time
 from statistics import median
 from multiprocessing import Pool
 
+from common import tail_fields
+
 
 tests 				 = 4 	 
 measurements 		 = 3
 warmup 				 = 1
 workload 			 = float(sys.argv[1])
 only_splay 			 = int(sys.argv[2]);
+shape 				 = sys.argv[3] if len(sys.argv) > 3 else None # Shape of the spanning tree of the initial graph (see TreeGenerator.hpp)
 test_operations      = 500   # Operations for one test
 size_start           = 100   # Start size of graph (number of vertices)
 size_step            = 1.25  # Enlarge each step
@@ -26,6 +29,7 @@ random.seed(0xDEADBEEF)
 
 program = "bin/experiment_double_edge_connectivity"
 #logfile_path  = f"experiment_double_edge_connectivity_{workload}.log" # will create .log output file
+tails = tail_fields(["insert", "delete", "query"]) # printed after the 6 mean times
 
 ##################
 
@@ -40,6 +44,7 @@ def execute(params):
 
 		# Construct and run command
 		command = [program, rnumber, str(N), str(M), str(test_operations), str(warmup), str(workload), str(only_splay)]
+		if shape is not None: command.append(shape)
 		#print(command)
 		cmd = subprocess.run(command, stdout=subprocess.PIPE, check=True)
 
@@ -57,6 +62,8 @@ def execute(params):
 			"time_splay_construction": float(output[4]),
 			"time_splay_op": float(output[5]),
 		}
+		for (j, field) in enumerate(tails):
+			measurement_results[i][field] = float(output[6 + j])
 	result = {
 		"vertices": N,
 		"edges": M,
@@ -69,6 +76,8 @@ def execute(params):
 		"time_splay_construction"			: median([measurement_results[i]["time_splay_construction"] 	for i in range(measurements)]),
 		"time_splay_op"						: median([measurement_results[i]["time_splay_op"] 				for i in range(measurements)]),
 	}
+	for field in tails:
+		result[field] = median([measurement_results[i][field] for i in range(measurements)])
 
 
 	# Log into file and to the stdout
@@ -77,7 +86,7 @@ def execute(params):
 		result["time_top_construction"], result["time_top_op"],
 		result["time_topology_construction"], result["time_topology_op"],
 		result["time_splay_construction"], result["time_splay_op"],
-	)
+	) + "   \t" + " ".join(str(result[field]) for field in tails)
 	#logfile.write(logline+"\n")
 	#logfile.flush()
 	print(logline)
@@ -7,11 +7,14 @@ import time
 from statistics import median
 from multiprocessing import Pool
 
+from common import tail_fields
+
 
 tests                = 8    # Tries for one size
 measurements		 = 3	# measurements per seed
 warmup 				 = 5 	# number of warmup rounds before a measurement is taken
 workload 			 = float(sys.argv[1]) # Ratio of insert / destroy operations
+shape 				 = sys.argv[2] if len(sys.argv) > 2 else None # Shape of the initial tree (see TreeGenerator.hpp)
 test_operations      = 1000   # Operations for one test
 size_start           = 450    # Start size of graph
 size_step            = 1.25  # Enlarge each step
@@ -21,6 +24,7 @@ random.seed(0xDEADBEEF)
 
 program = "bin/experiment_edge_weight"
 logfile_path  = f"experiment_edge_weight_{workload}.log" # will create .log output file
+tails = tail_fields(["add_edge", "remove_edge", "get_weight", "add_weight"]) # printed after the 10 mean times
 
 ##################
 
@@ -33,6 +37,7 @@ def execute(params):
 	for i in range(measurements):
 		# Construct and run command
 		command = [program, rnumber, str(size), str(test_operations), str(warmup), str(workload)]
+		if shape is not None: command += ["0", shape] # all threads for the parallel construction
 		cmd = subprocess.run(command, stdout=subprocess.PIPE, check=True)
 
 		# Get results
@@ -46,8 +51,14 @@ def execute(params):
 			"time_topology_construction": float(output[2]),
 			"time_topology_op": float(output[3]),
 			"time_splay_construction": float(output[4]),
-			"time_splay_op": float(output[5])
+			"time_splay_op": float(output[5]),
+			"time_topology_bulk_construction": float(output[6]),
+			"time_topology_parallel_construction": float(output[7]),
+			"time_top_bulk_construction": float(output[8]),
+			"time_top_parallel_construction": float(output[9])
 		}
+		for (j, field) in enumerate(tails):
+			measurement_results[i][field] = float(output[10 + j])
 	#print(command)
 
 	result = {}; 
@@ -60,15 +71,23 @@ def execute(params):
 	result["time_topology_op"] = median([measurement_results[i]["time_topology_op"] for i in range(measurements)])
 	result["time_splay_construction"] = median([measurement_results[i]["time_splay_construction"] for i in range(measurements)])
 	result["time_splay_op"] = median([measurement_results[i]["time_splay_op"] for i in range(measurements)])
+	result["time_topology_bulk_construction"] = median([measurement_results[i]["time_topology_bulk_construction"] for i in range(measurements)])
+	result["time_topology_parallel_construction"] = median([measurement_results[i]["time_topology_parallel_construction"] for i in range(measurements)])
+	result["time_top_bulk_construction"] = median([measurement_results[i]["time_top_bulk_construction"] for i in range(measurements)])
+	result["time_top_parallel_construction"] = median([measurement_results[i]["time_top_parallel_construction"] for i in range(measurements)])
+	for field in tails:
+		result[field] = median([measurement_results[i][field] for i in range(measurements)])
 
 
 	# Log into file and to the stdout
-	logline = "{} {} {} {} {} {} {} {} {}".format(
+	logline = "{} {} {} {} {} {} {} {} {} {} {} {} {}".format(
 		result["random"], result["size"], result["operations"],
 		result["time_top_construction"], result["time_top_op"],
 		result["time_topology_construction"], result["time_topology_op"],
-		result["time_splay_construction"], result["time_splay_op"]
-	)
+		result["time_splay_construction"], result["time_splay_op"],
+		result["time_topology_bulk_construction"], result["time_topology_parallel_construction"],
+		result["time_top_bulk_construction"], result["time_top_parallel_construction"]
+	) + " " + " ".join(str(result[field]) for field in tails)
 	#if logging:
 		# logfile.write(logline+"\n")
 		# logfile.flush()
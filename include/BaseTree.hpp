@@ -38,8 +38,11 @@ friend class RakeCluster;
 friend class TopologyTopTree;
 friend class TopologyCluster;
 friend class SimpleCluster;
+friend class TraceRecorder;
 public:
-	BaseTree();
+	// With arena_storage (default) vertices and edges (and their default data) are allocated
+	// from contiguous slabs owned by this tree instead of separate heap nodes
+	BaseTree(bool arena_storage = true);
 	~BaseTree();
 
 	// Adding basic objects
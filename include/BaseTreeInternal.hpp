@@ -2,6 +2,9 @@
 #include <list>
 
 #include "BaseTree.hpp"
+#include "Ref.hpp"
+#include "SlabArena.hpp"
+#include "SmallVector.hpp"
 #include "STCluster.hpp"
 #include "TopologyCluster.hpp"
 
@@ -16,78 +19,84 @@ public:
 	class Edge;
 
 	struct neighbour {
-		// std::weak_ptr<Vertex> vertex;
-		std::weak_ptr<Edge> edge;
-		std::list<std::shared_ptr<Vertex>>::iterator subvertice_iter; // may be set, it is needed to everytime check the edge->subvertice_edge to test if it is subvertice_edge
+		Ref<Edge> edge;
 	};
+	// Lists stored in every vertex, their nodes are allocated in the arena (when used)
+	// Neighbours are stored inline up to degree 3 (all subvertices of TopologyTopTree fit)
+	typedef SmallVector<neighbour, 3, SlabAllocator<neighbour>> neighbours_list;
+	typedef std::list<std::shared_ptr<STCluster>, SlabAllocator<std::shared_ptr<STCluster>>> handles_list;
 
-	std::vector<std::shared_ptr<Vertex> > vertices;
-	std::vector<std::shared_ptr<Edge> > edges;
+	std::vector<Ref<Vertex> > vertices;
+	std::vector<Ref<Edge> > edges;
+
+	// Storage for vertices and edges (NULL when they are allocated directly on the heap)
+	SlabArena *arena = NULL;
+
+	Internal(bool arena_storage);
+	~Internal();
+
+	// All vertices and edges (also the internal ones created by top trees) are allocated through these:
+	Ref<Vertex> new_vertex(std::shared_ptr<VertexData> data = NULL);
+	Ref<Edge> new_edge(Ref<Vertex> from, Ref<Vertex> to, std::shared_ptr<EdgeData> data = NULL);
 
 	// Internal functions:
-	std::vector<std::shared_ptr<Vertex> > find_leafs();
+	std::vector<Ref<Vertex> > find_leafs();
 
-	void orient_edges_to_root(const std::shared_ptr<Vertex> root, const std::shared_ptr<Vertex> from = NULL);
+	void orient_edges_to_root(const Ref<Vertex> root, const Ref<Vertex> from = NULL);
 
-	void print_rooted_prefix(const std::shared_ptr<Vertex> root, const std::shared_ptr<Vertex> from = NULL, const std::string prefix = "", bool last_child = true) const;
+	void print_rooted_prefix(const Ref<Vertex> root, const Ref<Vertex> from = NULL, const std::string prefix = "", bool last_child = true) const;
 };
 
 // Hide data from .hpp file using PIMP idiom
 
-class BaseTree::Internal::Vertex {
+class BaseTree::Internal::Vertex : public RefCounted {
 public:
-	Vertex(std::shared_ptr<VertexData> data):
-		data{data}
+	Vertex(std::shared_ptr<VertexData> data, SlabArena *arena = NULL):
+		data{data}, neighbours{SlabAllocator<neighbour>(arena)}, base_handles{SlabAllocator<std::shared_ptr<STCluster>>(arena)}
 	{}
+	static void free(Vertex *v); // called by Ref when the last reference is dropped
 
-	// Vertex parameters
-	bool deleted;
+	// Vertex parameters (small members are kept together to not waste memory on padding)
+	bool deleted = false;
+	bool used = false; // Used for building TopTree
 	int degree = 0;
-	std::shared_ptr<VertexData> data;
 	int index;
+	std::shared_ptr<VertexData> data;
 
 	// Linkage to the other objects
-	std::list<neighbour> neighbours;
+	neighbours_list neighbours; // edge knows its slot in this array (see Edge::slot_at)
+	// Where this vertex is allocated (NULL = heap), kept only by the allocator of its lists
+	SlabArena *get_arena() const { return neighbours.get_allocator().arena; }
+	void remove_neighbour(int slot);
 
 	// Handle
 	// - if degree at least 2: handle is comprees node around this middle vertex
 	// - if leaf: handle is the top most non-rake (base or compress) node having this vertex as one of its endpoints
 
 	// Points to some BaseCluster that has this vertex as one of its endpoints:
-	std::list<std::shared_ptr<STCluster>> base_handles;
+	handles_list base_handles;
 	// Points to the last STCluster that was found as handle. When this STCluster is no longer a
 	// handle, base_handle is used to recompute it
 	std::shared_ptr<STCluster> last_handle = NULL;
-
-	// Used for building TopTree:
-	bool used = false;
-	std::shared_ptr<STCluster> rake_tree_left = NULL;
-	std::shared_ptr<STCluster> rake_tree_right = NULL;
+	#ifdef TOP_TREE_STATISTICS
+		// Result of the last lookup of the handle, to count climb steps saved by the direct lookups (see get_handle)
+		std::shared_ptr<STCluster> climb_handle = NULL;
+	#endif
 
 	// Used in TopologyTopTree
-	std::shared_ptr<Vertex> superior_vertex = NULL;
-	std::list<std::shared_ptr<Vertex>> subvertices;
-	std::list<std::shared_ptr<Vertex>>::iterator superior_vertex_subvertices_iter;
-	std::list<std::shared_ptr<Edge>> subvertice_edges;
+	// Vertex of degree above 3 is splitted into a chain of subvertices, only the first one (end of the chain) may
+	// have a free slot, the others are found by next_subvertex
+	Ref<Vertex> superior_vertex = NULL;
+	Ref<Vertex> first_subvertex = NULL;
 	std::shared_ptr<TopologyCluster> topology_cluster;
 
-	// Used in TopologyTopTree expose procedure
-	std::vector<std::shared_ptr<SimpleCluster>> expose_clusters;
+	// Used in TopologyTopTree expose procedure (list of its clusters in the expose scratch of the tree)
+	int expose_first = -1;
+	int expose_last = -1;
 
-	void unlink() {
-		neighbours.clear();
-		base_handles.clear();
-		last_handle = NULL;
-		rake_tree_left = NULL;
-		rake_tree_right = NULL;
-		superior_vertex = NULL;
-		subvertices.clear();
-		subvertice_edges.clear();
-		topology_cluster = NULL;
-		expose_clusters.clear();
-
-		deleted = true;
-	}
+	void unlink();
+	// Neighbour in the chain of subvertices other than previous (NULL at the end of the chain)
+	Vertex *next_subvertex(const Vertex *previous) const;
 
 	friend std::ostream& operator<<(std::ostream& o, const Vertex& v) {
 		o << *v.data;
@@ -95,35 +104,43 @@ public:
 		return o;
 	}
 
-	static std::shared_ptr<Vertex> get_superior(std::shared_ptr<Vertex> v) {
+	static Vertex *get_superior(Vertex *v) {
 		if (v->superior_vertex != NULL) return v->superior_vertex;
 		else return v;
 	}
 };
 
-class BaseTree::Internal::Edge : public std::enable_shared_from_this<Edge> {
+class BaseTree::Internal::Edge : public RefCounted {
 public:
-	Edge(std::shared_ptr<Vertex> from, std::shared_ptr<Vertex> to, std::shared_ptr<EdgeData> data):
-		data{data}, from{from}, to{to}
+	Edge(Ref<Vertex> from, Ref<Vertex> to, std::shared_ptr<EdgeData> data, bool in_arena = false):
+		in_arena{in_arena}, data{data}, from{from}, to{to}
 	{}
+	static void free(Edge *e); // called by Ref when the last reference is dropped
 
 	void register_at_vertices();
 
 	// Edge parameters
-	bool deleted;
+	bool deleted = false;
+	bool subvertice_edge = false; // Used in TopologyTopTree
+	bool in_arena; // allocated in the arena of the tree (found by SlabArena::owner) or on the heap
 	std::shared_ptr<EdgeData> data;
 
 	// Linkage to the other objects
-	std::shared_ptr<Vertex> from;
-	std::list<neighbour>::iterator from_iter;
-	std::list<neighbour>::iterator superior_from_iter;
-	std::shared_ptr<Vertex> to;
-	std::list<neighbour>::iterator to_iter;
-	std::list<neighbour>::iterator superior_to_iter;
-
-	// Used in TopologyTopTree
-	bool subvertice_edge = false;
-	std::list<std::shared_ptr<Edge>>::iterator subvertice_edges_iterator;
+	Ref<Vertex> from;
+	Ref<Vertex> to;
+	// Positions in the neighbours arrays of the endpoints (and of their superior vertices)
+	int from_slot;
+	int to_slot;
+	int superior_from_slot;
+	int superior_to_slot;
+
+	// Slot of this edge in the neighbours of v (v is endpoint or superior vertex of endpoint)
+	int &slot_at(const Vertex *v) {
+		if (from.get() == v) return from_slot;
+		if (to.get() == v) return to_slot;
+		if (from->superior_vertex.get() == v) return superior_from_slot;
+		return superior_to_slot;
+	}
 
 	void unlink() {
 		from = NULL;
@@ -136,16 +153,14 @@ public:
 // Edges in TopologyTree
 // a) normal edge
 //     - from / to = real vertex to which this edge points
-//     - from_iter / to_iter = iter in the neighbours list
-//     - superior_from_iter / superior_to_iter = iterator to the superior vertex's neighbours list
+//     - from_slot / to_slot = slot in the neighbours array
+//     - superior_from_slot / superior_to_slot = slot in the superior vertex's neighbours array
 //     - subvertice_edge = false
-//     - subvertice_edges_iterator = NULL
 // b) subvertice edge
 //     - from / to = real vertex to which this edge points
-//     - from_iter / to_iter = iter in the neighbours list
-//     - superior_from_iter / superior_to_iter = NULL
+//     - from_slot / to_slot = slot in the neighbours array
+//     - superior_from_slot / superior_to_slot = not used
 //     - subvertice_edge = true
-//     - subvertice_edges_iterator = iter in the superior vertex's subvertice_edges list
 
 }
 
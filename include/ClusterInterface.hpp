@@ -1,6 +1,7 @@
 #include <memory>
 
 #include "BaseTreeInternal.hpp"
+#include "UserFunctions.hpp"
 
 #ifndef CLUSTER_INTERFACE_HPP
 #define CLUSTER_INTERFACE_HPP
@@ -9,9 +10,11 @@ namespace TopTree {
 
 struct ClusterData {
 	virtual ~ClusterData() {}
-};
 
-extern std::shared_ptr<ClusterData> InitClusterData();
+	// Called when the cluster is recycled, data should be set to the state returned by InitClusterData.
+	// When it returns false (not implemented) new data are obtained by InitClusterData instead.
+	virtual bool Reset() { return false; }
+};
 
 /**
  * Generic cluster interface returned from Top Trees methods. Its only public accessible field is shared_pointer to the ClusterData object.
@@ -20,15 +23,22 @@ class ICluster {
 friend class TopologyCluster;
 friend class TopologyTopTree;
 public:
-	std::shared_ptr<ClusterData> data = InitClusterData();
+	ICluster(const UserFunctions *functions): data{functions->InitClusterData()}, functions{functions} {}
+	ICluster(const UserFunctions *functions, std::shared_ptr<ClusterData> data): data{data}, functions{functions} {} // Used when recycling clusters with their data
+
+	std::shared_ptr<ClusterData> data;
 
 	int getLeftBoundary() { return (boundary_left->superior_vertex != NULL ? boundary_left->superior_vertex->index : boundary_left->index); }
 	int getRightBoundary() { return (boundary_right->superior_vertex != NULL ? boundary_right->superior_vertex->index : boundary_right->index); }
 
 	virtual std::ostream& ToString(std::ostream& o) const = 0;
 protected:
-	std::shared_ptr<BaseTree::Internal::Vertex> boundary_left;
-	std::shared_ptr<BaseTree::Internal::Vertex> boundary_right;
+	const UserFunctions *functions; // User defined functions of the top tree containing this cluster
+
+	// Boundaries are not owned by the cluster, they are kept alive by the edges inside it (raw pointers are also
+	// safe to read by more threads at once, see ITopTree::QueryPath)
+	BaseTree::Internal::Vertex *boundary_left = NULL;
+	BaseTree::Internal::Vertex *boundary_right = NULL;
 };
 std::ostream& operator<<(std::ostream& o, const ICluster& v);
 
@@ -39,35 +49,44 @@ std::ostream& operator<<(std::ostream& o, const ICluster& v);
  *
  * @return bool
  */
-inline bool isLeftRake(std::shared_ptr<ICluster> left, std::shared_ptr<ICluster> right, std::shared_ptr<ICluster> parent) {
-	int l = right->getLeftBoundary();
-	int r = right->getRightBoundary();
-	int pl = parent->getLeftBoundary();
-	int pr = parent->getRightBoundary();
+inline bool isLeftRake(ICluster &left, ICluster &right, ICluster &parent) {
+	int l = right.getLeftBoundary();
+	int r = right.getRightBoundary();
+	int pl = parent.getLeftBoundary();
+	int pr = parent.getRightBoundary();
 	return ((l == pl && r == pr) || (l == pr && r == pl));
 }
+inline bool isLeftRake(const std::shared_ptr<ICluster> &left, const std::shared_ptr<ICluster> &right, const std::shared_ptr<ICluster> &parent) {
+	return isLeftRake(*left, *right, *parent);
+}
 
 /**
  * @brief Check if boundary vertices respond to situation when right child is raked on the left one (left one remains).
  *
  * @return bool
  */
-inline bool isRightRake(std::shared_ptr<ICluster> left, std::shared_ptr<ICluster> right, std::shared_ptr<ICluster> parent) {
-	int l = left->getLeftBoundary();
-	int r = left->getRightBoundary();
-	int pl = parent->getLeftBoundary();
-	int pr = parent->getRightBoundary();
+inline bool isRightRake(ICluster &left, ICluster &right, ICluster &parent) {
+	int l = left.getLeftBoundary();
+	int r = left.getRightBoundary();
+	int pl = parent.getLeftBoundary();
+	int pr = parent.getRightBoundary();
 	return ((l == pl && r == pr) || (l == pr && r == pl));
 }
+inline bool isRightRake(const std::shared_ptr<ICluster> &left, const std::shared_ptr<ICluster> &right, const std::shared_ptr<ICluster> &parent) {
+	return isRightRake(*left, *right, *parent);
+}
 
 /**
  * @brief Check if boundary vertices respond to situation when left and right child were compressed
  *
  * @return bool
  */
-inline bool isCompress(std::shared_ptr<ICluster> left, std::shared_ptr<ICluster> right, std::shared_ptr<ICluster> parent) {
+inline bool isCompress(ICluster &left, ICluster &right, ICluster &parent) {
 	return (!isLeftRake(left, right, parent) && !isRightRake(left, right, parent));
 }
+inline bool isCompress(const std::shared_ptr<ICluster> &left, const std::shared_ptr<ICluster> &right, const std::shared_ptr<ICluster> &parent) {
+	return isCompress(*left, *right, *parent);
+}
 
 }
 
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+// Number of bits kept from every recorded value (relative error of percentiles is below 2^-PRECISION)
+#ifndef LATENCY_HISTOGRAM_PRECISION
+	#define LATENCY_HISTOGRAM_PRECISION 7
+#endif
+
+namespace TopTree {
+
+/**
+ * Histogram of latencies (in nanoseconds) in the style of HDR histograms: values below 2^PRECISION have their own
+ * bucket, greater values are bucketed by their highest bit and the following PRECISION bits. Recording is a constant
+ * number of instructions and the memory does not depend on the number of values, so it can be used for every
+ * operation of the experiments.
+ */
+class LatencyHistogram {
+public:
+	static const int SUB_BUCKETS = 1 << LATENCY_HISTOGRAM_PRECISION;
+
+	LatencyHistogram(): counts((64 - LATENCY_HISTOGRAM_PRECISION + 1) * SUB_BUCKETS, 0) {}
+
+	void record(uint64_t value) {
+		counts[get_index(value)]++;
+		total++;
+		sum += value;
+		max_value = std::max(max_value, value);
+	}
+
+	void merge(const LatencyHistogram &other) {
+		for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+		total += other.total;
+		sum += other.sum;
+		max_value = std::max(max_value, other.max_value);
+	}
+
+	uint64_t count() const { return total; }
+	uint64_t max() const { return max_value; }
+	double mean() const { return total == 0 ? 0 : (double) sum / total; }
+
+	// Smallest value such that at least the fraction p of values is not greater (up to the bucket precision)
+	uint64_t percentile(double p) const {
+		if (total == 0) return 0;
+		uint64_t rank = std::max((uint64_t) 1, (uint64_t) (p * total + 0.5));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < counts.size(); i++) {
+			seen += counts[i];
+			if (seen >= rank) return std::min(get_highest_value(i), max_value);
+		}
+		return max_value;
+	}
+
+private:
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	long double sum = 0;
+	uint64_t max_value = 0;
+
+	static size_t get_index(uint64_t value) {
+		if (value < SUB_BUCKETS) return value;
+		int shift = 63 - __builtin_clzll(value) - LATENCY_HISTOGRAM_PRECISION;
+		return (size_t) shift * SUB_BUCKETS + (value >> shift);
+	}
+
+	// Greatest value stored in the bucket
+	static uint64_t get_highest_value(size_t index) {
+		if (index < 2 * SUB_BUCKETS) return index;
+		int shift = index / SUB_BUCKETS - 1;
+		uint64_t top = index - shift * SUB_BUCKETS;
+		return ((top + 1) << shift) - 1;
+	}
+};
+
+}
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifndef PARALLEL_FOR_HPP
+#define PARALLEL_FOR_HPP
+
+// Minimal amount of work (clusters) given to a new thread during the parallel construction
+#ifndef PARALLEL_CONSTRUCTION_GRAIN
+	#define PARALLEL_CONSTRUCTION_GRAIN 16384
+#endif
+
+namespace TopTree {
+
+// Calls f(i) for all i < n, divided into continuous ranges for the given number of threads (small ranges are done by the calling thread only)
+template<class F>
+void parallel_for(int threads, size_t n, const F &f) {
+	threads = std::min(threads, (int) (n / PARALLEL_CONSTRUCTION_GRAIN));
+	if (threads <= 1) {
+		for (size_t i = 0; i < n; i++) f(i);
+		return;
+	}
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++) {
+		workers.emplace_back([&f, n, t, threads]() {
+			for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) f(i);
+		});
+	}
+	for (size_t i = 0; i < n / threads; i++) f(i);
+	for (auto &w: workers) w.join();
+}
+
+}
+
+#endif // PARALLEL_FOR_HPP
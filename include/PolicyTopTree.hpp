@@ -0,0 +1,78 @@
+#include <memory>
+
+#ifndef POLICY_TOP_TREE_HPP
+#define POLICY_TOP_TREE_HPP
+
+#include "TopTreeInterface.hpp"
+#include "UserFunctions.hpp"
+
+namespace TopTree {
+
+/**
+ * Table of user defined functions created from static methods of a policy class. Policy provides:
+ *
+ *   typedef ... Data; // data of clusters (derived from ClusterData, default constructible)
+ *   typedef ... Edge; // data of edges (derived from EdgeData)
+ *
+ *   static void Join(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent,
+ *                    Data *left_data, Data *right_data, Data *parent_data);
+ *   static void Split(... the same as Join ...);
+ *   static void Create(const std::shared_ptr<ICluster> &cluster, Data *data, const std::shared_ptr<Edge> &edge);
+ *   static void Destroy(... the same as Create ...);
+ *   static void CopyClusterData(const std::shared_ptr<ICluster> &from, const std::shared_ptr<ICluster> &to, Data *from_data, Data *to_data);
+ *
+ * Policy methods are called directly from the functions in the table (so they are inlined there) and data
+ * are given already typed (all clusters of the tree have the policy's Data, so no dynamic cast is needed).
+ * The trees themselves are not templates: they call the functions of the table through pointers (one indirect
+ * call per Join, Split, ...) and the Data of every cluster is a separate object created by InitClusterData.
+ */
+template<class Policy>
+class PolicyFunctions {
+public:
+	typedef typename Policy::Data Data;
+	typedef typename Policy::Edge Edge;
+
+	static const UserFunctions *Get() {
+		static const UserFunctions functions{Join, Split, Create, Destroy, CopyClusterData, InitClusterData};
+		return &functions;
+	}
+
+	static Data *GetData(const std::shared_ptr<ICluster> &cluster) { return static_cast<Data*>(cluster->data.get()); }
+private:
+	static void Join(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent) {
+		Policy::Join(leftChild, rightChild, parent, GetData(leftChild), GetData(rightChild), GetData(parent));
+	}
+	static void Split(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent) {
+		Policy::Split(leftChild, rightChild, parent, GetData(leftChild), GetData(rightChild), GetData(parent));
+	}
+	static void Create(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge) {
+		Policy::Create(cluster, GetData(cluster), std::static_pointer_cast<Edge>(edge));
+	}
+	static void Destroy(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge) {
+		Policy::Destroy(cluster, GetData(cluster), std::static_pointer_cast<Edge>(edge));
+	}
+	static void CopyClusterData(const std::shared_ptr<ICluster> &from, const std::shared_ptr<ICluster> &to) {
+		Policy::CopyClusterData(from, to, GetData(from), GetData(to));
+	}
+	static std::shared_ptr<ClusterData> InitClusterData() {
+		return std::make_shared<Data>();
+	}
+};
+
+/**
+ * Top tree (STTopTree or TopologyTopTree) using user defined functions of the given policy instead of the global ones,
+ * so more problems solved by top trees may be used in one program.
+ */
+template<class Policy, class Tree>
+class PolicyTopTree: public Tree {
+public:
+	PolicyTopTree(): Tree(PolicyFunctions<Policy>::Get()) {}
+	PolicyTopTree(std::shared_ptr<BaseTree> baseTree): Tree(baseTree, PolicyFunctions<Policy>::Get()) {}
+
+	// Typed data of clusters returned by this tree
+	static typename Policy::Data *GetData(const std::shared_ptr<ICluster> &cluster) { return PolicyFunctions<Policy>::GetData(cluster); }
+};
+
+}
+
+#endif // POLICY_TOP_TREE_HPP
@@ -0,0 +1,87 @@
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#ifndef REF_HPP
+#define REF_HPP
+
+namespace TopTree {
+
+// Base of the objects referenced by Ref. Counter is not atomic, objects of one tree are changed only by one thread
+// at a time (and readers that run in parallel must not copy references).
+class RefCounted {
+template<class T> friend class Ref;
+private:
+	uint32_t references = 0;
+};
+
+// Intrusive reference used instead of std::shared_ptr for the internal objects of the trees (vertices and edges).
+// It has the size of a raw pointer and copying it only changes the counter stored in the object. When the last
+// reference is dropped the object is freed by the static T::free(T*) (it knows where the object was allocated).
+// Links between clusters (parent, childs and fosters of STCluster, childs of TopologyCluster and SimpleCluster) stay
+// std::shared_ptr, clusters are the ICluster objects given to user functions and returned by ITopTree.
+template<class T>
+class Ref {
+public:
+	Ref() {}
+	Ref(std::nullptr_t) {}
+	template<class U> Ref(U *pointer): pointer{pointer} { acquire(); } // template, so NULL is taken as nullptr_t
+	Ref(const Ref &other): pointer{other.pointer} { acquire(); }
+	Ref(Ref &&other) noexcept: pointer{other.pointer} { other.pointer = NULL; }
+	~Ref() { release(); }
+
+	Ref &operator=(const Ref &other) {
+		// Other may be owned by the released object, so take it first
+		T *new_pointer = other.pointer;
+		if (new_pointer != NULL) new_pointer->references++;
+		release();
+		pointer = new_pointer;
+		return *this;
+	}
+	Ref &operator=(Ref &&other) noexcept {
+		T *new_pointer = other.pointer;
+		other.pointer = NULL;
+		release();
+		pointer = new_pointer;
+		return *this;
+	}
+	Ref &operator=(std::nullptr_t) {
+		release();
+		pointer = NULL;
+		return *this;
+	}
+
+	T *get() const { return pointer; }
+	T &operator*() const { return *pointer; }
+	T *operator->() const { return pointer; }
+	operator T*() const { return pointer; }
+
+	friend bool operator==(const Ref &a, const Ref &b) { return a.pointer == b.pointer; }
+	friend bool operator!=(const Ref &a, const Ref &b) { return a.pointer != b.pointer; }
+	template<class U> friend bool operator==(const Ref &a, U *b) { return a.pointer == b; }
+	template<class U> friend bool operator!=(const Ref &a, U *b) { return a.pointer != b; }
+	template<class U> friend bool operator==(U *a, const Ref &b) { return a == b.pointer; }
+	template<class U> friend bool operator!=(U *a, const Ref &b) { return a != b.pointer; }
+	friend bool operator==(const Ref &a, std::nullptr_t) { return a.pointer == NULL; }
+	friend bool operator!=(const Ref &a, std::nullptr_t) { return a.pointer != NULL; }
+private:
+	T *pointer = NULL;
+
+	void acquire() {
+		if (pointer != NULL) pointer->references++;
+	}
+	void release() {
+		if (pointer != NULL && --pointer->references == 0) T::free(pointer);
+	}
+};
+
+}
+
+namespace std {
+template<class T>
+struct hash<TopTree::Ref<T>> {
+	size_t operator()(const TopTree::Ref<T> &ref) const { return std::hash<T*>()(ref.get()); }
+};
+}
+
+#endif // REF_HPP
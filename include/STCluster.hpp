@@ -5,6 +5,7 @@
 
 namespace TopTree {
 class STCluster;
+class STClusterPool;
 }
 
 #include "ClusterInterface.hpp"
@@ -15,14 +16,23 @@ namespace TopTree {
 
 class STCluster : public ICluster, public std::enable_shared_from_this<STCluster> {
 friend class STTopTree;
+friend class STClusterPool;
 friend class BaseCluster;
 friend class CompressCluster;
 friend class RakeCluster;
 public:
+	STCluster(const UserFunctions *functions): ICluster(functions) {}
+	STCluster(const UserFunctions *functions, std::shared_ptr<ClusterData> data): ICluster(functions, data) {}
+
 	virtual std::ostream& ToString(std::ostream& o) const = 0;
 protected:
-	std::shared_ptr<BaseTree::Internal::Vertex> common_vertex;
+	STClusterPool *pool = NULL; // Pool from which this cluster was taken
+
+	BaseTree::Internal::Vertex *common_vertex = NULL;
 
+	// A flat layout of these nodes (one array, 32-bit indices, kind dispatched by a switch, data inline) was measured by a
+	// prototype on Expose of random paths in path graphs: 1.4x (N=1000) to 3.5x (N=100000) faster. It is not used, it
+	// would need its own splicing, Link, Cut and user functions without ICluster pointers.
 	std::shared_ptr<STCluster> parent = NULL;
 	std::shared_ptr<STCluster> left_child = NULL;
 	std::shared_ptr<STCluster> right_child = NULL;
@@ -34,7 +44,7 @@ protected:
 	void set_left_foster(std::shared_ptr<STCluster> child);
 	void set_right_foster(std::shared_ptr<STCluster> child);
 
-	std::list<std::shared_ptr<STCluster>>::iterator root_clusters_iterator;
+	std::list<std::shared_ptr<STCluster>, SlabAllocator<std::shared_ptr<STCluster>>>::iterator root_clusters_iterator;
 	bool is_splitted = true; // Initially clusters are in state that they need do_join method (which is called during construction)
 	bool is_deleted = false;
 
@@ -48,7 +58,7 @@ protected:
 	virtual void flip() = 0;
 	virtual void normalize_for_splay() = 0;
 
-	virtual bool is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v) = 0;
+	virtual bool is_handle_for(BaseTree::Internal::Vertex *v) = 0;
 	virtual void unregister() = 0;
 	virtual void unlink();
 
@@ -59,15 +69,17 @@ std::ostream& operator<<(std::ostream& o, const STCluster& v);
 class BaseCluster : public STCluster {
 friend class STTopTree;
 public:
+	using STCluster::STCluster;
+
 	virtual std::ostream& ToString(std::ostream& o) const;
-	static std::shared_ptr<BaseCluster> construct(std::shared_ptr<BaseTree::Internal::Edge> edge);
+	static std::shared_ptr<BaseCluster> construct(STClusterPool *pool, Ref<BaseTree::Internal::Edge> edge);
 protected:
 
-	std::shared_ptr<BaseTree::Internal::Edge> edge;
+	Ref<BaseTree::Internal::Edge> edge;
 
 	bool handles_registered = false;
-	std::list<std::shared_ptr<STCluster>>::iterator boundary_left_handles_iterator;
-	std::list<std::shared_ptr<STCluster>>::iterator boundary_right_handles_iterator;
+	std::list<std::shared_ptr<STCluster>, SlabAllocator<std::shared_ptr<STCluster>>>::iterator boundary_left_handles_iterator;
+	std::list<std::shared_ptr<STCluster>, SlabAllocator<std::shared_ptr<STCluster>>>::iterator boundary_right_handles_iterator;
 
 	virtual bool isBase() { return true; }
 	virtual void do_join();
@@ -76,7 +88,7 @@ protected:
 	virtual void flip();
 	virtual void normalize_for_splay();
 
-	virtual bool is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v);
+	virtual bool is_handle_for(BaseTree::Internal::Vertex *v);
 	virtual void unregister();
 	virtual void unlink();
 
@@ -85,9 +97,12 @@ protected:
 
 class RakeCluster : public STCluster {
 friend class STTopTree;
+friend class CompressCluster;
 public:
+	using STCluster::STCluster;
+
 	virtual std::ostream& ToString(std::ostream& o) const;
-	static std::shared_ptr<RakeCluster> construct(std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to, bool virtual_cluster = false);
+	static std::shared_ptr<RakeCluster> construct(STClusterPool *pool, std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to, bool virtual_cluster = false);
 protected:
 
 	virtual bool isRake() { return true; }
@@ -97,7 +112,7 @@ protected:
 	virtual void flip();
 	virtual void normalize_for_splay();
 
-	virtual bool is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v);
+	virtual bool is_handle_for(BaseTree::Internal::Vertex *v);
 	virtual void unregister();
 	virtual void unlink();
 
@@ -107,12 +122,15 @@ protected:
 class CompressCluster : public STCluster {
 friend class STTopTree;
 public:
+	using STCluster::STCluster;
+
 	virtual std::ostream& ToString(std::ostream& o) const;
-	static std::shared_ptr<CompressCluster> construct(std::shared_ptr<STCluster> left, std::shared_ptr<STCluster> right);
+	static std::shared_ptr<CompressCluster> construct(STClusterPool *pool, std::shared_ptr<STCluster> left, std::shared_ptr<STCluster> right);
 protected:
 
 	std::shared_ptr<RakeCluster> left_foster_rake = NULL;
 	std::shared_ptr<RakeCluster> right_foster_rake = NULL;
+	std::shared_ptr<RakeCluster> join_virtual_rake(std::shared_ptr<RakeCluster> rake, std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to);
 
 	virtual bool isCompress() { return !rakerized; }
 	virtual bool isRake() { return rakerized; }
@@ -122,7 +140,7 @@ protected:
 	virtual void flip();
 	virtual void normalize_for_splay();
 
-	virtual bool is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v);
+	virtual bool is_handle_for(BaseTree::Internal::Vertex *v);
 	virtual void unregister();
 	virtual void unlink();
 
@@ -131,6 +149,77 @@ protected:
 	bool rakerized = false; // modyfied to rake node during hard_expose
 };
 
+// Per STTopTree pool of clusters. When the last reference to a cluster is dropped the cluster is
+// returned into free list of its type (together with its ClusterData) and reused by the next
+// construct, control blocks of shared pointers are allocated in the pool's arena.
+//
+// Owner calls release() instead of delete, pool is freed after all its clusters are returned.
+class STClusterPool {
+public:
+	STClusterPool(const UserFunctions *functions);
+
+	template<class T> std::shared_ptr<T> create();
+
+	SlabArena *get_arena() { return arena; }
+	void release();
+private:
+	~STClusterPool();
+
+	template<class T> struct recycler {
+		STClusterPool *pool;
+		void operator()(T *cluster) const { pool->recycle(cluster); }
+	};
+	template<class T> void recycle(T *cluster);
+
+	struct free_cluster {
+		void *memory;
+		std::shared_ptr<ClusterData> data;
+	};
+	std::vector<free_cluster> free_base;
+	std::vector<free_cluster> free_compress;
+	std::vector<free_cluster> free_rake;
+	std::vector<free_cluster>& free_list(BaseCluster*) { return free_base; }
+	std::vector<free_cluster>& free_list(CompressCluster*) { return free_compress; }
+	std::vector<free_cluster>& free_list(RakeCluster*) { return free_rake; }
+
+	const UserFunctions *functions; // Given to all clusters
+	SlabArena *arena;
+	size_t living = 0;
+	bool released = false;
+};
+
+template<class T>
+std::shared_ptr<T> STClusterPool::create() {
+	auto &list = free_list((T*) NULL);
+	T *cluster;
+	if (list.empty()) {
+		cluster = new (::operator new(sizeof(T))) T(functions);
+	} else {
+		auto data = std::move(list.back().data);
+		void *memory = list.back().memory;
+		list.pop_back();
+
+		if (!data->Reset()) data = functions->InitClusterData();
+		cluster = new (memory) T(functions, data);
+	}
+	living++;
+
+	auto result = std::shared_ptr<T>(cluster, recycler<T>{this}, SlabAllocator<T>(arena));
+	result->pool = this;
+	return result;
+}
+
+template<class T>
+void STClusterPool::recycle(T *cluster) {
+	// Destructor releases all links to the other clusters (they may be recycled too)
+	auto data = std::move(cluster->data);
+	cluster->~T();
+	free_list((T*) NULL).push_back(free_cluster{cluster, std::move(data)});
+
+	living--;
+	if (released && living == 0) delete this;
+}
+
 }
 
 #endif // ST_CLUSTER_HPP
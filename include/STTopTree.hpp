@@ -5,16 +5,21 @@
 #define ST_TOP_TREE_HPP
 
 #include "TopTreeInterface.hpp"
+#include "UserFunctions.hpp"
 
 namespace TopTree {
 
 class STTopTree: public ITopTree {
 public:
-	STTopTree();
-	STTopTree(std::shared_ptr<BaseTree> baseTree); // Construct from underlying tree
+	// User defined functions are the global ones unless other table is given (see UserFunctions.hpp)
+	STTopTree(const UserFunctions *functions = GlobalUserFunctions());
+	STTopTree(std::shared_ptr<BaseTree> baseTree, const UserFunctions *functions = GlobalUserFunctions()); // Construct from underlying tree
 	~STTopTree();
 
 	void InitFromBaseTree(std::shared_ptr<BaseTree> baseTree);
+	// Construction by more threads (0 = all hardware threads): paths of the components are connected into balanced
+	// rake and compress trees in parallel. All user functions are called only from the calling thread.
+	void InitFromBaseTree(std::shared_ptr<BaseTree> baseTree, int threads);
 
 	// User operations (documented in the ITopTree interface)
 	std::shared_ptr<ICluster> Expose(int v, int w);
@@ -22,6 +27,16 @@ public:
 	std::shared_ptr<ICluster> Link(int v, int w, std::shared_ptr<EdgeData> edge_data);
 	void Restore();
 	std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> SplitRoot(std::shared_ptr<ICluster> root);
+
+	// With deferred joins the clusters split by splaying are not joined after each splay, but only once at the end of
+	// the operation (when the exposed cluster is read). Each of them is joined exactly once per operation.
+	void SetDeferredJoins(bool deferred);
+
+	// Counters of the internal work (documented in the ITopTree interface): rotations, splices, splays of soft
+	// expose, clusters rakerized by hard expose, lookups of handles (see get_handle) with the direct ones, climb
+	// steps of the others and climb steps saved by the direct ones and calls of the user defined functions
+	std::vector<std::pair<std::string, long long>> GetStatistics() const;
+	void ResetStatistics();
 private:
 	class Internal;
 	std::unique_ptr<Internal> internal;
@@ -0,0 +1,95 @@
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#ifndef SLAB_ARENA_HPP
+#define SLAB_ARENA_HPP
+
+namespace TopTree {
+
+// Arena for small objects. Memory is taken from the global allocator in big slabs
+// and every object size has its own free list, so objects of the same type are
+// stored next to each other and freed objects are reused without calling malloc.
+//
+// Owner calls release() instead of delete. The arena itself is freed after the last
+// object allocated from it is returned (shared_ptr control blocks may outlive the owner).
+// Arena is not thread safe.
+//
+// Slabs are aligned to their size and start with a pointer to the arena, so objects
+// do not need to remember where they were allocated (see owner).
+class SlabArena {
+public:
+	SlabArena();
+
+	void *allocate(size_t size);
+	void deallocate(void *pointer, size_t size);
+
+	void release();
+
+	// Arena of an object allocated by allocate (only objects up to max_object_size bytes)
+	static SlabArena *owner(const void *pointer) {
+		return *reinterpret_cast<SlabArena**>(reinterpret_cast<uintptr_t>(pointer) & ~(uintptr_t) (slab_size - 1));
+	}
+	static const size_t max_object_size = 1024;
+
+	// Bytes taken from the global allocator and bytes used by the living objects
+	size_t reserved_bytes() const { return reserved; }
+	size_t used_bytes() const { return used; }
+private:
+	~SlabArena();
+
+	struct free_node {
+		free_node *next;
+	};
+	struct size_class {
+		free_node *free = NULL;
+		char *next = NULL;
+		char *end = NULL;
+	};
+
+	// Objects are aligned only to the pointer size (see SlabAllocator)
+	static const size_t granularity = sizeof(void*);
+	static const size_t slab_size = 64 * 1024; // power of two, slab header is the first granule
+
+	std::vector<size_class> classes;
+	std::vector<char*> slabs;
+
+	size_t living = 0;
+	size_t reserved = 0;
+	size_t used = 0;
+	bool released = false;
+};
+
+// Standard allocator adapter, used with std::allocate_shared (so both object and its
+// control block are allocated inside the arena) and with lists stored in vertices.
+// Without arena (NULL) it behaves as the default allocator.
+template<class T>
+class SlabAllocator {
+static_assert(alignof(T) <= sizeof(void*), "SlabArena does not provide stronger alignment than pointer size");
+public:
+	typedef T value_type;
+
+	SlabAllocator(SlabArena *arena = NULL): arena{arena} {}
+	template<class U> SlabAllocator(const SlabAllocator<U> &other): arena{other.arena} {}
+
+	T *allocate(size_t n) {
+		if (arena == NULL) return static_cast<T*>(::operator new(n * sizeof(T)));
+		return static_cast<T*>(arena->allocate(n * sizeof(T)));
+	}
+	void deallocate(T *pointer, size_t n) {
+		if (arena == NULL) ::operator delete(pointer);
+		else arena->deallocate(pointer, n * sizeof(T));
+	}
+
+	SlabArena *arena;
+};
+
+template<class T, class U>
+bool operator==(const SlabAllocator<T> &a, const SlabAllocator<U> &b) { return a.arena == b.arena; }
+template<class T, class U>
+bool operator!=(const SlabAllocator<T> &a, const SlabAllocator<U> &b) { return a.arena != b.arena; }
+
+}
+
+#endif // SLAB_ARENA_HPP
@@ -0,0 +1,90 @@
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#ifndef SMALL_VECTOR_HPP
+#define SMALL_VECTOR_HPP
+
+namespace TopTree {
+
+// Contiguous array that stores up to N elements inline (without any allocation), bigger
+// arrays are allocated by the given allocator. Only the operations needed by the adjacency
+// of vertices and by the outer edges of clusters are provided, order of elements is not
+// preserved by remove (swap with last) but it is preserved by erase.
+template<class T, size_t N, class Allocator = std::allocator<T>>
+class SmallVector {
+public:
+	SmallVector(const Allocator &allocator = Allocator()): allocator{allocator} {}
+	~SmallVector() {
+		clear();
+		if (!is_inline()) allocator.deallocate(items, capacity);
+	}
+
+	SmallVector(const SmallVector&) = delete;
+	SmallVector& operator=(const SmallVector&) = delete;
+
+	T *begin() { return items; }
+	T *end() { return items + count; }
+	const T *begin() const { return items; }
+	const T *end() const { return items + count; }
+
+	const Allocator &get_allocator() const { return allocator; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T& operator[](size_t i) { return items[i]; }
+	const T& operator[](size_t i) const { return items[i]; }
+	T& back() { return items[count - 1]; }
+
+	void push_back(T item) {
+		if (count == capacity) grow();
+		new (items + count) T(std::move(item));
+		count++;
+	}
+	void pop_back() {
+		count--;
+		items[count].~T();
+	}
+	// Moves the last element into position i (returns false if there was nothing to move)
+	bool remove(size_t i) {
+		bool moved = (i != count - 1);
+		if (moved) items[i] = std::move(items[count - 1]);
+		pop_back();
+		return moved;
+	}
+
+	// Removes element at position i and shifts the following ones (keeps the order)
+	void erase(size_t i) {
+		for (; i + 1 < count; i++) items[i] = std::move(items[i + 1]);
+		pop_back();
+	}
+
+	void clear() {
+		while (count > 0) pop_back();
+	}
+private:
+	bool is_inline() const { return items == reinterpret_cast<const T*>(storage); }
+
+	void grow() {
+		size_t new_capacity = 2 * capacity;
+		T *new_items = allocator.allocate(new_capacity);
+		for (size_t i = 0; i < count; i++) {
+			new (new_items + i) T(std::move(items[i]));
+			items[i].~T();
+		}
+		if (!is_inline()) allocator.deallocate(items, capacity);
+		items = new_items;
+		capacity = new_capacity;
+	}
+
+	alignas(T) char storage[N * sizeof(T)];
+	T *items = reinterpret_cast<T*>(storage);
+	unsigned int count = 0;
+	unsigned int capacity = N;
+	Allocator allocator;
+};
+
+}
+
+#endif // SMALL_VECTOR_HPP
@@ -1,4 +1,5 @@
 #include <memory>
+#include <string>
 #include <vector>
 
 #ifndef TOP_TREE_INTERFACE_HPP
@@ -31,6 +32,24 @@ public:
 	 */
 	virtual std::shared_ptr<ICluster> Expose(int v, int w) = 0;
 
+	/**
+	 * @brief Computes cluster of the given path like Expose but without changing the top tree (if it is possible).
+	 *
+	 * @details Returned cluster is not part of the top tree, its data are only for reading (changes are not propagated
+	 * into the tree, use Expose for them). By default it is the same as Expose (STTopTree is self-adjusting, it is
+	 * restructured by every query).
+	 *
+	 * TopologyTopTree never changes the tree: it returns NULL when the last Expose was not restored yet, and more
+	 * threads may query one tree at once when there is no concurrent update (user functions Join, Split and
+	 * CopyClusterData must be thread safe then). Returned cluster is valid until the next QueryPath of the same thread.
+	 *
+	 * @param v Index of the first endpoint of wanted path. Indexes are these returned by creating vertices in the BaseTree.
+	 * @param w Index of the second endpoint of wanted path. Indexes are these returned by creating vertices in the BaseTree.
+	 *
+	 * @return shared_ptr to the Cluster of the path or NULL when there is no such path.
+	 */
+	virtual std::shared_ptr<ICluster> QueryPath(int v, int w) { return Expose(v, w); }
+
 	/**
 	 * @brief Cuts the edge between given vertices and returns pointers to new root Clusters.
 	 *
@@ -67,6 +86,21 @@ public:
 	virtual void Restore() = 0;
 
 	virtual std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> SplitRoot(std::shared_ptr<ICluster> root) = 0;
+
+	// Statistics
+
+	/**
+	 * @brief Returns counters of the internal work done since the construction (or the last ResetStatistics).
+	 *
+	 * @details Counters are compiled in only with TOP_TREE_STATISTICS defined (make STATISTICS=1), otherwise
+	 * the list is empty and counting costs nothing. Calls of the user defined functions are counted per thread,
+	 * so they are precise only when the tree is used by one thread.
+	 *
+	 * @return List of pairs (name of the counter, value).
+	 */
+	virtual std::vector<std::pair<std::string, long long>> GetStatistics() const { return {}; }
+
+	virtual void ResetStatistics() {}
 };
 
 }
@@ -0,0 +1,26 @@
+#ifndef TOP_TREE_STATISTICS_HPP
+#define TOP_TREE_STATISTICS_HPP
+
+// Counters of the internal work of the top trees (see ITopTree::GetStatistics) are compiled in only when
+// TOP_TREE_STATISTICS is defined (make STATISTICS=1), otherwise TOP_TREE_COUNT expands to nothing.
+#ifdef TOP_TREE_STATISTICS
+	#define TOP_TREE_COUNT(counter, value) ((counter) += (value))
+#else
+	#define TOP_TREE_COUNT(counter, value) ((void) 0)
+#endif
+
+namespace TopTree {
+
+// Calls of the user defined functions by clusters. Clusters do not know their tree, so calls are counted per thread
+// and trees report the difference since their construction (or last reset).
+struct UserFunctionCounters {
+	long long joins = 0;
+	long long splits = 0;
+	long long creates = 0;
+	long long destroys = 0;
+};
+inline thread_local UserFunctionCounters user_function_counters;
+
+}
+
+#endif // TOP_TREE_STATISTICS_HPP
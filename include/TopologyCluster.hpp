@@ -1,3 +1,4 @@
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -7,25 +8,27 @@
 namespace TopTree {
 class TopologyCluster;
 class SimpleCluster;
+class SimpleClusterPool;
 }
 
 #include "ClusterInterface.hpp"
 #include "BaseTreeInternal.hpp"
+#include "SmallVector.hpp"
 
 namespace TopTree {
 class TopologyCluster : public ICluster, public std::enable_shared_from_this<TopologyCluster> {
 friend class TopologyTopTree;
 friend class SimpleCluster;
 public:
-	static int global_index;
+	static std::atomic<int> global_index; // atomic, clusters may be created by more threads during the parallel construction
 
-	TopologyCluster();
+	TopologyCluster(const UserFunctions *functions);
 
 	virtual std::ostream& ToString(std::ostream& o) const;
 protected:
 	struct neighbour {
-		std::shared_ptr<BaseTree::Internal::Edge> edge;
-		std::shared_ptr<TopologyCluster> cluster;
+		BaseTree::Internal::Edge *edge; // not owned, the edge is in the base tree while it is an outer edge
+		TopologyCluster *cluster; // not owned, neighbours remove the edge from each other (see remove_all_outer_edges)
 	};
 
 	int index;
@@ -39,31 +42,41 @@ protected:
 	std::shared_ptr<TopologyCluster> second = NULL;
 
 	// Edge between clusters:
-	std::shared_ptr<BaseTree::Internal::Edge> edge;
+	Ref<BaseTree::Internal::Edge> edge;
 	// Vertex if it is the base topology cluster
-	std::shared_ptr<BaseTree::Internal::Vertex> vertex;
+	Ref<BaseTree::Internal::Vertex> vertex;
 
-	std::vector<neighbour> outer_edges;
+	// Topology tree keeps at most 4 outer edges of a cluster (3 of a base cluster), so they are stored inline
+	SmallVector<neighbour, 4> outer_edges;
 	int outer_edges_count = 0;
+	int construction_size = 0; // Size of the subtree during construction, used for dividing the work between threads
 
-	// Data of corresponding clusters in the top tree:
+	// Data of corresponding clusters in the top tree (owned by this cluster, do_join resets them in place):
 	std::shared_ptr<ICluster> edge_cluster;
-	std::shared_ptr<ICluster> combined_edge_cluster;
+	std::shared_ptr<ICluster> combined_edge_cluster; // own_combined_edge_cluster or edge_cluster (first child is not top)
+	std::shared_ptr<ICluster> own_combined_edge_cluster;
+	void renew_simple_cluster(std::shared_ptr<ICluster> &cluster);
 
 	void set_first_child(std::shared_ptr<TopologyCluster> child);
 	void set_second_child(std::shared_ptr<TopologyCluster> child);
 
 	std::list<std::shared_ptr<TopologyCluster>>::iterator root_clusters_iterator;
+	bool listed_in_root_clusters = false;
 	bool is_splitted = true; // Initially clusters are in state that they need do_join method (which is called during construction)
 	bool listed_in_delete_list = false;
 	bool listed_in_change_list = false;
 	bool listed_in_abandon_list = false;
 	bool listed_in_recompute_list = false;
+	bool outer_edges_changed = true; // childs changed since the last calculate_outer_edges (do_join has to calculate them)
+	bool outer_edges_rake_branch = false; // is_rake_branch given by the outer edges (do_join may change is_rake_branch)
+	bool on_expose_path = false; // above one of the exposed vertices (only while joining the other splitted clusters)
+	unsigned int restore_epoch = 0; // the last Restore which had this cluster in its split set
+	int restore_waiting = 0; // splitted childs from the same split set which are not joined yet
 
 	void do_split(std::vector<std::shared_ptr<TopologyCluster>>* splitted_clusters = NULL);
-	void do_join();
+	int do_join(); // returns number of Join callbacks (including the ones for splitted childs)
 
-	bool is_external_boundary_vertex(std::shared_ptr<BaseTree::Internal::Vertex> v);
+	bool is_external_boundary_vertex(BaseTree::Internal::Vertex *v);
 
 	void calculate_outer_edges(bool check_neighbours = false);
 	void remove_all_outer_edges();
@@ -73,23 +86,42 @@ protected:
 	/**
 	 * @brief Tries to find common vertex of two given IClusters.
 	 *
+	 * Boundary vertices equal in both clusters are preferred, superior vertices are compared only when there is none
+	 * (two subvertices of the same vertex have the same superior vertex).
+	 *
 	 * @param cluster_a Shared pointer to the first ICluster to compare.
 	 * @param cluster_b Shared pointer to the second ICluster to compare.
 	 * @param get_superior True if do comparison on the superior vertices of boundary vertices of given clusters, true by default.
 	 *
-	 * @return shared_ptr to the common vertex of two given IClusters or NULL when they have no common vertex
+	 * @return pointer to the common vertex of two given IClusters or NULL when they have no common vertex
+	 */
+	static BaseTree::Internal::Vertex *get_common_vertex(std::shared_ptr<ICluster> cluster_a, std::shared_ptr<ICluster> cluster_b, bool get_superior = true);
+	/**
+	 * @brief Moves a boundary of a cluster where the given rake branch is raked (if needed).
+	 *
+	 * Rake branch at a splitted vertex may cover a part of the chain of its subvertices (its boundaries are two different
+	 * subvertices). The other edges of the vertex continue from the other end of that part, so the boundary of the
+	 * cluster has to move there (joins with subvertice edges compare the subvertices exactly).
+	 *
+	 * @param rake Shared pointer to the raked rake branch.
+	 * @param boundary_left Left boundary of the cluster (changed when it is one of the boundaries of the rake branch).
+	 * @param boundary_right Right boundary of the cluster (changed when it is one of the boundaries of the rake branch).
 	 */
-	static std::shared_ptr<BaseTree::Internal::Vertex> get_common_vertex(std::shared_ptr<ICluster> cluster_a, std::shared_ptr<ICluster> cluster_b, bool get_superior = true);
+	static void move_boundary_over_rake(const std::shared_ptr<ICluster> &rake, BaseTree::Internal::Vertex *&boundary_left, BaseTree::Internal::Vertex *&boundary_right);
 };
 std::ostream& operator<<(std::ostream& o, const TopologyCluster& v);
 
 class SimpleCluster: public ICluster, public std::enable_shared_from_this<SimpleCluster> {
 friend class TopologyTopTree;
+friend class SimpleClusterPool;
 public:
+	SimpleCluster(const UserFunctions *functions): ICluster(functions) {}
+	SimpleCluster(const UserFunctions *functions, std::shared_ptr<ClusterData> data): ICluster(functions, data) {}
+
 	std::ostream& ToString(std::ostream& o) const { return o; }
-	static std::shared_ptr<SimpleCluster> construct(std::shared_ptr<ICluster> first, std::shared_ptr<ICluster> second);
+	static std::shared_ptr<SimpleCluster> construct(SimpleClusterPool *pool, std::shared_ptr<ICluster> first, std::shared_ptr<ICluster> second);
 protected:
-	std::shared_ptr<BaseTree::Internal::Edge> edge = NULL;
+	Ref<BaseTree::Internal::Edge> edge = NULL;
 
 	std::shared_ptr<SimpleCluster> parent = NULL;
 	std::shared_ptr<ICluster> first = NULL;
@@ -101,6 +133,41 @@ protected:
 	void unlink(bool recursive = false);
 };
 
+// Simple clusters made by Expose are freed by the next Restore, the pool keeps their memory and data (see
+// ClusterData::Reset) for the next Expose and control blocks are in its arena, so repeated Exposes do not allocate
+// once the pool is large enough. The same as STClusterPool it is freed after the tree and all its clusters.
+class SimpleClusterPool {
+public:
+	SimpleClusterPool(const UserFunctions *functions);
+
+	std::shared_ptr<SimpleCluster> create();
+
+	size_t get_allocations() const { return allocations; }
+	size_t get_creations() const { return creations; } // counted only with TOP_TREE_STATISTICS
+	void release();
+private:
+	~SimpleClusterPool();
+
+	struct recycler {
+		SimpleClusterPool *pool;
+		void operator()(SimpleCluster *cluster) const { pool->recycle(cluster); }
+	};
+	void recycle(SimpleCluster *cluster);
+
+	struct free_cluster {
+		void *memory;
+		std::shared_ptr<ClusterData> data;
+	};
+	std::vector<free_cluster> free_clusters;
+
+	const UserFunctions *functions; // Given to all clusters
+	SlabArena *arena;
+	size_t living = 0;
+	size_t allocations = 0; // clusters and data taken from the global allocator
+	size_t creations = 0; // clusters created by the pool
+	bool released = false;
+};
+
 }
 
 #endif // TOPOLOGY_CLUSTER_HPP
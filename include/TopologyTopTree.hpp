@@ -5,25 +5,59 @@
 #define TOPOLOGY_TOP_TREE_HPP
 
 #include "TopTreeInterface.hpp"
+#include "UserFunctions.hpp"
 // #include "Cluster.hpp"
 
 namespace TopTree {
 
 class TopologyTopTree: public ITopTree {
 public:
-	TopologyTopTree();
-	TopologyTopTree(std::shared_ptr<BaseTree> baseTree); // Construct from underlying tree
+	// User defined functions are the global ones unless other table is given (see UserFunctions.hpp)
+	TopologyTopTree(const UserFunctions *functions = GlobalUserFunctions());
+	TopologyTopTree(std::shared_ptr<BaseTree> baseTree, const UserFunctions *functions = GlobalUserFunctions()); // Construct from underlying tree
 	~TopologyTopTree();
 
 	void InitFromBaseTree(std::shared_ptr<BaseTree> baseTree);
+	// Construction by more threads (0 = all hardware threads): independent components are constructed in parallel
+	// and clusters of one level of a large component are matched in parallel too. InitClusterData may be called
+	// from more threads at once, all other user functions are called only from the calling thread.
+	void InitFromBaseTree(std::shared_ptr<BaseTree> baseTree, int threads);
 
 	// User operations (documented in the ITopTree interface)
 	std::shared_ptr<ICluster> Expose(int v, int w);
+	std::shared_ptr<ICluster> QueryPath(int v, int w);
 	std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr<EdgeData>> Cut(int v, int w);
 	std::shared_ptr<ICluster> Link(int v, int w, std::shared_ptr<EdgeData> edge_data);
 	void Restore();
 	std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> SplitRoot(std::shared_ptr<ICluster> root);
 
+	// Batch of changes: all cuts are done before all links (as if called one by one in this order), but clusters
+	// above the changed vertices are repaired together for all of them. Operations that need to split vertices
+	// into subvertices or to repair subvertices are still done one by one. Returns number of successful operations,
+	// or -1 without any change when some cut is not valid (vertices are not linked or the edge is cut twice).
+	struct LinkRequest {
+		int v;
+		int w;
+		std::shared_ptr<EdgeData> edge_data;
+	};
+	int ApplyBatch(const std::vector<LinkRequest> &links, const std::vector<std::pair<int, int>> &cuts);
+
+	// Restore joins every cluster split since the previous Restore once (children before parents). Hook is called at
+	// the end of each Restore of an exposed path with the number of Join callbacks it invoked.
+	void SetRestoreHook(void (*hook)(int joins));
+
+	// With deferred joins the clusters split by an Expose are not joined back when the next Expose starts. Clusters the
+	// next Expose splits again stay splitted, the other ones are joined only before their data is read. Restore and
+	// all the other operations join everything, each cluster is joined exactly once.
+	void SetDeferredJoins(bool deferred);
+
+	// Counters of the internal work (documented in the ITopTree interface): levels and clusters repaired by updates,
+	// Exposes and their simple clusters, Exposes reusing the exposed clusters (Expose of the same path with no
+	// operation between), allocations by Exposes, Restores of exposed paths and their Joins, splitting of vertices
+	// into subvertices and calls of the user defined functions (QueryPath is not counted, it may run in more threads)
+	std::vector<std::pair<std::string, long long>> GetStatistics() const;
+	void ResetStatistics();
+
 	// Return roots of the top trees
 	// std::vector<std::shared_ptr<Cluster> > GetTopTrees();
 
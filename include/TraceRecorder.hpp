@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+
+#include "TopTreeInterface.hpp"
+
+namespace TopTree {
+
+/**
+ * Binary trace of ITopTree calls: header followed by records of a fixed size (both in the byte order of the machine,
+ * so the trace can be memory mapped and read in place). Edges of the underlying tree are recorded as EDGE records
+ * followed by one INIT record (with the number of vertices in v), after that every call is one record. Calls which
+ * failed (returned NULL) are recorded with the failed flag, they did not change the tree.
+ */
+#define TRACE_MAGIC "TTTRACE"
+#define TRACE_VERSION 1
+
+struct TraceHeader {
+	char magic[8]; // TRACE_MAGIC (with the terminating zero)
+	uint32_t version;
+	uint32_t record_size; // sizeof(TraceRecord)
+};
+
+enum TraceOp: uint8_t { TRACE_EDGE, TRACE_INIT, TRACE_LINK, TRACE_CUT, TRACE_EXPOSE, TRACE_QUERY_PATH, TRACE_RESTORE, TRACE_OPS };
+
+struct TraceRecord {
+	uint8_t op; // TraceOp
+	uint8_t failed;
+	uint16_t reserved;
+	int32_t v;
+	int32_t w;
+	int32_t value; // value of the edge (EDGE and LINK), given by the edge_value function of the recorder
+};
+
+/**
+ * Top tree decorator which writes all calls into a trace file and forwards them to the given top tree (it is owned by
+ * the recorder and deleted with it). Data of edges are user defined, so only one number given by the edge_value
+ * function is kept for each of them (zero when no function is given). SplitRoot is forwarded but not recorded.
+ */
+class TraceRecorder: public ITopTree {
+public:
+	TraceRecorder(ITopTree *top_tree, const char *filename, int (*edge_value)(const std::shared_ptr<EdgeData> &edge_data) = NULL);
+	~TraceRecorder();
+
+	void InitFromBaseTree(std::shared_ptr<BaseTree> base_tree);
+
+	// User operations (documented in the ITopTree interface)
+	std::shared_ptr<ICluster> Expose(int v, int w);
+	std::shared_ptr<ICluster> QueryPath(int v, int w);
+	std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr<EdgeData>> Cut(int v, int w);
+	std::shared_ptr<ICluster> Link(int v, int w, std::shared_ptr<EdgeData> edge_data);
+	void Restore();
+	std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> SplitRoot(std::shared_ptr<ICluster> root);
+
+	std::vector<std::pair<std::string, long long>> GetStatistics() const { return top_tree->GetStatistics(); }
+	void ResetStatistics() { top_tree->ResetStatistics(); }
+
+	long long GetRecords() const { return records; } // number of records written
+private:
+	ITopTree *top_tree;
+	FILE *file;
+	int (*edge_value)(const std::shared_ptr<EdgeData> &edge_data);
+	long long records = 0;
+
+	void write(TraceOp op, bool failed, int v, int w, int value = 0);
+};
+
+}
+
+#endif // TRACE_RECORDER_HPP
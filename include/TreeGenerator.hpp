@@ -0,0 +1,87 @@
+#include <string.h>
+#include <random>
+#include <vector>
+
+#ifndef TREE_GENERATOR_HPP
+#define TREE_GENERATOR_HPP
+
+namespace TopTree {
+
+/**
+ * Generators of trees of different shapes for the experiments. Vertex i > 0 always gets a parent with lower number
+ * (so the first i vertices form a tree), the same shape also gives new parents for moved vertices (cut + link), so
+ * the tree keeps its shape while it changes. All randomness comes from the given generator, trees are reproducible
+ * from its seed. Shapes stress different parts of the top trees: paths give the deepest trees (and longest cascades
+ * of update_clusters), stars and power-law trees give vertices of high degree (split into many subvertices by
+ * TopologyTopTree), caterpillars and complete binary trees are in between.
+ */
+class TreeGenerator {
+public:
+	struct Shape {
+		const char *name;
+		int (*parent)(TreeGenerator &generator, int i); // parent of the vertex i (lower than i)
+	};
+	static const std::vector<Shape> &GetShapes() {
+		static const std::vector<Shape> shapes = {
+			{"random", random_parent}, // random recursive tree
+			{"path", path_parent},
+			{"star", star_parent}, // all vertices are leaves of the vertex 0
+			{"caterpillar", caterpillar_parent}, // path of the first half of vertices, each with one leaf
+			{"power_law", power_law_parent}, // preferential attachment (degrees have a power-law distribution)
+			{"binary", binary_parent}, // complete binary tree
+		};
+		return shapes;
+	}
+	// Shape of the given name or NULL when there is no such shape
+	static const Shape *FindShape(const char *name) {
+		for (auto &shape: GetShapes()) if (!strcmp(shape.name, name)) return &shape;
+		return NULL;
+	}
+
+	TreeGenerator(const Shape &shape, int N, std::mt19937_64 &random): shape{shape}, N{N}, random{random} {}
+
+	// Parent of the next vertex of the tree (vertices are added in order from 1 to N - 1)
+	int AddVertex(int i) {
+		int parent = shape.parent(*this, i);
+		endpoints.push_back(parent);
+		endpoints.push_back(i);
+		return parent;
+	}
+	// New parent of the vertex i in the same shape (for moves), the tree of the generator is not changed
+	int GetParent(int i) { return shape.parent(*this, i); }
+
+	// Parents of all N vertices (root 0 is its own parent)
+	std::vector<int> Generate() {
+		std::vector<int> parents(N, 0);
+		for (int i = 1; i < N; i++) parents[i] = AddVertex(i);
+		return parents;
+	}
+
+private:
+	const Shape &shape;
+	int N;
+	std::mt19937_64 &random;
+	std::vector<int> endpoints; // of the added edges (vertex is there as many times as is its degree)
+
+	static int random_parent(TreeGenerator &g, int i) { return g.random() % i; }
+	static int path_parent(TreeGenerator &g, int i) { return i - 1; }
+	static int star_parent(TreeGenerator &g, int i) { return 0; }
+	static int caterpillar_parent(TreeGenerator &g, int i) {
+		if (i < g.N / 2) return i - 1;
+		return i - g.N / 2;
+	}
+	static int binary_parent(TreeGenerator &g, int i) { return (i - 1) / 2; }
+	static int power_law_parent(TreeGenerator &g, int i) {
+		// Endpoint of a random edge restricted to the lower vertices
+		if (g.endpoints.empty()) return 0;
+		for (int attempt = 0; attempt < 10; attempt++) {
+			int v = g.endpoints[g.random() % g.endpoints.size()];
+			if (v < i) return v;
+		}
+		return g.random() % i;
+	}
+};
+
+}
+
+#endif // TREE_GENERATOR_HPP
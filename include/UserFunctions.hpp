@@ -3,24 +3,51 @@
 #ifndef USER_FUNCTIONS_HPP
 #define USER_FUNCTIONS_HPP
 
-#include "TopTreeInterface.hpp"
+#include "BaseTree.hpp"
 
 namespace TopTree {
 
+class ICluster;
+struct ClusterData;
+
 // USER DEFINED FUNCTIONS:
 
+// Clusters given to the functions belong to the tree, which may reset and reuse them (and their data) after the call,
+// so the functions must not keep references to them.
+
 // Joining and splitting of compress/rake clusters:
-extern void Join(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent);
-extern void Split(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent);
+extern void Join(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent);
+extern void Split(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent);
 
 // Creating and destroying Base clusters:
-extern void Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge);
-extern void Destroy(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge);
+extern void Create(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge);
+extern void Destroy(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge);
 
-extern void CopyClusterData(std::shared_ptr<ICluster> from, std::shared_ptr<ICluster> to);
+extern void CopyClusterData(const std::shared_ptr<ICluster> &from, const std::shared_ptr<ICluster> &to);
 
+// Must be thread safe, the parallel construction (InitFromBaseTree with more threads) calls it from more threads at once
 extern std::shared_ptr<ClusterData> InitClusterData();
 // END OF USER DEFINED FUNCTIONS
+
+// Table of the user defined functions used by one top tree (every cluster points to the table of its tree and
+// calls them through it, the calls are not inlined into the trees).
+// Trees constructed without a table use the global functions above, PolicyTopTree (see PolicyTopTree.hpp)
+// creates the table from static methods of a policy class.
+struct UserFunctions {
+	void (*Join)(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent);
+	void (*Split)(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent);
+	void (*Create)(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge);
+	void (*Destroy)(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge);
+	void (*CopyClusterData)(const std::shared_ptr<ICluster> &from, const std::shared_ptr<ICluster> &to);
+	std::shared_ptr<ClusterData> (*InitClusterData)();
+};
+
+// Table of the global functions, they need to be defined only by programs that use it
+inline const UserFunctions *GlobalUserFunctions() {
+	static const UserFunctions functions{Join, Split, Create, Destroy, CopyClusterData, InitClusterData};
+	return &functions;
+}
+
 }
 
 #endif // USER_FUNCTIONS_HPP
@@ -4,6 +4,9 @@
 #include <sstream>
 
 #include "TopTreeInterface.hpp"
+#include "PolicyTopTree.hpp"
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
 
 //#define DEBUG
 //#define DEBUG_VERBOSE
@@ -12,6 +15,8 @@
 //#define ASSERTS
 //#define DISPLAY_ERRORS
 
+namespace DoubleEdge {
+
 class MyVertexData: public TopTree::VertexData {
 public:
 	MyVertexData(std::string label): label{label} {}
@@ -80,6 +85,23 @@ struct MyClusterData: public TopTree::ClusterData {
 	std::vector<int> nonpath_incident_a;
 	std::vector<int> nonpath_incident_b;
 
+	// Recycled cluster data: clear everything, vectors keep their capacity (rows of the two-dimensional ones are
+	// cleared in place, getters resize them back with zeros)
+	bool Reset() {
+		cover = join_step = cover_limit = cover_set = 0;
+		edge = cover_edge = cover_edge_set = NULL;
+		endpoint_a = endpoint_b = 0;
+		for (auto &row: size_a) row.clear();
+		for (auto &row: size_b) row.clear();
+		for (auto &row: incident_a) row.clear();
+		for (auto &row: incident_b) row.clear();
+		nonpath_size_a.clear();
+		nonpath_size_b.clear();
+		nonpath_incident_a.clear();
+		nonpath_incident_b.clear();
+		return true;
+	}
+
 	int get_size(int v, int i, int j) {
 		#ifdef DEBUG_VERBOSE_GETTERS
 			std::cerr << "   getting size " << v << "," << i << "," << j << ": ";
@@ -275,12 +297,9 @@ struct MyClusterData: public TopTree::ClusterData {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+
 class DoubleConnectivity {
-friend void TopTree::Join(std::shared_ptr<TopTree::ICluster> leftChild, std::shared_ptr<TopTree::ICluster> rightChild, std::shared_ptr<TopTree::ICluster> parent);
-friend void TopTree::Split(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent);
-friend void TopTree::Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge);
-friend void TopTree::Destroy(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge);
-friend void TopTree::CopyClusterData(std::shared_ptr<ICluster> from, std::shared_ptr<ICluster> to);
+friend struct Policy;
 public:
 	static DoubleConnectivity *dc;
 
@@ -305,7 +324,7 @@ public:
 		auto cluster = TT->Expose(vv, ww);
 		bool result = false;
 		if (cluster != NULL) {
-			auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+			auto data = get_data(cluster);
 			#ifdef DEBUG
 				std::cerr << "data cover is " << data->cover << std::endl;
 			#endif
@@ -369,7 +388,7 @@ public:
 			//unregister_at_vertices(edge);
 			return;
 		}
-		auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+		auto data = get_data(cluster);
 
 		// 2. Delete edge
 		if (data->edge != NULL) {
@@ -389,7 +408,7 @@ public:
 				unregister_at_vertices(edge);
 				return;
 			}
-			data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+			data = get_data(cluster);
 		}
 		internal_uncover(cluster, edge->level);
 
@@ -411,6 +430,9 @@ private:
 
 	std::list<std::shared_ptr<MyEdgeData>> nontree_edges;
 
+	// Data of a cluster of the top tree (all of them have MyClusterData of the Policy, so no dynamic cast is needed)
+	static MyClusterData *get_data(const std::shared_ptr<TopTree::ICluster> &cluster) { return static_cast<MyClusterData*>(cluster->data.get()); }
+
 	int get_vertex(uint v) {
 		if (v >= vertex_added.size()) {
 			vertex_added.resize(v+1);
@@ -552,7 +574,7 @@ private:
 			return;
 		}
 
-		auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+		auto data = get_data(cluster);
 		#ifdef DEBUG
 			std::cerr << "* Internal cover " << i << " for edge ";
 			if (edge != NULL) std::cerr << *edge;
@@ -600,7 +622,7 @@ private:
 			return;
 		}
 
-		auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+		auto data = get_data(cluster);
 		#ifdef DEBUG
 			std::cerr << "* Internal uncover " << i << " at cluster " << cluster->getLeftBoundary() << "-" << cluster->getRightBoundary() << " with cover " << data->cover  << std::endl;
 		#endif
@@ -639,7 +661,7 @@ private:
 
 	void clean(std::shared_ptr<TopTree::ICluster> leftChild, std::shared_ptr<TopTree::ICluster> rightChild, std::shared_ptr<TopTree::ICluster> parent) {
 		// Part of the Split is an Clean method
-		auto data = std::dynamic_pointer_cast<MyClusterData>(parent->data);
+		auto data = get_data(parent);
 
 		#ifdef DEBUG_VERBOSE
 			std::cerr << "Clean of cluster " << parent->getLeftBoundary() << "-" << parent->getRightBoundary() << " joined in step " << data->join_step;
@@ -686,7 +708,7 @@ private:
 			#endif
 			return;
 		}
-		auto dataC = std::dynamic_pointer_cast<MyClusterData>(clusterC->data);
+		auto dataC = get_data(clusterC);
 
 		std::shared_ptr<MyEdgeData> last_edge = NULL;
 
@@ -709,7 +731,7 @@ private:
 					#endif
 					return;
 				}
-				auto dataD = std::dynamic_pointer_cast<MyClusterData>(clusterD->data);
+				auto dataD = get_data(clusterD);
 				if ((dataD->get_size(edge->from, -1, i+1) + 2) > N/(1<<(i+1))) {
 					internal_cover(clusterD, i, edge);
 					break;
@@ -724,7 +746,7 @@ private:
 					std::cerr << "Recover " << i << " of path " << vv << "-" << ww << " - clusterC is NULL" << std::endl;
 					return;
 				}
-				dataC = std::dynamic_pointer_cast<MyClusterData>(clusterC->data);
+				dataC = get_data(clusterC);
 			}
 			if (u == uu) break;
 			else u = uu; //end of the u=w run
@@ -759,8 +781,8 @@ private:
 				std::swap(A, B);
 			}
 
-			auto data_a = std::dynamic_pointer_cast<MyClusterData>(A->data);
-			//auto data_b = std::dynamic_pointer_cast<MyClusterData>(B->data);
+			auto data_a = get_data(A);
+			//auto data_b = get_data(B);
 
 			// If A is a nonpath child and ... or A is a path cluster and ...
 			if (isLeftRake(A, B, cluster) && data_a->get_nonpath_incident(a, i) > 0) return find(a, A, i); // A is nonpath child
@@ -783,7 +805,7 @@ private:
 			#endif
 			return;
 		}
-		auto data = std::dynamic_pointer_cast<MyClusterData>(edgeCluster->data);
+		auto data = get_data(edgeCluster);
 
 		if (data->edge == NULL) {
 			std::cerr << "Edge cluster " << vv << "-" << ww << " does not have underlying edge" << std::endl;
@@ -837,285 +859,283 @@ private:
 };
 DoubleConnectivity* DoubleConnectivity::dc = NULL;
 
-
 ////////////////////////////////////////////////////////////////////////////////
 
-// Merge
-void TopTree::Join(std::shared_ptr<TopTree::ICluster> leftChild, std::shared_ptr<TopTree::ICluster> rightChild, std::shared_ptr<TopTree::ICluster> parent) {
-	auto data = std::dynamic_pointer_cast<MyClusterData>(parent->data);
-	auto left_data = std::dynamic_pointer_cast<MyClusterData>(leftChild->data);
-	auto right_data = std::dynamic_pointer_cast<MyClusterData>(rightChild->data);
+// User defined functions (used by the top trees below instead of the global ones)
+struct Policy {
+	typedef MyClusterData Data;
+	typedef MyEdgeData Edge;
 
-	auto dc = DoubleConnectivity::dc;
+	// Merge
+	static void Join(const std::shared_ptr<TopTree::ICluster> &leftChild, const std::shared_ptr<TopTree::ICluster> &rightChild, const std::shared_ptr<TopTree::ICluster> &parent,
+		MyClusterData *left_data, MyClusterData *right_data, MyClusterData *data) {
+		auto dc = DoubleConnectivity::dc;
 
-	#ifdef DEBUG
-		std::cerr << "JOIN " << dc->join_counter <<  " of cluster " << leftChild->getLeftBoundary()  << "-" << leftChild->getRightBoundary() << "(" << left_data->cover << ")"
-		<< " and " << rightChild->getLeftBoundary()  << "-" << rightChild->getRightBoundary() << "(" << right_data->cover << ")"
-		<< " into " << parent->getLeftBoundary()  << "-" << parent->getRightBoundary() << std::endl;
-	#endif
+		#ifdef DEBUG
+			std::cerr << "JOIN " << dc->join_counter <<  " of cluster " << leftChild->getLeftBoundary()  << "-" << leftChild->getRightBoundary() << "(" << left_data->cover << ")"
+			<< " and " << rightChild->getLeftBoundary()  << "-" << rightChild->getRightBoundary() << "(" << right_data->cover << ")"
+			<< " into " << parent->getLeftBoundary()  << "-" << parent->getRightBoundary() << std::endl;
+		#endif
 
-	// HOTFIX FIXUP
-	/*
-	if ((leftChild->getLeftBoundary() != left_data->endpoint_a && leftChild->getLeftBoundary() != left_data->endpoint_b)
-		|| (leftChild->getRightBoundary() != left_data->endpoint_a && leftChild->getRightBoundary() != left_data->endpoint_b)) {
-			left_data->endpoint_a = leftChild->getLeftBoundary();
-			left_data->endpoint_b = leftChild->getRightBoundary();
-		}
+		// HOTFIX FIXUP
+		/*
+		if ((leftChild->getLeftBoundary() != left_data->endpoint_a && leftChild->getLeftBoundary() != left_data->endpoint_b)
+			|| (leftChild->getRightBoundary() != left_data->endpoint_a && leftChild->getRightBoundary() != left_data->endpoint_b)) {
+				left_data->endpoint_a = leftChild->getLeftBoundary();
+				left_data->endpoint_b = leftChild->getRightBoundary();
+			}
 
-	// HOTFIX FIXUP
-	if ((rightChild->getLeftBoundary() != right_data->endpoint_a && rightChild->getLeftBoundary() != right_data->endpoint_b)
-		|| (rightChild->getRightBoundary() != right_data->endpoint_a && rightChild->getRightBoundary() != right_data->endpoint_b)) {
-			right_data->endpoint_a = rightChild->getLeftBoundary();
-			right_data->endpoint_b = rightChild->getRightBoundary();
-		}
-	*/
+		// HOTFIX FIXUP
+		if ((rightChild->getLeftBoundary() != right_data->endpoint_a && rightChild->getLeftBoundary() != right_data->endpoint_b)
+			|| (rightChild->getRightBoundary() != right_data->endpoint_a && rightChild->getRightBoundary() != right_data->endpoint_b)) {
+				right_data->endpoint_a = rightChild->getLeftBoundary();
+				right_data->endpoint_b = rightChild->getRightBoundary();
+			}
+		*/
 
-	/*
-	std::cerr << "PARENT JOIN: " << parent->getLeftBoundary() << "-" << parent->getRightBoundary() << std::endl;
-
-	std::cerr << "Left: " << leftChild->getLeftBoundary() << "-" << leftChild->getRightBoundary() << std::endl;
-	std::cerr << "Left: " << left_data->endpoint_a << "-" << left_data->endpoint_b << std::endl;
-
-	std::cerr << "Right: " << rightChild->getLeftBoundary() << "-" << rightChild->getRightBoundary() << std::endl;
-	std::cerr << "Right: " << right_data->endpoint_a << "-" << right_data->endpoint_b << std::endl;
-	*/
-
-	/////////////////////////////////////////////////////////
-	// Init endpoints in the new cluster - O(1) computations:
-	data->endpoint_a = parent->getLeftBoundary();
-	data->endpoint_b = parent->getRightBoundary();
-
-	data->join_step = dc->join_counter++;
-
-	// Find path child minimizing cover
-	if (isLeftRake(leftChild, rightChild, parent)) {
-		data->cover = right_data->cover;
-		data->cover_edge = right_data->cover_edge;
-		data->edge = right_data->edge; // copy the underlying edge if only from one child
-	} else if (isRightRake(leftChild, rightChild, parent)) {
-		data->cover = left_data->cover;
-		data->cover_edge = left_data->cover_edge;
-		data->edge = left_data->edge; // copy the underlying edge if only from one child
-	} else {
-		if (left_data->cover < right_data->cover) {
+		/*
+		std::cerr << "PARENT JOIN: " << parent->getLeftBoundary() << "-" << parent->getRightBoundary() << std::endl;
+
+		std::cerr << "Left: " << leftChild->getLeftBoundary() << "-" << leftChild->getRightBoundary() << std::endl;
+		std::cerr << "Left: " << left_data->endpoint_a << "-" << left_data->endpoint_b << std::endl;
+
+		std::cerr << "Right: " << rightChild->getLeftBoundary() << "-" << rightChild->getRightBoundary() << std::endl;
+		std::cerr << "Right: " << right_data->endpoint_a << "-" << right_data->endpoint_b << std::endl;
+		*/
+
+		/////////////////////////////////////////////////////////
+		// Init endpoints in the new cluster - O(1) computations:
+		data->endpoint_a = parent->getLeftBoundary();
+		data->endpoint_b = parent->getRightBoundary();
+
+		data->join_step = dc->join_counter++;
+
+		// Find path child minimizing cover
+		if (TopTree::isLeftRake(*leftChild, *rightChild, *parent)) {
+			data->cover = right_data->cover;
+			data->cover_edge = right_data->cover_edge;
+			data->edge = right_data->edge; // copy the underlying edge if only from one child
+		} else if (TopTree::isRightRake(*leftChild, *rightChild, *parent)) {
 			data->cover = left_data->cover;
 			data->cover_edge = left_data->cover_edge;
+			data->edge = left_data->edge; // copy the underlying edge if only from one child
 		} else {
-			data->cover = right_data->cover;
-			data->cover_edge = right_data->cover_edge;
+			if (left_data->cover < right_data->cover) {
+				data->cover = left_data->cover;
+				data->cover_edge = left_data->cover_edge;
+			} else {
+				data->cover = right_data->cover;
+				data->cover_edge = right_data->cover_edge;
+			}
 		}
-	}
-	data->cover_set = -1;
-	data->cover_limit = -1;
-	data->cover_edge_set = NULL;
+		data->cover_set = -1;
+		data->cover_limit = -1;
+		data->cover_edge_set = NULL;
 
-	///////////////////////////////////////////////////
-	// Time consuming computations in O(log^2 N) below:
+		///////////////////////////////////////////////////
+		// Time consuming computations in O(log^2 N) below:
 
-	if (dc->quick_expose && dc->quick_expose_running) return; // skip slow computations below
+		if (dc->quick_expose && dc->quick_expose_running) return; // skip slow computations below
 
-	int common = leftChild->getLeftBoundary();
-	if (common != rightChild->getLeftBoundary() && common != rightChild->getRightBoundary()) common = leftChild->getRightBoundary();
+		int common = leftChild->getLeftBoundary();
+		if (common != rightChild->getLeftBoundary() && common != rightChild->getRightBoundary()) common = leftChild->getRightBoundary();
 
-	int other_left = (leftChild->getLeftBoundary() == common ? leftChild->getRightBoundary() : leftChild->getLeftBoundary());
-	int other_right = (rightChild->getLeftBoundary() == common ? rightChild->getRightBoundary() : rightChild->getLeftBoundary());
+		int other_left = (leftChild->getLeftBoundary() == common ? leftChild->getRightBoundary() : leftChild->getLeftBoundary());
+		int other_right = (rightChild->getLeftBoundary() == common ? rightChild->getRightBoundary() : rightChild->getLeftBoundary());
 
-	// A) Computation of nonpath_size[a][j] for a in {a,b} and j in 0...max_l
-	if (isCompress(leftChild, rightChild, parent)) {
+		// A) Computation of nonpath_size[a][j] for a in {a,b} and j in 0...max_l
+		if (TopTree::isCompress(*leftChild, *rightChild, *parent)) {
 
-		// Because we don't know which one of endpoint will be used compute for both a and c - figure 1(3)
-		// For other vertex from leftChild
-		int other = other_left;
-		for (int j = 0; j <= dc->max_l; j++) {
-			int size = left_data->get_size(other, j, j);
-			int incident = left_data->get_size(other, j, j);
-			if (left_data->cover >= j) {
-				size += dc->get_size(common, j) + right_data->get_nonpath_size(common, j);
-				incident += dc->get_incident(common, j) + right_data->get_nonpath_incident(common, j);
+			// Because we don't know which one of endpoint will be used compute for both a and c - figure 1(3)
+			// For other vertex from leftChild
+			int other = other_left;
+			for (int j = 0; j <= dc->max_l; j++) {
+				int size = left_data->get_size(other, j, j);
+				int incident = left_data->get_size(other, j, j);
+				if (left_data->cover >= j) {
+					size += dc->get_size(common, j) + right_data->get_nonpath_size(common, j);
+					incident += dc->get_incident(common, j) + right_data->get_nonpath_incident(common, j);
+				}
+				data->set_nonpath_size(other, j, size);
+				data->set_nonpath_incident(other, j, incident);
 			}
-			data->set_nonpath_size(other, j, size);
-			data->set_nonpath_incident(other, j, incident);
-		}
 
-		// For oher vertex from rightChild
-		other = other_right;
-		for (int j = 0; j <= dc->max_l; j++) {
-			int size = right_data->get_size(other, j, j);
-			int incident = right_data->get_size(other, j, j);
-			if (left_data->cover >= j) {
-				size += dc->get_size(common, j) + right_data->get_nonpath_size(common, j);
-				incident += dc->get_incident(common, j) + right_data->get_nonpath_incident(common, j);
+			// For oher vertex from rightChild
+			other = other_right;
+			for (int j = 0; j <= dc->max_l; j++) {
+				int size = right_data->get_size(other, j, j);
+				int incident = right_data->get_size(other, j, j);
+				if (left_data->cover >= j) {
+					size += dc->get_size(common, j) + right_data->get_nonpath_size(common, j);
+					incident += dc->get_incident(common, j) + right_data->get_nonpath_incident(common, j);
+				}
+				data->set_nonpath_size(other, j, size);
+				data->set_nonpath_incident(other, j, incident);
 			}
-			data->set_nonpath_size(other, j, size);
-			data->set_nonpath_incident(other, j, incident);
-		}
-	} else {
-		// Some rake, not interesting which - figure 1(4)
-		for (int j = 0; j <= dc->max_l; j++) {
-			data->set_nonpath_size(common, j,
-				left_data->get_nonpath_size(common, j) + right_data->get_nonpath_size(common, j)
-			);
-			data->set_nonpath_incident(common, j,
-				left_data->get_nonpath_incident(common, j) + right_data->get_nonpath_incident(common, j)
-			);
-		}
-	}
-
-	// B) Computation of path size[a][i][j] for i,j in -1...max_l
-	if (isLeftRake(leftChild, rightChild, parent)) {
-		// left {common} is raked on the right one {common,other_right} - set for common and other_right
-		for (int i = -1; i <= dc->max_l; i++) {
-			for (int j = -1; j <= dc->max_l; j++) {
-				data->set_size(common, i, j,
-					left_data->get_nonpath_size(common, j) + right_data->get_size(common, i, j)
+		} else {
+			// Some rake, not interesting which - figure 1(4)
+			for (int j = 0; j <= dc->max_l; j++) {
+				data->set_nonpath_size(common, j,
+					left_data->get_nonpath_size(common, j) + right_data->get_nonpath_size(common, j)
 				);
-				data->set_incident(common, i, j,
-					left_data->get_nonpath_incident(common, j) + right_data->get_incident(common, i, j)
+				data->set_nonpath_incident(common, j,
+					left_data->get_nonpath_incident(common, j) + right_data->get_nonpath_incident(common, j)
 				);
-
-				int size = right_data->get_size(other_right, i, j);
-				int incident = right_data->get_incident(other_right, i, j);
-				if (right_data->cover >= i) {
-					size += left_data->get_nonpath_size(other_left, j);
-					incident += left_data->get_nonpath_incident(other_left, j);
-				}
-				data->set_size(other_right, i, j, size);
-				data->set_incident(other_right, i, j, incident);
 			}
 		}
-	} else if (isRightRake(leftChild, rightChild, parent)) {
-		// right {common} is raked on the left one {common,other_left} - set for common and other_left
-		for (int i = -1; i <= dc->max_l; i++) {
-			for (int j = -1; j <= dc->max_l; j++) {
-				data->set_size(common, i, j,
-					right_data->get_nonpath_size(common, j) + left_data->get_size(common, i, j)
-				);
-				data->set_incident(common, i, j,
-					right_data->get_nonpath_incident(common, j) + left_data->get_incident(common, i, j)
-				);
 
-				int size = left_data->get_size(other_left, i, j);
-				int incident = left_data->get_incident(other_left, i, j);
-				if (left_data->cover >= i) {
-					size += right_data->get_nonpath_size(other_right, j);
-					incident += right_data->get_nonpath_incident(other_right, j);
+		// B) Computation of path size[a][i][j] for i,j in -1...max_l
+		if (TopTree::isLeftRake(*leftChild, *rightChild, *parent)) {
+			// left {common} is raked on the right one {common,other_right} - set for common and other_right
+			for (int i = -1; i <= dc->max_l; i++) {
+				for (int j = -1; j <= dc->max_l; j++) {
+					data->set_size(common, i, j,
+						left_data->get_nonpath_size(common, j) + right_data->get_size(common, i, j)
+					);
+					data->set_incident(common, i, j,
+						left_data->get_nonpath_incident(common, j) + right_data->get_incident(common, i, j)
+					);
+
+					int size = right_data->get_size(other_right, i, j);
+					int incident = right_data->get_incident(other_right, i, j);
+					if (right_data->cover >= i) {
+						size += left_data->get_nonpath_size(other_left, j);
+						incident += left_data->get_nonpath_incident(other_left, j);
+					}
+					data->set_size(other_right, i, j, size);
+					data->set_incident(other_right, i, j, incident);
 				}
-				data->set_size(other_left, i, j, size);
-				data->set_incident(other_left, i, j, incident);
 			}
-		}
-	} else { // Compress
-		for (int i = -1; i <= dc->max_l; i++) {
-			for (int j = -1; j <= dc->max_l; j++) {
-				// for other_left
-				int size = left_data->get_size(other_left, i, j);
-				int incident = left_data->get_incident(other_left, i, j);
-				if (left_data->cover >= i) {
-					size += dc->get_size(common, j) + right_data->get_size(common, i, j);
-					incident += dc->get_incident(common, j) + right_data->get_incident(common, i, j);
+		} else if (TopTree::isRightRake(*leftChild, *rightChild, *parent)) {
+			// right {common} is raked on the left one {common,other_left} - set for common and other_left
+			for (int i = -1; i <= dc->max_l; i++) {
+				for (int j = -1; j <= dc->max_l; j++) {
+					data->set_size(common, i, j,
+						right_data->get_nonpath_size(common, j) + left_data->get_size(common, i, j)
+					);
+					data->set_incident(common, i, j,
+						right_data->get_nonpath_incident(common, j) + left_data->get_incident(common, i, j)
+					);
+
+					int size = left_data->get_size(other_left, i, j);
+					int incident = left_data->get_incident(other_left, i, j);
+					if (left_data->cover >= i) {
+						size += right_data->get_nonpath_size(other_right, j);
+						incident += right_data->get_nonpath_incident(other_right, j);
+					}
+					data->set_size(other_left, i, j, size);
+					data->set_incident(other_left, i, j, incident);
 				}
-				data->set_size(other_left, i, j, size);
-				data->set_incident(other_left, i, j, incident);
-
-				// for other_right
-				size = right_data->get_size(other_right, i, j);
-				incident = right_data->get_incident(other_right, i, j);
-				if (right_data->cover >= i) {
-					size += dc->get_size(common, j) + left_data->get_size(common, i, j);
-					incident += dc->get_incident(common, j) + left_data->get_incident(common, i, j);
+			}
+		} else { // Compress
+			for (int i = -1; i <= dc->max_l; i++) {
+				for (int j = -1; j <= dc->max_l; j++) {
+					// for other_left
+					int size = left_data->get_size(other_left, i, j);
+					int incident = left_data->get_incident(other_left, i, j);
+					if (left_data->cover >= i) {
+						size += dc->get_size(common, j) + right_data->get_size(common, i, j);
+						incident += dc->get_incident(common, j) + right_data->get_incident(common, i, j);
+					}
+					data->set_size(other_left, i, j, size);
+					data->set_incident(other_left, i, j, incident);
+
+					// for other_right
+					size = right_data->get_size(other_right, i, j);
+					incident = right_data->get_incident(other_right, i, j);
+					if (right_data->cover >= i) {
+						size += dc->get_size(common, j) + left_data->get_size(common, i, j);
+						incident += dc->get_incident(common, j) + left_data->get_incident(common, i, j);
+					}
+					data->set_size(other_right, i, j, size);
+					data->set_incident(other_right, i, j, incident);
 				}
-				data->set_size(other_right, i, j, size);
-				data->set_incident(other_right, i, j, incident);
 			}
 		}
-	}
 
-	#ifdef DEBUG
-		std::cerr << "JOIN result: cover " << data->cover << std::endl;
-	#endif
-} // COMPLETE
-void TopTree::Split(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent) {
-	DoubleConnectivity::dc->clean(leftChild, rightChild, parent);
-	// delete C - not needed, it will be deleted by TopTrees structure
-} // COMPLETE
-
-// Creating and destroying Base clusters:
-void TopTree::Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
-	auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
-	auto edge_data = std::dynamic_pointer_cast<MyEdgeData>(edge);
-
-	#ifdef DEBUG
-		std::cerr << "Creating cluster for edge " << edge_data->from << "-" << edge_data->to << " with cover " << edge_data->cover << std::endl;
-	#endif
-
-	data->endpoint_a = cluster->getLeftBoundary();
-	data->endpoint_b = cluster->getRightBoundary();
-
-	data->edge = edge_data;
-
-	data->cover = edge_data->cover;
-
-	// Backup (or defaults) from underlying edge
-	data->cover = edge_data->cover;
-	data->cover_edge = edge_data->cover_edge;
-} // COMPLETE
-void TopTree::Destroy(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
-	auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
-	auto edge_data = std::dynamic_pointer_cast<MyEdgeData>(edge);
-
-	#ifdef DEBUG
-		std::cerr << "Destroying cluster for edge " << edge_data->from << "-" << edge_data->to << " with cover " << data->cover << std::endl;
-	#endif
-
-	// Backup into cluster
-	edge_data->cover = data->cover;
-	edge_data->cover_edge = data->cover_edge;
-} // COMPLETE
-
-std::shared_ptr<TopTree::ClusterData> TopTree::InitClusterData() {
-	return std::make_shared<MyClusterData>();
-}
+		#ifdef DEBUG
+			std::cerr << "JOIN result: cover " << data->cover << std::endl;
+		#endif
+	} // COMPLETE
+	static void Split(const std::shared_ptr<TopTree::ICluster> &leftChild, const std::shared_ptr<TopTree::ICluster> &rightChild, const std::shared_ptr<TopTree::ICluster> &parent,
+		MyClusterData *left_data, MyClusterData *right_data, MyClusterData *parent_data) {
+		DoubleConnectivity::dc->clean(leftChild, rightChild, parent);
+		// delete C - not needed, it will be deleted by TopTrees structure
+	} // COMPLETE
 
-void TopTree::CopyClusterData(std::shared_ptr<ICluster> from, std::shared_ptr<ICluster> to) {
-	#ifdef DEBUG
-		//std::cerr << "COPY from cluster " << from->getLeftBoundary()  << "-" << from->getRightBoundary()
-		//<< " to " << to->getLeftBoundary()  << "-" << to->getRightBoundary() << std::endl;
-		std::cerr << "COPY from cluster " << from << " to " << to << std::endl;
-	#endif
+	// Creating and destroying Base clusters:
+	static void Create(const std::shared_ptr<TopTree::ICluster> &cluster, MyClusterData *data, const std::shared_ptr<MyEdgeData> &edge_data) {
+		#ifdef DEBUG
+			std::cerr << "Creating cluster for edge " << edge_data->from << "-" << edge_data->to << " with cover " << edge_data->cover << std::endl;
+		#endif
 
-	auto fromData = std::dynamic_pointer_cast<MyClusterData>(from->data);
-	auto toData = std::dynamic_pointer_cast<MyClusterData>(to->data);
+		data->endpoint_a = cluster->getLeftBoundary();
+		data->endpoint_b = cluster->getRightBoundary();
 
-	toData->join_step = fromData->join_step;
+		data->edge = edge_data;
 
-	toData->cover = fromData->cover;
-	toData->cover_limit = fromData->cover_limit;
-	toData->cover_set = fromData->cover_set;
+		data->cover = edge_data->cover;
 
-	toData->edge = fromData->edge;
-	toData->cover_edge = fromData->cover_edge;
-	toData->cover_edge_set = fromData->cover_edge_set;
+		// Backup (or defaults) from underlying edge
+		data->cover = edge_data->cover;
+		data->cover_edge = edge_data->cover_edge;
+	} // COMPLETE
+	static void Destroy(const std::shared_ptr<TopTree::ICluster> &cluster, MyClusterData *data, const std::shared_ptr<MyEdgeData> &edge_data) {
+		#ifdef DEBUG
+			std::cerr << "Destroying cluster for edge " << edge_data->from << "-" << edge_data->to << " with cover " << data->cover << std::endl;
+		#endif
+
+		// Backup into cluster
+		edge_data->cover = data->cover;
+		edge_data->cover_edge = data->cover_edge;
+	} // COMPLETE
+
+	static void CopyClusterData(const std::shared_ptr<TopTree::ICluster> &from, const std::shared_ptr<TopTree::ICluster> &to, MyClusterData *fromData, MyClusterData *toData) {
+		#ifdef DEBUG
+			//std::cerr << "COPY from cluster " << from->getLeftBoundary()  << "-" << from->getRightBoundary()
+			//<< " to " << to->getLeftBoundary()  << "-" << to->getRightBoundary() << std::endl;
+			std::cerr << "COPY from cluster " << from << " to " << to << std::endl;
+		#endif
 
-	toData->endpoint_a = fromData->endpoint_a;
-	toData->endpoint_b = fromData->endpoint_b;
+		toData->join_step = fromData->join_step;
 
-	auto dc = DoubleConnectivity::dc;
+		toData->cover = fromData->cover;
+		toData->cover_limit = fromData->cover_limit;
+		toData->cover_set = fromData->cover_set;
 
-	if (dc->quick_expose && dc->quick_expose_running) return; // skip slow computations below
+		toData->edge = fromData->edge;
+		toData->cover_edge = fromData->cover_edge;
+		toData->cover_edge_set = fromData->cover_edge_set;
 
-	auto a = toData->endpoint_a;
-	auto b = toData->endpoint_b;
+		toData->endpoint_a = fromData->endpoint_a;
+		toData->endpoint_b = fromData->endpoint_b;
 
-	for (int i = 0; i <= dc->max_l; i++) {
-		for (int j = 0; j <= dc->max_l; j++) {
-			toData->set_size(a, i, j, fromData->get_size(a, i, j));
-			toData->set_size(b, i, j, fromData->get_size(b, i, j));
-			toData->set_incident(a, i, j, fromData->get_incident(a, i, j));
-			toData->set_incident(b, i, j, fromData->get_incident(b, i, j));
+		auto dc = DoubleConnectivity::dc;
+
+		if (dc->quick_expose && dc->quick_expose_running) return; // skip slow computations below
+
+		auto a = toData->endpoint_a;
+		auto b = toData->endpoint_b;
+
+		for (int i = 0; i <= dc->max_l; i++) {
+			for (int j = 0; j <= dc->max_l; j++) {
+				toData->set_size(a, i, j, fromData->get_size(a, i, j));
+				toData->set_size(b, i, j, fromData->get_size(b, i, j));
+				toData->set_incident(a, i, j, fromData->get_incident(a, i, j));
+				toData->set_incident(b, i, j, fromData->get_incident(b, i, j));
+			}
+			toData->set_nonpath_size(a, i, fromData->get_nonpath_size(a, i));
+			toData->set_nonpath_size(b, i, fromData->get_nonpath_size(b, i));
+			toData->set_nonpath_incident(a, i, fromData->get_nonpath_incident(a, i));
+			toData->set_nonpath_incident(b, i, fromData->get_nonpath_incident(b, i));
 		}
-		toData->set_nonpath_size(a, i, fromData->get_nonpath_size(a, i));
-		toData->set_nonpath_size(b, i, fromData->get_nonpath_size(b, i));
-		toData->set_nonpath_incident(a, i, fromData->get_nonpath_incident(a, i));
-		toData->set_nonpath_incident(b, i, fromData->get_nonpath_incident(b, i));
 	}
+};
+
+// Top trees solving this problem
+typedef TopTree::PolicyTopTree<Policy, TopTree::STTopTree> STTopTree;
+typedef TopTree::PolicyTopTree<Policy, TopTree::TopologyTopTree> TopologyTopTree;
+
 }
+
+using DoubleEdge::DoubleConnectivity;
@@ -3,6 +3,11 @@
 #include <sstream>
 
 #include "TopTreeInterface.hpp"
+#include "PolicyTopTree.hpp"
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
+
+namespace MaxEdge {
 
 class MyEdgeData: public TopTree::EdgeData {
 public:
@@ -29,13 +34,89 @@ struct MyClusterData: public TopTree::ClusterData {
 	int w_max;
 	std::shared_ptr<MyEdgeData> w_max_edge;
 	int w_extra;
+
+	bool Reset() {
+		w_max = w_extra = 0;
+		w_max_edge = NULL;
+		return true;
+	}
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// User defined functions (used by the top trees below instead of the global ones)
+struct Policy {
+	typedef MyClusterData Data;
+	typedef MyEdgeData Edge;
+
+	static void Join(const std::shared_ptr<TopTree::ICluster> &leftChild, const std::shared_ptr<TopTree::ICluster> &rightChild, const std::shared_ptr<TopTree::ICluster> &parent,
+		MyClusterData *left_data, MyClusterData *right_data, MyClusterData *parent_data) {
+		if (TopTree::isLeftRake(*leftChild, *rightChild, *parent)) {
+			parent_data->w_max = right_data->w_max;
+			parent_data->w_max_edge = right_data->w_max_edge;
+		} else if (TopTree::isRightRake(*leftChild, *rightChild, *parent)) {
+			parent_data->w_max = left_data->w_max;
+			parent_data->w_max_edge = left_data->w_max_edge;
+		} else {
+			if (left_data->w_max > right_data->w_max) {
+				parent_data->w_max = left_data->w_max;
+				parent_data->w_max_edge = left_data->w_max_edge;
+			} else {
+				parent_data->w_max = right_data->w_max;
+				parent_data->w_max_edge = right_data->w_max_edge;
+			}
+		}
+		// There is no extra weight yet
+		parent_data->w_extra = 0;
+	}
+	static void Split(const std::shared_ptr<TopTree::ICluster> &leftChild, const std::shared_ptr<TopTree::ICluster> &rightChild, const std::shared_ptr<TopTree::ICluster> &parent,
+		MyClusterData *left_data, MyClusterData *right_data, MyClusterData *parent_data) {
+		// Distribute w_extra to childs
+		if (TopTree::isLeftRake(*leftChild, *rightChild, *parent)) {
+			right_data->w_extra += parent_data->w_extra;
+			right_data->w_max += parent_data->w_extra;
+		} else if (TopTree::isRightRake(*leftChild, *rightChild, *parent)) {
+			left_data->w_extra += parent_data->w_extra;
+			left_data->w_max += parent_data->w_extra;
+		} else {
+			// Left
+			left_data->w_extra += parent_data->w_extra;
+			left_data->w_max += parent_data->w_extra;
+			// Right
+			right_data->w_extra += parent_data->w_extra;
+			right_data->w_max += parent_data->w_extra;
+		}
+	}
+
+	// Creating and destroying Base clusters:
+	static void Create(const std::shared_ptr<TopTree::ICluster> &cluster, MyClusterData *data, const std::shared_ptr<MyEdgeData> &edge_data) {
+		data->w_max = edge_data->weight;
+		data->w_max_edge = edge_data;
+		data->w_extra = 0;
+	}
+	static void Destroy(const std::shared_ptr<TopTree::ICluster> &cluster, MyClusterData *data, const std::shared_ptr<MyEdgeData> &edge_data) {
+		edge_data->weight = data->w_max;
+	}
+
+	static void CopyClusterData(const std::shared_ptr<TopTree::ICluster> &from, const std::shared_ptr<TopTree::ICluster> &to, MyClusterData *fromData, MyClusterData *toData) {
+		toData->w_max = fromData->w_max;
+		toData->w_max_edge = fromData->w_max_edge;
+		toData->w_extra = fromData->w_extra;
+	}
+};
+
+// Top trees solving this problem
+typedef TopTree::PolicyTopTree<Policy, TopTree::STTopTree> STTopTree;
+typedef TopTree::PolicyTopTree<Policy, TopTree::TopologyTopTree> TopologyTopTree;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
 class MaximumEdgeWeight {
 public:
-	MaximumEdgeWeight(TopTree::ITopTree *top_tree): top_tree{top_tree}, base_tree{std::make_shared<TopTree::BaseTree>()} {}
+	MaximumEdgeWeight(TopTree::ITopTree *top_tree, bool arena_storage = true): top_tree{top_tree}, base_tree{std::make_shared<TopTree::BaseTree>(arena_storage)} {}
 
 	~MaximumEdgeWeight() {
 		delete(top_tree);
@@ -43,7 +124,7 @@ public:
 
 	int add_vertex(std::string label) {
 		// Add vertex adds vertex every time in the BaseTree
-		int index = base_tree->AddVertex(std::make_shared<MyVertexData>(label));
+		int index = base_tree->AddVertex(std::make_shared<MaxEdge::MyVertexData>(label));
 		vertices.push_back(vertex{label, index});
 		return vertices.size() - 1;
 	}
@@ -53,7 +134,7 @@ public:
 		int index = edges.size() - 1;
 		std::ostringstream ss;
 		ss << vertices[a].index << "," << vertices[b].index;
-		auto edge_data = std::make_shared<MyEdgeData>(index, weight, ss.str());
+		auto edge_data = std::make_shared<MaxEdge::MyEdgeData>(index, weight, ss.str());
 
 		// When not initialized add to BaseTree, otherwise call Link
 		if (!initialized) base_tree->AddEdge(vertices[a].index, vertices[b].index, edge_data);
@@ -81,7 +162,7 @@ public:
 		auto cluster = top_tree->Expose(vertices[a].index, vertices[b].index);
 		if (cluster == NULL) return false;
 
-		auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
+		auto data = MaxEdge::STTopTree::GetData(cluster);
 		data->w_extra += extra_weight;
 		data->w_max += extra_weight;
 		return true;
@@ -92,13 +173,15 @@ public:
 		int max_weight;
 		int edge_index;
 	};
+	const TopTree::ITopTree *get_top_tree() const { return top_tree; }
+
 	struct max_weight_result get_max_weight_on_path(int a, int b) {
-		auto cluster = top_tree->Expose(vertices[a].index, vertices[b].index);
+		top_tree->Restore(); // QueryPath does not read a tree with unrestored Expose (of add_weight_on_path)
+		auto cluster = top_tree->QueryPath(vertices[a].index, vertices[b].index);
 		if (cluster == NULL) return max_weight_result{false, 0, 0};
 
-		auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
-		auto edge = std::dynamic_pointer_cast<MyEdgeData>(data->w_max_edge);
-		return max_weight_result{true, data->w_max, edge->index};
+		auto data = MaxEdge::STTopTree::GetData(cluster);
+		return max_weight_result{true, data->w_max, data->w_max_edge->index};
 	}
 
 private:
@@ -119,77 +202,3 @@ private:
 	std::vector<vertex> vertices;
 	std::vector<edge> edges;
 };
-
-////////////////////////////////////////////////////////////////////////////////
-
-void TopTree::Join(std::shared_ptr<TopTree::ICluster> leftChild, std::shared_ptr<TopTree::ICluster> rightChild, std::shared_ptr<TopTree::ICluster> parent) {
-	auto left_data = std::dynamic_pointer_cast<MyClusterData>(leftChild->data);
-	auto right_data = std::dynamic_pointer_cast<MyClusterData>(rightChild->data);
-	auto parent_data = std::dynamic_pointer_cast<MyClusterData>(parent->data);
-
-	if (isLeftRake(leftChild, rightChild, parent)) {
-		parent_data->w_max = right_data->w_max;
-		parent_data->w_max_edge = right_data->w_max_edge;
-	} else if (isRightRake(leftChild, rightChild, parent)) {
-		parent_data->w_max = left_data->w_max;
-		parent_data->w_max_edge = left_data->w_max_edge;
-	} else {
-		if (left_data->w_max > right_data->w_max) {
-			parent_data->w_max = left_data->w_max;
-			parent_data->w_max_edge = left_data->w_max_edge;
-		} else {
-			parent_data->w_max = right_data->w_max;
-			parent_data->w_max_edge = right_data->w_max_edge;
-		}
-	}
-	// There is no extra weight yet
-	parent_data->w_extra = 0;
-}
-void TopTree::Split(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent) {
-	auto left_data = std::dynamic_pointer_cast<MyClusterData>(leftChild->data);
-	auto right_data = std::dynamic_pointer_cast<MyClusterData>(rightChild->data);
-	auto parent_data = std::dynamic_pointer_cast<MyClusterData>(parent->data);
-
-	// Distribute w_extra to childs
-	if (isLeftRake(leftChild, rightChild, parent)) {
-		right_data->w_extra += parent_data->w_extra;
-		right_data->w_max += parent_data->w_extra;
-	} else if (isRightRake(leftChild, rightChild, parent)) {
-		left_data->w_extra += parent_data->w_extra;
-		left_data->w_max += parent_data->w_extra;
-	} else {
-		// Left
-		left_data->w_extra += parent_data->w_extra;
-		left_data->w_max += parent_data->w_extra;
-		// Right
-		right_data->w_extra += parent_data->w_extra;
-		right_data->w_max += parent_data->w_extra;
-	}
-}
-
-// Creating and destroying Base clusters:
-void TopTree::Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
-	auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
-	auto edge_data = std::dynamic_pointer_cast<MyEdgeData>(edge);
-	data->w_max = edge_data->weight;
-	data->w_max_edge = edge_data;
-	data->w_extra = 0;
-}
-void TopTree::Destroy(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
-	auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
-	auto edge_data = std::dynamic_pointer_cast<MyEdgeData>(edge);
-	edge_data->weight = data->w_max;
-}
-
-void TopTree::CopyClusterData(std::shared_ptr<ICluster> from, std::shared_ptr<ICluster> to) {
-	auto fromData = std::dynamic_pointer_cast<MyClusterData>(from->data);
-	auto toData = std::dynamic_pointer_cast<MyClusterData>(to->data);
-
-	toData->w_max = fromData->w_max;
-	toData->w_max_edge = fromData->w_max_edge;
-	toData->w_extra = fromData->w_extra;
-}
-
-std::shared_ptr<TopTree::ClusterData> TopTree::InitClusterData() {
-	return std::make_shared<MyClusterData>();
-}
@@ -16,7 +16,7 @@ int EdgeData::e_counter = 0;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-BaseTree::BaseTree() : internal{std::make_unique<Internal>()} {}
+BaseTree::BaseTree(bool arena_storage) : internal{std::make_unique<Internal>(arena_storage)} {}
 BaseTree::~BaseTree() {
 	for (auto e: internal->edges) e->unlink();
 	for (auto v: internal->vertices) v->unlink();
@@ -25,21 +25,19 @@ BaseTree::~BaseTree() {
 }
 
 int BaseTree::AddVertex(std::shared_ptr<VertexData> v) {
-	if (v == NULL) v = std::make_shared<VertexData>();
 	int i = internal->vertices.size();
-	internal->vertices.push_back(std::make_shared<Internal::Vertex>(v));
+	internal->vertices.push_back(internal->new_vertex(v));
 	internal->vertices[i]->index = i;
 
 	return i;
 }
 
 int BaseTree::AddEdge(int from, int to, std::shared_ptr<EdgeData> e) {
-	if (e == NULL) e = std::make_shared<EdgeData>();
 	int i = internal->edges.size();
 	auto vertex_from = internal->vertices[from];
 	auto vertex_to = internal->vertices[to];
 
-	auto edge = std::make_shared<Internal::Edge>(vertex_from, vertex_to, e);
+	auto edge = internal->new_edge(vertex_from, vertex_to, e);
 	edge->register_at_vertices();
 
 	internal->edges.push_back(edge);
@@ -57,39 +55,133 @@ void BaseTree::PrintRooted(int root) {
 	//internal->orient_edges_to_root(internal->vertices[root]);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+BaseTree::Internal::Internal(bool arena_storage) {
+	if (arena_storage) arena = new SlabArena();
+}
+
+BaseTree::Internal::~Internal() {
+	// Arena is freed after the last vertex/edge still referenced from clusters is gone
+	if (arena != NULL) arena->release();
+}
+
+Ref<BaseTree::Internal::Vertex> BaseTree::Internal::new_vertex(std::shared_ptr<VertexData> data) {
+	if (arena == NULL) {
+		if (data == NULL) data = std::make_shared<VertexData>();
+		return new Vertex(data);
+	}
+
+	if (data == NULL) data = std::allocate_shared<VertexData>(SlabAllocator<VertexData>(arena));
+	return new (arena->allocate(sizeof(Vertex))) Vertex(data, arena);
+}
+
+Ref<BaseTree::Internal::Edge> BaseTree::Internal::new_edge(Ref<Vertex> from, Ref<Vertex> to, std::shared_ptr<EdgeData> data) {
+	if (arena == NULL) {
+		if (data == NULL) data = std::make_shared<EdgeData>();
+		return new Edge(from, to, data);
+	}
+
+	if (data == NULL) data = std::allocate_shared<EdgeData>(SlabAllocator<EdgeData>(arena));
+	static_assert(sizeof(Edge) <= SlabArena::max_object_size, "Edge has to be in a slab to find its arena");
+	return new (arena->allocate(sizeof(Edge))) Edge(from, to, data, true);
+}
+
+void BaseTree::Internal::Vertex::free(Vertex *v) {
+	SlabArena *arena = v->get_arena();
+	if (arena == NULL) delete v;
+	else {
+		v->~Vertex();
+		arena->deallocate(v, sizeof(Vertex));
+	}
+}
+
+void BaseTree::Internal::Edge::free(Edge *e) {
+	if (!e->in_arena) delete e;
+	else {
+		SlabArena *arena = SlabArena::owner(e);
+		e->~Edge();
+		arena->deallocate(e, sizeof(Edge));
+	}
+}
+
+void BaseTree::Internal::Vertex::unlink() {
+	// Subvertices and their edges are not referenced from the BaseTree, unlink them here to break cycles
+	std::vector<Ref<Vertex>> subvertices;
+	Vertex *previous = NULL;
+	for (auto s = first_subvertex.get(); s != NULL;) {
+		auto next = s->next_subvertex(previous);
+		subvertices.push_back(s);
+		previous = s;
+		s = next;
+	}
+	for (auto &s: subvertices) {
+		for (auto &n: s->neighbours) if (n.edge != NULL && n.edge->subvertice_edge) n.edge->unlink();
+		s->unlink();
+	}
+
+	neighbours.clear();
+	base_handles.clear();
+	last_handle = NULL;
+	#ifdef TOP_TREE_STATISTICS
+		climb_handle = NULL;
+	#endif
+	superior_vertex = NULL;
+	first_subvertex = NULL;
+	topology_cluster = NULL;
+	expose_first = -1;
+	expose_last = -1;
+
+	deleted = true;
+}
+
+BaseTree::Internal::Vertex *BaseTree::Internal::Vertex::next_subvertex(const Vertex *previous) const {
+	for (const auto &n: neighbours) {
+		if (n.edge == NULL || !n.edge->subvertice_edge) continue;
+		auto w = n.edge->from.get();
+		if (w == this) w = n.edge->to.get();
+		if (w != previous) return w;
+	}
+	return NULL;
+}
+
+void BaseTree::Internal::Vertex::remove_neighbour(int slot) {
+	// The last edge is moved into the freed slot, update its position
+	if (neighbours.remove(slot)) neighbours[slot].edge->slot_at(this) = slot;
+}
+
 void BaseTree::Internal::Edge::register_at_vertices() {
-	from->neighbours.push_back(Internal::neighbour{shared_from_this()});
-	from_iter = std::prev(from->neighbours.end());
+	from_slot = from->neighbours.size();
+	from->neighbours.push_back(Internal::neighbour{this});
 
-	to->neighbours.push_back(Internal::neighbour{shared_from_this()});
-	to_iter = std::prev(to->neighbours.end());
+	to_slot = to->neighbours.size();
+	to->neighbours.push_back(Internal::neighbour{this});
 
 	from->degree++;
 	to->degree++;
 
 	// Superior vertices
 	if (from->superior_vertex != NULL && !subvertice_edge) {
-		from->superior_vertex->neighbours.push_back(Internal::neighbour{shared_from_this()});
-		superior_from_iter = std::prev(from->superior_vertex->neighbours.end());
+		superior_from_slot = from->superior_vertex->neighbours.size();
+		from->superior_vertex->neighbours.push_back(Internal::neighbour{this});
 		from->superior_vertex->degree++;
 	}
 	if (to->superior_vertex != NULL && !subvertice_edge) {
-		to->superior_vertex->neighbours.push_back(Internal::neighbour{shared_from_this()});
-		superior_to_iter = std::prev(to->superior_vertex->neighbours.end());
+		superior_to_slot = to->superior_vertex->neighbours.size();
+		to->superior_vertex->neighbours.push_back(Internal::neighbour{this});
 		to->superior_vertex->degree++;
 	}
 }
 
-void BaseTree::Internal::print_rooted_prefix(const std::shared_ptr<Vertex> root, const std::shared_ptr<Vertex> from, const std::string prefix, bool last_child) const {
+void BaseTree::Internal::print_rooted_prefix(const Ref<Vertex> root, const Ref<Vertex> from, const std::string prefix, bool last_child) const {
 	std::cout << prefix << "|-" << *root->data << std::endl;
 	int size = root->neighbours.size();
 	if (from == NULL) size++;
 	auto prefix_child = prefix + (last_child ? "   " : "|  ");
 	if (size) {
 		for (const auto &v: root->neighbours) {
-			if (auto ee = v.edge.lock()) {
-				auto vv = ee->from;
-				if (vv == root) vv = ee->to;
+			if (auto &ee = v.edge) {
+				Vertex *vv = (ee->from == root ? ee->to : ee->from);
 				if (vv == from) continue;
 				size--;
 				std::cout << prefix_child << "|" << *ee->data << std::endl;
@@ -99,11 +191,10 @@ void BaseTree::Internal::print_rooted_prefix(const std::shared_ptr<Vertex> root,
 	}
 }
 
-void BaseTree::Internal::orient_edges_to_root(const std::shared_ptr<Vertex> root, const std::shared_ptr<Vertex> from) {
+void BaseTree::Internal::orient_edges_to_root(const Ref<Vertex> root, const Ref<Vertex> from) {
 	for (const auto &v: root->neighbours) {
-		if (auto ee = v.edge.lock()) {
-			auto vv = ee->from;
-			if (vv == root) vv = ee->to;
+		if (auto &ee = v.edge) {
+			Vertex *vv = (ee->from == root ? ee->to : ee->from);
 			if (vv == from) continue;
 			if (ee->to != root) {
 				std::cout << "Rotating" << std::endl;
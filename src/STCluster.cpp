@@ -1,4 +1,5 @@
 #include "STCluster.hpp"
+#include "TopTreeStatistics.hpp"
 
 //#define DEBUG
 
@@ -30,8 +31,8 @@ void STCluster::unlink() {
 	right_child = NULL;
 }
 
-std::shared_ptr<BaseCluster> BaseCluster::construct(std::shared_ptr<BaseTree::Internal::Edge> edge) {
-	auto cluster = std::make_shared<BaseCluster>();
+std::shared_ptr<BaseCluster> BaseCluster::construct(STClusterPool *pool, Ref<BaseTree::Internal::Edge> edge) {
+	auto cluster = pool->create<BaseCluster>();
 
 	cluster->edge = edge;
 	cluster->do_join();
@@ -66,7 +67,8 @@ void BaseCluster::do_join() {
 	}
 
 	// 3. Call user defined method:
-	Create(shared_from_this(), edge->data);
+	TOP_TREE_COUNT(user_function_counters.creates, 1);
+	functions->Create(shared_from_this(), edge->data);
 
 	is_splitted = false;
 }
@@ -84,20 +86,25 @@ void BaseCluster::do_split(std::vector<std::shared_ptr<STCluster>>* splitted_clu
 	if (parent != NULL) parent->do_split(splitted_clusters);
 
 	// 3. Call user defined method:
-	Destroy(shared_from_this(), edge->data);
+	TOP_TREE_COUNT(user_function_counters.destroys, 1);
+	functions->Destroy(shared_from_this(), edge->data);
 
 	is_splitted = true;
 }
 void BaseCluster::unregister() {
 	if (boundary_left->last_handle == shared_from_this()) boundary_left->last_handle = NULL;
 	if (boundary_right->last_handle == shared_from_this()) boundary_right->last_handle = NULL;
+	#ifdef TOP_TREE_STATISTICS
+		if (boundary_left->climb_handle == shared_from_this()) boundary_left->climb_handle = NULL;
+		if (boundary_right->climb_handle == shared_from_this()) boundary_right->climb_handle = NULL;
+	#endif
 
 	if (handles_registered) {
 		boundary_left->base_handles.erase(boundary_left_handles_iterator);
 		boundary_right->base_handles.erase(boundary_right_handles_iterator);
 	}
-	edge->from->neighbours.erase(edge->from_iter);
-	edge->to->neighbours.erase(edge->to_iter);
+	edge->from->remove_neighbour(edge->from_slot);
+	edge->to->remove_neighbour(edge->to_slot);
 
 	boundary_left->degree--;
 	boundary_right->degree--;
@@ -122,7 +129,7 @@ void BaseCluster::normalize_for_splay() {
 	// Recursive call in top-down direction
 	if (parent != NULL) parent->normalize_for_splay();
 }
-bool BaseCluster::is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+bool BaseCluster::is_handle_for(BaseTree::Internal::Vertex *v) {
 	return (boundary_left == v || boundary_right == v);
 }
 std::ostream& BaseCluster::ToString(std::ostream& o) const {
@@ -132,21 +139,14 @@ std::ostream& BaseCluster::_short_name(std::ostream& o) const {
 	return o << *boundary_left->data << "," << *boundary_right->data;
 }
 
-std::shared_ptr<CompressCluster> CompressCluster::construct(std::shared_ptr<STCluster> left, std::shared_ptr<STCluster> right) {
-	auto cluster = std::make_shared<CompressCluster>();
+std::shared_ptr<CompressCluster> CompressCluster::construct(STClusterPool *pool, std::shared_ptr<STCluster> left, std::shared_ptr<STCluster> right) {
+	auto cluster = pool->create<CompressCluster>();
 
 	// Basic connections (needed by do_join):
 	cluster->set_left_child(left);
 	cluster->set_right_child(right);
 
 	cluster->correct_endpoints();
-
-	// Foster children (if there are any)
-	cluster->set_left_foster(cluster->common_vertex->rake_tree_left);
-	cluster->common_vertex->rake_tree_left = NULL;
-	cluster->set_right_foster(cluster->common_vertex->rake_tree_right);
-	cluster->common_vertex->rake_tree_right = NULL;
-
 	cluster->do_join();
 
 	return cluster;
@@ -171,19 +171,31 @@ void CompressCluster::do_join() {
 	// 3.1 If there are foster children first do Join into virtual rake nodes
 	auto left = left_child;
 	if (left_foster != NULL) {
-		left_foster_rake = RakeCluster::construct(left_foster, left_child, true);
+		left_foster_rake = join_virtual_rake(left_foster_rake, left_foster, left_child);
 		left = left_foster_rake;
 	}
 	auto right = right_child;
 	if (right_foster != NULL) {
-		right_foster_rake = RakeCluster::construct(right_foster, right_child, true);
+		right_foster_rake = join_virtual_rake(right_foster_rake, right_foster, right_child);
 		right = right_foster_rake;
 	}
 	// 3.2 Normal Join
-	Join(left, right, shared_from_this());
+	TOP_TREE_COUNT(user_function_counters.joins, 1);
+	functions->Join(left, right, shared_from_this());
 
 	is_splitted = false;
 }
+std::shared_ptr<RakeCluster> CompressCluster::join_virtual_rake(std::shared_ptr<RakeCluster> rake, std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to) {
+	// Virtual rake node is referenced only from this cluster, so the previous one is reused
+	if (rake == NULL) return RakeCluster::construct(pool, rake_from, rake_to, true);
+
+	if (!rake->data->Reset()) rake->data = functions->InitClusterData();
+	rake->left_child = rake_from;
+	rake->right_child = rake_to;
+	rake->is_splitted = true;
+	rake->do_join();
+	return rake;
+}
 void CompressCluster::do_split(std::vector<std::shared_ptr<STCluster>>* splitted_clusters) {
 
 	#ifdef DEBUG
@@ -206,10 +218,11 @@ void CompressCluster::do_split(std::vector<std::shared_ptr<STCluster>>* splitted
 	// 3.2 Normal Split
 	left->correct_endpoints();
 	right->correct_endpoints();
-	Split(left, right, shared_from_this());
+	TOP_TREE_COUNT(user_function_counters.splits, 1 + (left_foster != NULL) + (right_foster != NULL));
+	functions->Split(left, right, shared_from_this());
 	// 3.3 If there are foster children Split virtual rake nodes
-	if (left_foster != NULL) Split(left_foster, left_child, left);
-	if (right_foster != NULL) Split(right_foster, right_child, right);
+	if (left_foster != NULL) functions->Split(left_foster, left_child, left);
+	if (right_foster != NULL) functions->Split(right_foster, right_child, right);
 
 	is_splitted = true;
 }
@@ -238,11 +251,19 @@ void CompressCluster::correct_endpoints() {
 	// 2. Correct endpoints
 	boundary_left = (left_child->boundary_left == common_vertex) ? left_child->boundary_right : left_child->boundary_left;
 	boundary_right = (right_child->boundary_left == common_vertex) ? right_child->boundary_right : right_child->boundary_left;
+
+	// 3. This is the handle of the common vertex (it is the only compress cluster around it)
+	if (common_vertex->last_handle.get() != this) common_vertex->last_handle = shared_from_this();
 }
 void CompressCluster::unregister() {
 	if (boundary_left->last_handle == shared_from_this()) boundary_left->last_handle = NULL;
 	if (boundary_right->last_handle == shared_from_this()) boundary_right->last_handle = NULL;
 	if (common_vertex->last_handle == shared_from_this()) common_vertex->last_handle = NULL;
+	#ifdef TOP_TREE_STATISTICS
+		if (boundary_left->climb_handle == shared_from_this()) boundary_left->climb_handle = NULL;
+		if (boundary_right->climb_handle == shared_from_this()) boundary_right->climb_handle = NULL;
+		if (common_vertex->climb_handle == shared_from_this()) common_vertex->climb_handle = NULL;
+	#endif
 
 	is_deleted = true;
 }
@@ -300,7 +321,7 @@ void CompressCluster::normalize_for_splay() {
 		}
 	}
 }
-bool CompressCluster::is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+bool CompressCluster::is_handle_for(BaseTree::Internal::Vertex *v) {
 	return (boundary_left == v || boundary_right == v || common_vertex == v);
 }
 std::ostream& CompressCluster::ToString(std::ostream& o) const {
@@ -311,8 +332,8 @@ std::ostream& CompressCluster::_short_name(std::ostream& o) const {
 }
 
 
-std::shared_ptr<RakeCluster> RakeCluster::construct(std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to, bool virtual_cluster) {
-	auto cluster = std::make_shared<RakeCluster>();
+std::shared_ptr<RakeCluster> RakeCluster::construct(STClusterPool *pool, std::shared_ptr<STCluster> rake_from, std::shared_ptr<STCluster> rake_to, bool virtual_cluster) {
+	auto cluster = pool->create<RakeCluster>();
 
 	// Basic connections (needed by do_join):
 	if (virtual_cluster) {
@@ -347,7 +368,8 @@ void RakeCluster::do_join() {
 	#endif
 
 	// 3. Call user defined method:
-	Join(rake_from, rake_to, shared_from_this());
+	TOP_TREE_COUNT(user_function_counters.joins, 1);
+	functions->Join(rake_from, rake_to, shared_from_this());
 
 	is_splitted = false;
 }
@@ -367,7 +389,8 @@ void RakeCluster::do_split(std::vector<std::shared_ptr<STCluster>>* splitted_clu
 	// 3. Call user defined method:
 	left_child->correct_endpoints();
 	right_child->correct_endpoints();
-	Split(left_child, right_child, shared_from_this());
+	TOP_TREE_COUNT(user_function_counters.splits, 1);
+	functions->Split(left_child, right_child, shared_from_this());
 
 	is_splitted = true;
 }
@@ -408,7 +431,7 @@ void RakeCluster::normalize_for_splay() {
 	if (left_child->boundary_right != boundary_right) left_child->flip();
 	if (right_child->boundary_right != boundary_right) right_child->flip();
 }
-bool RakeCluster::is_handle_for(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+bool RakeCluster::is_handle_for(BaseTree::Internal::Vertex *v) {
 	return false;
 }
 std::ostream& RakeCluster::ToString(std::ostream& o) const {
@@ -418,4 +441,22 @@ std::ostream& RakeCluster::_short_name(std::ostream& o) const {
 	return o << *boundary_left << "," << *boundary_right;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+STClusterPool::STClusterPool(const UserFunctions *functions): functions{functions} {
+	arena = new SlabArena();
+}
+
+STClusterPool::~STClusterPool() {
+	for (auto c: free_base) ::operator delete(c.memory);
+	for (auto c: free_compress) ::operator delete(c.memory);
+	for (auto c: free_rake) ::operator delete(c.memory);
+	arena->release();
+}
+
+void STClusterPool::release() {
+	released = true;
+	if (living == 0) delete this;
+}
+
 }
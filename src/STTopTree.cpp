@@ -1,11 +1,14 @@
-#include <queue>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <thread>
 
 #include "ClusterInterface.hpp"
 #include "STTopTree.hpp"
 #include "BaseTreeInternal.hpp"
 #include "STCluster.hpp"
+#include "ParallelFor.hpp"
+#include "TopTreeStatistics.hpp"
 
 //#define DEBUG
 //#define DEBUG_GRAPHVIZ
@@ -18,19 +21,43 @@ namespace TopTree {
 // Hide data from .hpp file using PIMP idiom
 class STTopTree::Internal {
 public:
-	std::list<std::shared_ptr<STCluster>> root_clusters;
+	Internal(const UserFunctions *functions);
+	~Internal();
+
+	STClusterPool *pool; // All clusters of this top tree are taken from the pool
+	std::list<std::shared_ptr<STCluster>, SlabAllocator<std::shared_ptr<STCluster>>> root_clusters;
 	std::shared_ptr<BaseTree> base_tree;
 
-	std::shared_ptr<STCluster> construct_cluster(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> e=NULL);
+	void construct_components(int threads);
 
-	void soft_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w);
-	std::shared_ptr<STCluster> hard_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w);
+	void soft_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, bool join = true);
+	std::shared_ptr<STCluster> hard_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w);
 	void guarded_splay(std::shared_ptr<STCluster> node, std::shared_ptr<STCluster> guard = NULL);
 
 	std::vector<std::shared_ptr<STCluster>> splitted_clusters;
 	std::vector<std::shared_ptr<CompressCluster>> hard_expose_transformed_clusters;
 
-	std::shared_ptr<STCluster> get_handle(std::shared_ptr<BaseTree::Internal::Vertex> v);
+	std::shared_ptr<STCluster> get_handle(BaseTree::Internal::Vertex *v);
+
+	// Counters of GetStatistics (counted only with TOP_TREE_STATISTICS), user function calls are reported relative
+	// to their values at the construction (or reset)
+	struct Statistics {
+		long long rotations = 0;
+		long long splices = 0;
+		long long soft_expose_splays = 0;
+		long long rakerizations = 0;
+		long long handle_lookups = 0;
+		long long direct_handles = 0; // handle kept by the compress cluster, no climbing needed
+		long long handle_climb_steps = 0; // steps up the tree done by the other lookups
+		long long saved_climb_steps = 0; // steps the direct lookups would climb from the last lookup (see get_handle)
+		UserFunctionCounters user_functions_at_reset = user_function_counters;
+	} statistics;
+
+	// Clusters split during soft expose are joined only once at the end of the operation (from the handles left
+	// in unjoined_handles by soft expose) instead of after each splay
+	bool deferred_joins = false;
+	std::vector<std::shared_ptr<STCluster>> unjoined_handles;
+	void join_handles();
 
 	// Debug methods:
 	#ifdef DEBUG
@@ -50,15 +77,26 @@ private:
 	void rotate_right(std::shared_ptr<STCluster> x);
 
 	void splice(std::shared_ptr<STCluster> node);
+	// Scratch space of splice (kept to avoid allocations, always empty between calls)
+	std::vector<std::shared_ptr<STCluster>> left_nodes;
+	std::vector<std::shared_ptr<STCluster>> right_nodes;
 
 	void soft_expose_handle(std::shared_ptr<STCluster> handle, std::shared_ptr<STCluster> splay_guard = NULL);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
-STTopTree::STTopTree() : internal{std::make_unique<Internal>()} {}
+STTopTree::Internal::Internal(const UserFunctions *functions) : pool{new STClusterPool(functions)}, root_clusters{SlabAllocator<std::shared_ptr<STCluster>>(pool->get_arena())} {}
+
+STTopTree::Internal::~Internal() {
+	// Clusters still referenced (by splitted_clusters or by the user) return to the pool later
+	root_clusters.clear();
+	pool->release();
+}
+
+STTopTree::STTopTree(const UserFunctions *functions) : internal{std::make_unique<Internal>(functions)} {}
 
-STTopTree::STTopTree(std::shared_ptr<BaseTree> baseTree) : STTopTree() {
+STTopTree::STTopTree(std::shared_ptr<BaseTree> baseTree, const UserFunctions *functions) : STTopTree(functions) {
 	InitFromBaseTree(baseTree);
 }
 
@@ -70,16 +108,16 @@ STTopTree::~STTopTree() {
 }
 
 void STTopTree::InitFromBaseTree(std::shared_ptr<BaseTree> baseTree) {
+	InitFromBaseTree(baseTree, 1);
+}
+
+void STTopTree::InitFromBaseTree(std::shared_ptr<BaseTree> baseTree, int threads) {
 	internal->base_tree = baseTree;
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
 
 	for (auto v : internal->base_tree->internal->vertices) v->used = false;
 
-	for (auto v : internal->base_tree->internal->vertices) {
-		if (v->used || v->degree != 1) continue;
-		auto cluster = internal->construct_cluster(v);
-		internal->root_clusters.push_back(cluster);
-		cluster->root_clusters_iterator = std::prev(internal->root_clusters.end());
-	}
+	internal->construct_components(threads);
 
 	#ifdef DEBUG_GRAPHVIZ
 		for (auto root_cluster: internal->root_clusters) internal->print_graphviz(root_cluster, "Full");
@@ -201,12 +239,45 @@ std::shared_ptr<ICluster> STTopTree::Expose(int v, int w) {
 		std::cerr << "[Exposing " << *vertexV->data << "," << *vertexW->data << "]" << std::endl;
 	#endif
 
-	internal->soft_expose(vertexV, vertexW);
-	return internal->hard_expose(vertexV, vertexW);
+	if (!internal->deferred_joins) {
+		internal->soft_expose(vertexV, vertexW);
+		return internal->hard_expose(vertexV, vertexW);
+	}
+	// Hard expose splits the top of the tree again, so clusters are joined only after it
+	internal->soft_expose(vertexV, vertexW, false);
+	auto exposed = internal->hard_expose(vertexV, vertexW);
+	internal->join_handles();
+	return exposed;
+}
+
+void STTopTree::Internal::join_handles() {
+	// Join is recursive into splitted children, so each splitted cluster is joined exactly once
+	for (auto c: unjoined_handles) c->do_join();
+	unjoined_handles.clear();
 }
 
-std::shared_ptr<STCluster> STTopTree::Internal::get_handle(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+std::shared_ptr<STCluster> STTopTree::Internal::get_handle(BaseTree::Internal::Vertex *v) {
 	if (v->base_handles.size() == 0) return NULL;
+	TOP_TREE_COUNT(statistics.handle_lookups, 1);
+
+	// Compress cluster with v as its common vertex contains all edges of v (no cluster above it is handle for v),
+	// it sets itself as last_handle whenever its endpoints are corrected (see CompressCluster::correct_endpoints).
+	if (v->last_handle != NULL && v->last_handle->isCompress() && v->last_handle->common_vertex == v) {
+		TOP_TREE_COUNT(statistics.direct_handles, 1);
+		#ifdef TOP_TREE_STATISTICS
+			// Steps saved: climbing from the result of the previous lookup (as it was done without direct lookups)
+			if (v->climb_handle == NULL || !v->climb_handle->is_handle_for(v)) v->climb_handle = v->base_handles.front();
+			while (v->climb_handle != v->last_handle) {
+				auto parent = v->climb_handle->parent;
+				while (parent != NULL && parent->isRake()) parent = parent->parent;
+				if (parent == NULL || !parent->is_handle_for(v)) break;
+				v->climb_handle = parent;
+				statistics.saved_climb_steps++;
+			}
+			v->climb_handle = v->last_handle;
+		#endif
+		return v->last_handle;
+	}
 
 	if (v->last_handle == NULL || !v->last_handle->is_handle_for(v)) v->last_handle = v->base_handles.front();
 
@@ -214,12 +285,47 @@ std::shared_ptr<STCluster> STTopTree::Internal::get_handle(std::shared_ptr<BaseT
 	while (true) {
 		auto parent = v->last_handle->parent;
 		while (parent != NULL && parent->isRake()) parent = parent->parent;
-		if (parent != NULL && parent->is_handle_for(v)) v->last_handle = parent;
-		else break;
+		if (parent != NULL && parent->is_handle_for(v)) {
+			v->last_handle = parent;
+			TOP_TREE_COUNT(statistics.handle_climb_steps, 1);
+		} else break;
 	}
+	#ifdef TOP_TREE_STATISTICS
+		v->climb_handle = v->last_handle;
+	#endif
 	return v->last_handle;
 }
 
+void STTopTree::SetDeferredJoins(bool deferred) {
+	internal->deferred_joins = deferred;
+}
+
+std::vector<std::pair<std::string, long long>> STTopTree::GetStatistics() const {
+	#ifdef TOP_TREE_STATISTICS
+		auto &s = internal->statistics;
+		return {
+			{"rotations", s.rotations},
+			{"splices", s.splices},
+			{"soft_expose_splays", s.soft_expose_splays},
+			{"rakerizations", s.rakerizations},
+			{"handle_lookups", s.handle_lookups},
+			{"direct_handles", s.direct_handles},
+			{"handle_climb_steps", s.handle_climb_steps},
+			{"saved_climb_steps", s.saved_climb_steps},
+			{"joins", user_function_counters.joins - s.user_functions_at_reset.joins},
+			{"splits", user_function_counters.splits - s.user_functions_at_reset.splits},
+			{"creates", user_function_counters.creates - s.user_functions_at_reset.creates},
+			{"destroys", user_function_counters.destroys - s.user_functions_at_reset.destroys}
+		};
+	#else
+		return {};
+	#endif
+}
+
+void STTopTree::ResetStatistics() {
+	internal->statistics = Internal::Statistics();
+}
+
 // A. Splaying
 void STTopTree::Internal::adjust_parent(std::shared_ptr<STCluster> parent, std::shared_ptr<STCluster> old_child, std::shared_ptr<STCluster> new_child) {
 	// Ensure that both children are splitted before any action
@@ -256,6 +362,7 @@ void STTopTree::Internal::rotate_left(std::shared_ptr<STCluster> x) {
 	#ifdef DEBUG
 		std::cerr << "Rotating left around " << *x << std::endl;
 	#endif
+	TOP_TREE_COUNT(statistics.rotations, 1);
 
 	adjust_parent(parent, x, y);
 
@@ -282,6 +389,7 @@ void STTopTree::Internal::rotate_right(std::shared_ptr<STCluster> x) {
 	#ifdef DEBUG
 		std::cerr << "Rotating right around " << *x << std::endl;
 	#endif
+	TOP_TREE_COUNT(statistics.rotations, 1);
 
 	adjust_parent(parent, x, y);
 
@@ -328,12 +436,10 @@ void STTopTree::Internal::guarded_splay(std::shared_ptr<STCluster> node, std::sh
 // B. Splicing
 // Splicing occur only after splaying -> at most two rake nodes to the root of some compress tree
 void STTopTree::Internal::splice(std::shared_ptr<STCluster> node) {
-	auto left_nodes = std::vector<std::shared_ptr<STCluster>>();
-	auto right_nodes = std::vector<std::shared_ptr<STCluster>>();
-
 	#ifdef DEBUG
 		std::cerr << "Splicing " << *node << std::endl;
 	#endif
+	TOP_TREE_COUNT(statistics.splices, 1);
 
 	// 1. Go up to the root of a compress tree and split other nodes to left
 	// and right siblings
@@ -400,7 +506,7 @@ void STTopTree::Internal::splice(std::shared_ptr<STCluster> node) {
 				std::cerr << " - next left rake is " << *right << std::endl;
 			#endif
 
-			auto temp = std::make_shared<RakeCluster>();
+			auto temp = pool->create<RakeCluster>();
 
 			temp->set_left_child(new_left_foster);
 			temp->set_right_child(right);
@@ -434,7 +540,7 @@ void STTopTree::Internal::splice(std::shared_ptr<STCluster> node) {
 				std::cerr << " - next right rake is " << *left << std::endl;
 			#endif
 
-			auto temp = std::make_shared<RakeCluster>();
+			auto temp = pool->create<RakeCluster>();
 
 			temp->set_right_child(new_right_foster);
 			temp->set_left_child(left);
@@ -490,6 +596,7 @@ void STTopTree::Internal::soft_expose_handle(std::shared_ptr<STCluster> N, std::
 			guard = guard->parent;
 		}
 		// Splay within this compress tree
+		TOP_TREE_COUNT(statistics.soft_expose_splays, 1);
 		guarded_splay(node, guard);
 
 		if (node->parent == NULL) break;
@@ -498,11 +605,15 @@ void STTopTree::Internal::soft_expose_handle(std::shared_ptr<STCluster> N, std::
 		if (orig_parent->isRake()) {
 			guard = orig_parent->parent;
 			while (guard != extern_splay_guard && guard != NULL && guard->isRake()) guard = guard->parent;
+			TOP_TREE_COUNT(statistics.soft_expose_splays, 1);
 			guarded_splay(orig_parent, guard);
 		}
 
 		// 1.3 If N have different parent than orig_parent:
-		if (node->parent != orig_parent && node->parent != extern_splay_guard) guarded_splay(node->parent, orig_parent);
+		if (node->parent != orig_parent && node->parent != extern_splay_guard) {
+			TOP_TREE_COUNT(statistics.soft_expose_splays, 1);
+			guarded_splay(node->parent, orig_parent);
+		}
 
 		// For next run - node in above compress tree under which N is
 		if (orig_parent->isRake()) node = orig_parent->parent;
@@ -539,13 +650,14 @@ void STTopTree::Internal::soft_expose_handle(std::shared_ptr<STCluster> N, std::
 
 	// 3. Splay N and making it the root of the entire tree
 	N->normalize_for_splay();
+	TOP_TREE_COUNT(statistics.soft_expose_splays, 1);
 	guarded_splay(N, extern_splay_guard);
 
-	// 4. Restore all clusters
-	for (auto c: splitted_clusters) c->do_join();
+	// 4. Restore all clusters (with deferred joins they stay splitted until the end of the operation)
+	if (!deferred_joins) for (auto c: splitted_clusters) c->do_join();
 }
 
-void STTopTree::Internal::soft_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w) {
+void STTopTree::Internal::soft_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, bool join) {
 	// Init array for clusters restoration
 	splitted_clusters.clear();
 
@@ -600,8 +712,14 @@ void STTopTree::Internal::soft_expose(std::shared_ptr<BaseTree::Internal::Vertex
 		if ((Nv->left_child->boundary_left == v && Nv->left_child->boundary_right == w)
 		 || (Nv->left_child->boundary_left == w && Nv->left_child->boundary_right == v)) Nv->flip();
 	}
-	if (Nv != NULL) Nv->do_join();
-	if (Nw != NULL) Nw->do_join();
+	if (join) {
+		if (Nv != NULL) Nv->do_join();
+		if (Nw != NULL) Nw->do_join();
+	} else {
+		// Caller joins them by join_handles (they are roots of all splitted clusters)
+		if (Nv != NULL) unjoined_handles.push_back(Nv);
+		if (Nw != NULL) unjoined_handles.push_back(Nw);
+	}
 
 	#ifdef DEBUG
 		for (auto root : root_clusters) {
@@ -615,7 +733,7 @@ void STTopTree::Internal::soft_expose(std::shared_ptr<BaseTree::Internal::Vertex
 }
 
 // D. Hard expose
-std::shared_ptr<STCluster> STTopTree::Internal::hard_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w) {
+std::shared_ptr<STCluster> STTopTree::Internal::hard_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w) {
 	#ifdef DEBUG
 		std::cerr << "Hard expose of path " << *v->data << "," << *w->data << std::endl;
 	#endif
@@ -635,6 +753,7 @@ std::shared_ptr<STCluster> STTopTree::Internal::hard_expose(std::shared_ptr<Base
 		node = node->right_child;
 	}
 	// Rakerizing cluster nodes
+	TOP_TREE_COUNT(statistics.rakerizations, hard_expose_transformed_clusters.size());
 	for (auto v: hard_expose_transformed_clusters) {
 		v->do_split(&splitted_clusters);
 		v->rakerized = true;
@@ -864,9 +983,9 @@ std::shared_ptr<ICluster> STTopTree::Link(int v_index, int w_index, std::shared_
 	}
 
 	// 2. Make new base cluster
-	auto edge = std::make_shared<BaseTree::Internal::Edge>(v, w, edge_data);
+	auto edge = internal->base_tree->internal->new_edge(v, w, edge_data);
 	edge->register_at_vertices();
-	auto edge_cluster = BaseCluster::construct(edge);
+	auto edge_cluster = BaseCluster::construct(internal->pool, edge);
 
 	// 2. If joining solitary nodes return only the new cluster
 	if (v->degree == 1 && w->degree == 1) {
@@ -887,12 +1006,12 @@ std::shared_ptr<ICluster> STTopTree::Link(int v_index, int w_index, std::shared_
 		// v was independent node -> do nothing and leave node as edge cluster
 	} else if (v->degree == 2) {
 		// v had degree 1, it was endpoint of the Nv -> construct new compress node
-		node = CompressCluster::construct(Nv, node);
+		node = CompressCluster::construct(internal->pool, Nv, node);
 	} else {
 		Nv->do_split();
 		if (Nv->right_foster == NULL) Nv->right_foster = Nv->right_child;
 		else {
-			Nv->right_foster = RakeCluster::construct(Nv->right_foster, Nv->right_child);
+			Nv->right_foster = RakeCluster::construct(internal->pool, Nv->right_foster, Nv->right_child);
 			Nv->right_foster->parent = Nv;
 		}
 		Nv->set_right_child(node);
@@ -903,7 +1022,7 @@ std::shared_ptr<ICluster> STTopTree::Link(int v_index, int w_index, std::shared_
 	// Nw cannot have degree one (this case where degree of both is one is special case above)
 	if (w->degree == 2) {
 		// w had degree 1, it was endpoint of the Nw -> construct new compress node
-		node = CompressCluster::construct(Nw, node);
+		node = CompressCluster::construct(internal->pool, Nw, node);
 		// Nw is not longer root cluster, there is new root cluster
 		// -> remove Nw from root clusters and push node there
 		internal->root_clusters.erase(Nw->root_clusters_iterator);
@@ -913,7 +1032,7 @@ std::shared_ptr<ICluster> STTopTree::Link(int v_index, int w_index, std::shared_
 		Nw->do_split();
 		if (Nw->right_foster == NULL) Nw->right_foster = Nw->right_child;
 		else {
-			Nw->right_foster = RakeCluster::construct(Nw->right_foster, Nw->right_child);
+			Nw->right_foster = RakeCluster::construct(internal->pool, Nw->right_foster, Nw->right_child);
 			Nw->right_foster->parent = Nw;
 		}
 		Nw->set_right_child(node);
@@ -937,108 +1056,197 @@ std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> STTopTree::Split
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::shared_ptr<STCluster> STTopTree::Internal::construct_cluster(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> e) {
-	std::queue<std::shared_ptr<STCluster>> path;
-	std::queue<std::shared_ptr<STCluster>> rake_list;
-
-	auto v_backup = v;
+void STTopTree::Internal::construct_components(int threads) {
+	// Vertices are numbered in order of the walk below (close vertices have close numbers), these are indexed by it:
+	std::vector<int> parent;
+	std::vector<int> size;
+	std::vector<int> heavy; // child with the biggest subtree, path continues there
+	std::vector<int> first_child;
+	std::vector<int> last_child;
+	std::vector<int> next_sibling;
+	std::vector<std::shared_ptr<STCluster>> parent_cluster; // base cluster of the edge to the parent
+
+	// 1. Walk all components from their leaves (by explicit stack), save their vertices, children and sizes
+	//    of subtrees and construct base clusters of all edges (it is done by this thread only, clusters are
+	//    taken from the pool and user functions may not be thread safe)
+	struct entry {
+		BaseTree::Internal::Vertex *vertex;
+		int number;
+		uint next_neighbour;
+	};
+	std::vector<entry> stack;
+	auto add_vertex = [&](BaseTree::Internal::Vertex *v, int p, std::shared_ptr<STCluster> cluster) {
+		int number = parent.size();
+		v->used = true;
+		parent.push_back(p);
+		size.push_back(1);
+		heavy.push_back(-1);
+		first_child.push_back(-1);
+		last_child.push_back(-1);
+		next_sibling.push_back(-1);
+		parent_cluster.push_back(cluster);
+		stack.push_back(entry{v, number, 0});
+	};
+	for (const auto &r: base_tree->internal->vertices) {
+		if (r->used || r->degree != 1) continue;
+
+		add_vertex(r.get(), -1, NULL);
+		while (!stack.empty()) {
+			auto &top = stack.back();
+			auto v = top.vertex;
+			int n = top.number;
+			if (top.next_neighbour == v->neighbours.size()) {
+				stack.pop_back();
+				int p = parent[n];
+				if (p < 0) continue;
+				size[p] += size[n];
+				if (heavy[p] < 0 || size[n] > size[heavy[p]]) heavy[p] = n;
+				continue;
+			}
 
-	// #ifdef DEBUG
-	// 	std::cerr << "Constructing path from vertex " << *v->data << std::endl;
-	// #endif
+			const auto &e = v->neighbours[top.next_neighbour++].edge;
+			if (e == NULL) continue;
+			auto w = (e->from.get() == v ? e->to.get() : e->from.get());
+			if (w->used) continue;
 
-	auto next_v = v;
-	auto next_e = e;
+			int number = parent.size();
+			if (first_child[n] < 0) first_child[n] = number;
+			else next_sibling[last_child[n]] = number;
+			last_child[n] = number;
 
-	// A. Find some path, create base clusters from edges of this path,
-	// recursively construct all other clusters and rake them onto base clusters
-	while (v != NULL) {
-		v->used = true;
-		next_v = NULL;
-
-		// 1. Construct BaseCluster if there was edge given
-		std::shared_ptr<STCluster> path_cluster = (e != NULL ? BaseCluster::construct(e) : NULL);
-
-		// 2. Select continuation and recursive construct top trees on subtrees
-		for (auto n : v->neighbours) {
-			if (auto ee = n.edge.lock()) {
-				auto vv = ee->from;
-				if (vv == v) vv = ee->to;
-				if (vv->used) continue;
-				if (next_v == NULL) {
-					// Use this as continuation of path
-					next_v = vv;
-					next_e = ee;
-				} else {
-					// Recursively construct top tree on subtree
-					rake_list.push(construct_cluster(vv, ee));
-				}
-			}
+			add_vertex(w, n, BaseCluster::construct(pool, e));
+		}
+	}
+	std::vector<int> path_of(parent.size(), -1);
+	std::vector<std::shared_ptr<STCluster>> rake_tree(parent.size()); // rake tree of subtrees hanged on the vertex
+
+	// 2. Decompose components into paths: a path continues into the heavy child, all other (light) children
+	//    start new paths. Rake and compress clusters for the paths are taken from the pool, paths are also
+	//    grouped into levels by the number of light edges above them (at most log n levels).
+	struct path {
+		int first; // vertex under the first edge of the path
+		std::shared_ptr<STCluster> root;
+		size_t rakes; // index of its first rake cluster
+		size_t compresses; // index of its first compress cluster
+		int level;
+	};
+	std::vector<path> paths;
+	std::vector<int> root_paths;
+	std::vector<std::shared_ptr<RakeCluster>> rakes;
+	std::vector<std::shared_ptr<CompressCluster>> compresses;
+	for (int v = 0; v < (int) parent.size(); v++) {
+		int p = parent[v];
+		if (p >= 0 && heavy[p] == v) continue; // inner vertex of the path of its parent
+
+		int level = 0;
+		int first = v;
+		if (p < 0) {
+			// Path of the whole component, it starts by the edge from the leaf
+			root_paths.push_back(paths.size());
+			first = heavy[v];
+		} else level = paths[path_of[p]].level + 1;
+		paths.push_back(path{first, NULL, rakes.size(), compresses.size(), level});
+
+		int edges = 0;
+		for (int w = first; w >= 0; w = heavy[w]) {
+			path_of[w] = paths.size() - 1;
+			edges++;
+			if (heavy[w] < 0) continue;
+			int light = -1;
+			for (int c = first_child[w]; c >= 0; c = next_sibling[c]) light++;
+			for (int i = 1; i < light; i++) rakes.push_back(pool->create<RakeCluster>());
 		}
+		for (int i = 1; i < edges; i++) compresses.push_back(pool->create<CompressCluster>());
+	}
 
-		// 3. Rake all top trees from rake list to rake tree,
-		// connect the rake tree as foster child to the path edge
-		// and add path edge into path
-		if (path_cluster != NULL) {
-			// 3.1 Rake all edges into rake tree
-			std::queue<std::shared_ptr<STCluster>> rake_list_new;
-			while (rake_list.size() > 1) {
-				while (rake_list.size() > 0) {
-					if (rake_list.size() == 1) {
-						rake_list_new.push(rake_list.front());
-						rake_list.pop();
-					} else {
-						auto first = rake_list.front();
-						rake_list.pop();
-						auto second = rake_list.front();
-						rake_list.pop();
-						rake_list_new.push(RakeCluster::construct(first, second));
+	// 3. Connect clusters of one path, roots of paths of its light children must be already known.
+	//    Clusters are combined in pairs (in rounds) to obtain balanced rake and compress trees.
+	auto connect_path = [&](int i) {
+		auto &pth = paths[i];
+		size_t next_rake = pth.rakes;
+		size_t next_compress = pth.compresses;
+		std::vector<std::pair<std::shared_ptr<STCluster>, int>> list; // cluster and its last vertex on the path
+
+		// 3.1 Rake roots of paths of the light children into rake trees of the path vertices
+		for (int w = pth.first; w >= 0; w = heavy[w]) {
+			for (int c = first_child[w]; c >= 0; c = next_sibling[c]) {
+				if (c != heavy[w]) list.push_back(std::make_pair(paths[path_of[c]].root, c));
+			}
+			while (list.size() > 1) {
+				size_t j = 0;
+				for (size_t k = 0; k < list.size(); k += 2, j++) {
+					if (k + 1 == list.size()) {
+						list[j] = list[k];
+						continue;
 					}
+					auto rake = rakes[next_rake++];
+					rake->set_left_child(list[k].first);
+					rake->set_right_child(list[k + 1].first);
+					list[j].first = rake;
 				}
-				rake_list.swap(rake_list_new);
-			}
-			// 3.2 Prepare rake tree and save it into the vertex
-			if (!rake_list.empty()) {
-				auto rake_tree = rake_list.front();
-				rake_list.pop();
-
-				// Only use one side (left)
-				v->rake_tree_left = rake_tree;
+				list.resize(j);
 			}
-			// 3.3 Push cluster with edge into path
-			path.push(path_cluster);
+			if (!list.empty()) rake_tree[w] = list.front().first;
+			list.clear();
 		}
 
-		// 4. Move to the next vertex on path
-		v = next_v;
-		e = next_e;
-	}
-
-	// B. Compress all clusters into one compress cluster
-	std::queue<std::shared_ptr<STCluster>> path_new;
-	while (path.size() > 1) {
-		while (path.size() > 0) {
-			if (path.size() == 1) {
-				path_new.push(path.front());
-				path.pop();
-			} else {
-				auto left = path.front();
-				path.pop();
-				auto right = path.front();
-				path.pop();
-
-				// Construct compress cluster and push it into the path
-				path_new.push(CompressCluster::construct(left, right));
+		// 3.2 Compress the path, rake trees are connected as (left) foster children of the compress clusters
+		for (int w = pth.first; w >= 0; w = heavy[w]) list.push_back(std::make_pair(parent_cluster[w], w));
+		while (list.size() > 1) {
+			size_t j = 0;
+			for (size_t k = 0; k < list.size(); k += 2, j++) {
+				if (k + 1 == list.size()) {
+					list[j] = list[k];
+					continue;
+				}
+				auto compress = compresses[next_compress++];
+				int common_vertex = list[k].second;
+				compress->set_left_child(list[k].first);
+				compress->set_right_child(list[k + 1].first);
+				compress->correct_endpoints();
+				compress->set_left_foster(rake_tree[common_vertex]);
+				rake_tree[common_vertex] = NULL;
+				list[j] = std::make_pair(compress, list[k + 1].second);
 			}
+			list.resize(j);
 		}
-		path.swap(path_new);
+		pth.root = list.front().first;
+	};
+
+	// 4. Join rake and compress clusters of one path by this thread, children are always joined before
+	//    their parents, so do_join does not recurse
+	auto join_path = [&](int i) {
+		size_t rakes_end = (size_t) i + 1 < paths.size() ? paths[i + 1].rakes : rakes.size();
+		size_t compresses_end = (size_t) i + 1 < paths.size() ? paths[i + 1].compresses : compresses.size();
+		for (size_t j = paths[i].rakes; j < rakes_end; j++) rakes[j]->do_join();
+		for (size_t j = paths[i].compresses; j < compresses_end; j++) compresses[j]->do_join();
+	};
+
+	// Paths of light children always come after the path of their parent
+	if (threads == 1) {
+		for (int i = paths.size() - 1; i >= 0; i--) {
+			connect_path(i);
+			join_path(i);
+		}
+	} else {
+		// All paths of one level are independent, levels are connected in parallel from the deepest one
+		std::vector<std::vector<int>> levels;
+		for (size_t i = 0; i < paths.size(); i++) {
+			if ((int) levels.size() <= paths[i].level) levels.resize(paths[i].level + 1);
+			levels[paths[i].level].push_back(i);
+		}
+		for (int l = levels.size() - 1; l >= 0; l--) {
+			const auto &level = levels[l];
+			parallel_for(threads, level.size(), [&](size_t i) { connect_path(level[i]); });
+		}
+		for (int i = paths.size() - 1; i >= 0; i--) join_path(i);
 	}
 
-	// #ifdef DEBUG
-	// 	std::cerr << "Construction of path from vertex " << *v_backup->data << " ended" << std::endl;
-	// #endif
-
-	return path.front();
+	// 5. Roots of paths from leaves are roots of the whole components
+	for (int i: root_paths) {
+		root_clusters.push_back(paths[i].root);
+		paths[i].root->root_clusters_iterator = std::prev(root_clusters.end());
+	}
 }
 
 }
@@ -0,0 +1,67 @@
+#include <new>
+
+#include "SlabArena.hpp"
+
+namespace TopTree {
+
+SlabArena::SlabArena() {
+	classes.resize(max_object_size / granularity + 1);
+}
+
+SlabArena::~SlabArena() {
+	for (auto slab: slabs) ::operator delete(slab, std::align_val_t(slab_size));
+}
+
+void *SlabArena::allocate(size_t size) {
+	living++;
+
+	// Big objects (vectors etc.) are not worth to keep in slabs
+	if (size > max_object_size) return ::operator new(size);
+
+	size_t index = (size + granularity - 1) / granularity;
+	size_t rounded = index * granularity;
+	auto &c = classes[index];
+	used += rounded;
+
+	// 1. Reuse freed object
+	if (c.free != NULL) {
+		auto node = c.free;
+		c.free = node->next;
+		return node;
+	}
+
+	// 2. Take next object from the slab (and allocate new slab if needed)
+	if ((size_t) (c.end - c.next) < rounded) {
+		auto slab = static_cast<char*>(::operator new(slab_size, std::align_val_t(slab_size)));
+		*reinterpret_cast<SlabArena**>(slab) = this;
+		c.next = slab + granularity;
+		c.end = slab + slab_size;
+		slabs.push_back(slab);
+		reserved += slab_size;
+	}
+	void *pointer = c.next;
+	c.next += rounded;
+	return pointer;
+}
+
+void SlabArena::deallocate(void *pointer, size_t size) {
+	if (size > max_object_size) {
+		::operator delete(pointer);
+	} else {
+		size_t index = (size + granularity - 1) / granularity;
+		auto node = static_cast<free_node*>(pointer);
+		node->next = classes[index].free;
+		classes[index].free = node;
+		used -= index * granularity;
+	}
+
+	living--;
+	if (released && living == 0) delete this;
+}
+
+void SlabArena::release() {
+	released = true;
+	if (living == 0) delete this;
+}
+
+}
@@ -1,5 +1,6 @@
 #include "UserFunctions.hpp"
 #include "TopologyCluster.hpp"
+#include "TopTreeStatistics.hpp"
 
 //#define DEBUG
 
@@ -21,10 +22,14 @@ void SimpleCluster::do_split() {
 
 	if (parent != NULL) parent->do_split();
 
-	if (first != NULL && second != NULL) Split(first, second, shared_from_this());
-	else if (first != NULL) CopyClusterData(shared_from_this(), first); // just copy data
-	else if (edge != NULL && !edge->subvertice_edge) Destroy(shared_from_this(), edge->data);
-	else {
+	if (first != NULL && second != NULL) {
+		TOP_TREE_COUNT(user_function_counters.splits, 1);
+		functions->Split(first, second, shared_from_this());
+	} else if (first != NULL) functions->CopyClusterData(shared_from_this(), first); // just copy data
+	else if (edge != NULL && !edge->subvertice_edge) {
+		TOP_TREE_COUNT(user_function_counters.destroys, 1);
+		functions->Destroy(shared_from_this(), edge->data);
+	} else {
 		std::cerr << "Not know what to do with this simple cluster, cannot Split, copy nor Destroy" << std::endl;
 		exit(1);
 	}
@@ -34,8 +39,8 @@ void SimpleCluster::do_split() {
 	was_splitted = true;
 }
 
-std::shared_ptr<SimpleCluster> SimpleCluster::construct(std::shared_ptr<ICluster> first, std::shared_ptr<ICluster> second) {
-	auto cluster = std::make_shared<SimpleCluster>();
+std::shared_ptr<SimpleCluster> SimpleCluster::construct(SimpleClusterPool *pool, std::shared_ptr<ICluster> first, std::shared_ptr<ICluster> second) {
+	auto cluster = pool->create();
 	cluster->first = first;
 	auto simple_first = std::dynamic_pointer_cast<SimpleCluster>(first);
 	if (simple_first != NULL) simple_first->parent = cluster;
@@ -54,6 +59,56 @@ void SimpleCluster::unlink(bool recursive) {
 	second = NULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// SimpleClusterPool
+
+SimpleClusterPool::SimpleClusterPool(const UserFunctions *functions): functions{functions} {
+	arena = new SlabArena();
+}
+
+SimpleClusterPool::~SimpleClusterPool() {
+	for (auto c: free_clusters) ::operator delete(c.memory);
+	arena->release();
+}
+
+std::shared_ptr<SimpleCluster> SimpleClusterPool::create() {
+	SimpleCluster *cluster;
+	if (free_clusters.empty()) {
+		cluster = new (::operator new(sizeof(SimpleCluster))) SimpleCluster(functions);
+		allocations += 2; // cluster and its data
+	} else {
+		auto data = std::move(free_clusters.back().data);
+		void *memory = free_clusters.back().memory;
+		free_clusters.pop_back();
+
+		if (!data->Reset()) {
+			data = functions->InitClusterData();
+			allocations++;
+		}
+		cluster = new (memory) SimpleCluster(functions, data);
+	}
+	living++;
+	TOP_TREE_COUNT(creations, 1);
+
+	return std::shared_ptr<SimpleCluster>(cluster, recycler{this}, SlabAllocator<SimpleCluster>(arena));
+}
+
+void SimpleClusterPool::recycle(SimpleCluster *cluster) {
+	// Destructor releases all links to the other clusters (they may be recycled too)
+	auto data = std::move(cluster->data);
+	cluster->~SimpleCluster();
+	if (free_clusters.size() == free_clusters.capacity()) allocations++;
+	free_clusters.push_back(free_cluster{cluster, std::move(data)});
+
+	living--;
+	if (released && living == 0) delete this;
+}
+
+void SimpleClusterPool::release() {
+	released = true;
+	if (living == 0) delete this;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// TopologyCluster
 
@@ -66,13 +121,18 @@ void TopologyCluster::unlink() {
 	vertex = NULL;
 	edge_cluster = NULL;
 	combined_edge_cluster = NULL;
+	own_combined_edge_cluster = NULL;
 
 	outer_edges.clear(); // or call remove_all_outer_edges?
 
 	is_deleted = true;
 }
 
-std::shared_ptr<BaseTree::Internal::Vertex> TopologyCluster::get_common_vertex(std::shared_ptr<ICluster> cluster_a, std::shared_ptr<ICluster> cluster_b, bool get_superior) {
+BaseTree::Internal::Vertex *TopologyCluster::get_common_vertex(std::shared_ptr<ICluster> cluster_a, std::shared_ptr<ICluster> cluster_b, bool get_superior) {
+	// Exact match first (two subvertices of one vertex have the same superior vertex)
+	if (cluster_a->boundary_left == cluster_b->boundary_left || cluster_a->boundary_left == cluster_b->boundary_right) return cluster_a->boundary_left;
+	if (cluster_a->boundary_right == cluster_b->boundary_left || cluster_a->boundary_right == cluster_b->boundary_right) return cluster_a->boundary_right;
+
 	auto common_vertex = cluster_a->boundary_left;
 
 	if (get_superior && common_vertex->superior_vertex != NULL) common_vertex = common_vertex->superior_vertex;
@@ -89,10 +149,21 @@ std::shared_ptr<BaseTree::Internal::Vertex> TopologyCluster::get_common_vertex(s
 	return common_vertex;
 }
 
-int TopologyCluster::global_index = 0;
+void TopologyCluster::move_boundary_over_rake(const std::shared_ptr<ICluster> &rake, BaseTree::Internal::Vertex *&boundary_left, BaseTree::Internal::Vertex *&boundary_right) {
+	auto a = rake->boundary_left;
+	auto b = rake->boundary_right;
+	if (a == b || a->superior_vertex == NULL || a->superior_vertex != b->superior_vertex) return; // raked at one vertex
+
+	if (boundary_left == a) boundary_left = b;
+	else if (boundary_left == b) boundary_left = a;
+	else if (boundary_right == a) boundary_right = b;
+	else if (boundary_right == b) boundary_right = a;
+}
+
+std::atomic<int> TopologyCluster::global_index{0};
 
-TopologyCluster::TopologyCluster() {
-	index = global_index++;
+TopologyCluster::TopologyCluster(const UserFunctions *functions) : ICluster(functions) {
+	index = global_index.fetch_add(1, std::memory_order_relaxed);
 }
 
 std::ostream& TopologyCluster::ToString(std::ostream& o) const {
@@ -108,17 +179,20 @@ std::ostream& operator<<(std::ostream& o, const TopologyCluster& c) { return c.T
 void TopologyCluster::set_first_child(std::shared_ptr<TopologyCluster> child) {
 	do_split(); // ensure splitted
 	first = child;
+	outer_edges_changed = true;
 	if (child != NULL) child->parent = shared_from_this();
 }
 void TopologyCluster::set_second_child(std::shared_ptr<TopologyCluster> child) {
 	do_split(); // ensure splitted
 	second = child;
+	outer_edges_changed = true;
 	if (child != NULL) child->parent = shared_from_this();
 }
 
-void TopologyCluster::do_join() {
-	if (!is_splitted) return;
-	if (is_deleted) return;
+int TopologyCluster::do_join() {
+	if (!is_splitted) return 0;
+	if (is_deleted) return 0;
+	int joins = 0;
 
 	#ifdef DEBUG
 		std::cerr << "Joining " << *shared_from_this() << " (" << shared_from_this() << ")" << std::endl;
@@ -131,15 +205,16 @@ void TopologyCluster::do_join() {
 		#ifdef DEBUG
 			std::cerr << "... joined (vertex cluster without edge)" << std::endl;
 		#endif
-		return; // it is the basic cluster at vertex level
+		return 0; // it is the basic cluster at vertex level
 	}
 
 	// 1. Ensure that childs are joined
-	if (first != NULL) first->do_join();
-	if (second != NULL) second->do_join();
+	if (first != NULL) joins += first->do_join();
+	if (second != NULL) joins += second->do_join();
 
-	// 2. Calculate outer edges
-	calculate_outer_edges();
+	// 2. Calculate outer edges (only if childs changed, edges to the neighbours are kept up to date by the neighbours)
+	if (outer_edges_changed) calculate_outer_edges();
+	else is_rake_branch = outer_edges_rake_branch;
 
 	// 3. Join itself:
 	if (second == NULL) {
@@ -152,7 +227,7 @@ void TopologyCluster::do_join() {
 		edge = NULL;
 		edge_cluster = NULL;
 		//data = first->data;
-		CopyClusterData(first, shared_from_this());
+		functions->CopyClusterData(first, shared_from_this());
 	} else {
 		if (edge == NULL) {
 			std::cerr << "ERROR: Cluster '" << this << "' with both children but without edge between!" << std::endl;
@@ -166,17 +241,21 @@ void TopologyCluster::do_join() {
 		is_top_cluster = !edge->subvertice_edge || first->is_top_cluster || second->is_top_cluster; // if edge or at least one child is top cluster -> this is top cluster too
 
 		// 1. Create base cluster for edge
-		edge_cluster = std::make_shared<SimpleCluster>();
+		renew_simple_cluster(edge_cluster);
 		edge_cluster->boundary_left = edge->from;
 		edge_cluster->boundary_right = edge->to;
-		if (!edge->subvertice_edge) Create(edge_cluster, edge->data);
+		if (!edge->subvertice_edge) {
+			TOP_TREE_COUNT(user_function_counters.creates, 1);
+			functions->Create(edge_cluster, edge->data);
+		}
 
 		// 2. Join with the edge first (if there is something to Join)
 		if (first->is_top_cluster) {
 			#ifdef DEBUG
 				std::cerr << "... joining " << *first << " (" << *first->boundary_left << "-" << *first->boundary_right << ") with edge with endpoints " << *edge_cluster->boundary_left << "-" << *edge_cluster->boundary_right << std::endl;
 			#endif
-			combined_edge_cluster = std::make_shared<SimpleCluster>();
+			renew_simple_cluster(own_combined_edge_cluster);
+			combined_edge_cluster = own_combined_edge_cluster;
 			if (first->is_rake_branch) {
 				//if (edge->subvertice_edge) {
 				//	combined_edge_cluster->boundary_left = first->boundary_left;
@@ -185,6 +264,7 @@ void TopologyCluster::do_join() {
 					combined_edge_cluster->boundary_left = edge_cluster->boundary_left;
 					combined_edge_cluster->boundary_right = edge_cluster->boundary_right;
 				//}
+				move_boundary_over_rake(first, combined_edge_cluster->boundary_left, combined_edge_cluster->boundary_right);
 			} else {
 				// It is compress
 				// i) get common vertex
@@ -196,9 +276,11 @@ void TopologyCluster::do_join() {
 			}
 			if (!edge->subvertice_edge) {
 				//if (first->data == combined_edge_cluster->data || edge_cluster->data == combined_edge_cluster->data) combined_edge_cluster->data = InitClusterData();
-				Join(first, edge_cluster, combined_edge_cluster);
+				TOP_TREE_COUNT(user_function_counters.joins, 1);
+				functions->Join(first, edge_cluster, combined_edge_cluster);
+				joins++;
 			}
-			else CopyClusterData(first, combined_edge_cluster); // combined_edge_cluster->data = first->data;
+			else functions->CopyClusterData(first, combined_edge_cluster); // combined_edge_cluster->data = first->data;
 			#ifdef DEBUG
 				std::cerr << "... combined edge have endpoints " << *combined_edge_cluster->boundary_left << "," << *combined_edge_cluster->boundary_right << std::endl;
 			#endif
@@ -213,6 +295,7 @@ void TopologyCluster::do_join() {
 			if (second->is_rake_branch) {
 				boundary_left = combined_edge_cluster->boundary_left;
 				boundary_right = combined_edge_cluster->boundary_right;
+				move_boundary_over_rake(second, boundary_left, boundary_right);
 				is_rake_branch = (edge->subvertice_edge && first->is_top_cluster && first->is_rake_branch);
 			} else {
 				// It is compress
@@ -232,9 +315,11 @@ void TopologyCluster::do_join() {
 				#endif
 				//if (second->data == data || combined_edge_cluster->data == data) data = InitClusterData();
 				//std::cerr << second << " + " << combined_edge_cluster << " -> " << shared_from_this() << std::endl;
-				Join(second, combined_edge_cluster, shared_from_this());
+				TOP_TREE_COUNT(user_function_counters.joins, 1);
+				functions->Join(second, combined_edge_cluster, shared_from_this());
+				joins++;
 			}
-			else CopyClusterData(second, shared_from_this()); // data = second->data;
+			else functions->CopyClusterData(second, shared_from_this()); // data = second->data;
 
 			#ifdef DEBUG
 				std::cerr << "... cluster have endpoints " << *boundary_left << "," << *boundary_right << std::endl;
@@ -244,7 +329,7 @@ void TopologyCluster::do_join() {
 			boundary_left = combined_edge_cluster->boundary_left;
 			boundary_right = combined_edge_cluster->boundary_right;
 			//data = combined_edge_cluster->data;
-			CopyClusterData(combined_edge_cluster, shared_from_this());
+			functions->CopyClusterData(combined_edge_cluster, shared_from_this());
 		}
 		//}
 	}
@@ -254,16 +339,18 @@ void TopologyCluster::do_join() {
 	#endif
 
 	is_splitted = false;
+	return joins;
 }
 
 void TopologyCluster::remove_all_outer_edges() {
-	for (auto o: outer_edges) {
+	for (const auto &o: outer_edges) {
 		// Remove outer edge from neighbour
 		// bool removed = false;
 		for (uint i = 0; i < o.cluster->outer_edges.size(); i++) {
-			if (o.cluster->outer_edges[i].edge == o.edge && o.cluster->outer_edges[i].cluster == shared_from_this()) {
+			if (o.cluster->outer_edges[i].edge == o.edge && o.cluster->outer_edges[i].cluster == this) {
 				// std::cerr << "Removed edge to " << *o.cluster << " " << *o.cluster->outer_edges[i].cluster << "(" << *o.edge->data << ")" << std::endl;
-				o.cluster->outer_edges.erase(o.cluster->outer_edges.begin() + i);
+				o.cluster->outer_edges.erase(i);
+				if (o.cluster->parent != NULL) o.cluster->parent->outer_edges_changed = true;
 				// removed = true;
 				break;
 			}
@@ -273,6 +360,8 @@ void TopologyCluster::remove_all_outer_edges() {
 	outer_edges.clear();
 }
 
+// Outer edges are always rebuilt from both childs (at most 8 entries), changes of the childs are not applied
+// incrementally, do_join only skips clusters whose childs did not change (see outer_edges_changed)
 void TopologyCluster::calculate_outer_edges(bool check_neighbours) {
 	do_split(); // ensure splitted
 	outer_edges.clear();
@@ -281,9 +370,9 @@ void TopologyCluster::calculate_outer_edges(bool check_neighbours) {
 			std::cerr << "Calculating edges for basic cluster of " << *vertex->data << " with " << vertex->neighbours.size() << " neighbours" << std::endl;
 		#endif
 		// Update outer edges according to underlying vertex
-		for (auto n: vertex->neighbours) {
-			auto ee = n.edge.lock();
-			std::shared_ptr<BaseTree::Internal::Vertex> vv;
+		for (const auto &n: vertex->neighbours) {
+			auto &ee = n.edge;
+			BaseTree::Internal::Vertex *vv;
 			if (ee->from == vertex) vv = ee->to;
 			else if (ee->to == vertex) vv = ee->from;
 			else {
@@ -295,43 +384,43 @@ void TopologyCluster::calculate_outer_edges(bool check_neighbours) {
 			#ifdef DEBUG
 				std::cerr << "... " << *vv << " with " << *ee->data << " (" << *ee->from << "-" << *ee->to << ")" << std::endl;
 			#endif
-			outer_edges.push_back(neighbour{ee, vv->topology_cluster});
+			outer_edges.push_back(neighbour{ee, vv->topology_cluster.get()});
 			if (vv->topology_cluster == NULL) {
 				std::cerr << "ERROR: Cannot get topology cluster for neighbour " << *vv << std::endl;
 				exit(1);
 			}
 		}
 	} else if (second == NULL) {
-		for (auto o: first->outer_edges) outer_edges.push_back(neighbour{o.edge, o.cluster->parent});
+		for (const auto &o: first->outer_edges) outer_edges.push_back(neighbour{o.edge, o.cluster->parent.get()});
 		boundary_left = first->boundary_left;
 		boundary_right = first->boundary_right;
 	} else {
 		// Take only unique edges from both children
 		// std::cerr << "First " << *first << " edges:" << std::endl;
 		int first_counter = 0;
-		for (auto o: first->outer_edges) {
+		for (const auto &o: first->outer_edges) {
 			// std::cerr << *o.cluster << "(" << *o.edge->data << ")" << std::endl;
 			bool unique = true;
-			for (auto oo: second->outer_edges) if (o.edge == oo.edge) {
+			for (const auto &oo: second->outer_edges) if (o.edge == oo.edge) {
 				// edge = o.edge; // not neede because the second for does it
 				unique = false;
 			}
 			if (unique) {
-				outer_edges.push_back(neighbour{o.edge, o.cluster->parent});
+				outer_edges.push_back(neighbour{o.edge, o.cluster->parent.get()});
 				first_counter++;
 			}
 		}
 		// std::cerr << "Second " << *second << " edges:" << std::endl;
 		int second_counter = 0;
-		for (auto o: second->outer_edges) {
+		for (const auto &o: second->outer_edges) {
 			// std::cerr << *o.cluster << "(" << *o.edge->data << ")" << std::endl;
 			bool unique = true;
-			for (auto oo: first->outer_edges) if (o.edge == oo.edge) {
+			for (const auto &oo: first->outer_edges) if (o.edge == oo.edge) {
 				edge = o.edge;
 				unique = false;
 			}
 			if (unique) {
-				outer_edges.push_back(neighbour{o.edge, o.cluster->parent});
+				outer_edges.push_back(neighbour{o.edge, o.cluster->parent.get()});
 				second_counter++;
 			}
 		}
@@ -339,22 +428,26 @@ void TopologyCluster::calculate_outer_edges(bool check_neighbours) {
 		if (first_counter == 2 && second_counter == 0) is_rake_branch = true;
 		else if (first_counter == 0 && second_counter == 2) is_rake_branch = true;
 		else is_rake_branch = false;
+		outer_edges_rake_branch = is_rake_branch;
 	}
+	outer_edges_changed = false;
+	if (parent != NULL) parent->outer_edges_changed = true; // its outer edges are taken from this cluster
 
-	if (check_neighbours) for (auto o: outer_edges) {
+	if (check_neighbours) for (const auto &o: outer_edges) {
 		#ifdef DEBUG
 			std::cerr << "Checking edge " << *o.edge->data << " to cluster " << *o.cluster << std::endl;
 		#endif
 		bool found = false;
 		for (auto &oo: o.cluster->outer_edges) {
 			if (oo.edge == o.edge) {
-				if (oo.cluster != shared_from_this()) oo.cluster = shared_from_this();
+				oo.cluster = this;
 				// std::cerr << "found " << *oo.cluster << "(" << *oo.edge->data << ")" << std::endl;
 				found = true;
 				break;
 			}
 		}
-		if (!found) o.cluster->outer_edges.push_back(neighbour{o.edge, shared_from_this()});
+		if (!found) o.cluster->outer_edges.push_back(neighbour{o.edge, this});
+		if (o.cluster->parent != NULL) o.cluster->parent->outer_edges_changed = true;
 	}
 }
 
@@ -379,7 +472,7 @@ void TopologyCluster::do_split(std::vector<std::shared_ptr<TopologyCluster>>* sp
 	if (second == NULL) {
 		// Just copy data down
 		//first->data = data;
-		CopyClusterData(shared_from_this(), first);
+		functions->CopyClusterData(shared_from_this(), first);
 	} else {
 		if (edge == NULL) {
 			std::cerr << "ERROR: Cluster '" << this << "' with both children but without edge between!" << std::endl;
@@ -389,35 +482,39 @@ void TopologyCluster::do_split(std::vector<std::shared_ptr<TopologyCluster>>* sp
 			// They are joined as rake clusters, first was raked to the second one
 			if (first->is_top_cluster && second->is_top_cluster) {
 				// Rake Split:
-				Split(first, second, shared_from_this());
+				TOP_TREE_COUNT(user_function_counters.splits, 1);
+				functions->Split(first, second, shared_from_this());
 			} else if (first->is_top_cluster) {
 				// Just copy data down
 				//first->data = data;
-				CopyClusterData(shared_from_this(), first);
+				functions->CopyClusterData(shared_from_this(), first);
 			} else if (second->is_top_cluster) {
 				// Just copy data down
 				//second->data = data;
-				CopyClusterData(shared_from_this(), second);
+				functions->CopyClusterData(shared_from_this(), second);
 			}
 		} else {
 			// 1. Split with the second
 			if (second->is_top_cluster) {
-				Split(second, combined_edge_cluster, shared_from_this());
+				TOP_TREE_COUNT(user_function_counters.splits, 1);
+				functions->Split(second, combined_edge_cluster, shared_from_this());
 			} else {
 				//combined_edge_cluster->data = data;
-				CopyClusterData(shared_from_this(), combined_edge_cluster);
+				functions->CopyClusterData(shared_from_this(), combined_edge_cluster);
 			}
 
 			// 2. Split with the first
 			if (first->is_top_cluster) {
-				Split(first, edge_cluster, combined_edge_cluster);
+				TOP_TREE_COUNT(user_function_counters.splits, 1);
+				functions->Split(first, edge_cluster, combined_edge_cluster);
 			} else {
 				//edge_cluster->data = combined_edge_cluster->data;
-				CopyClusterData(combined_edge_cluster, edge_cluster);
+				functions->CopyClusterData(combined_edge_cluster, edge_cluster);
 			}
 
 			// 3. Destroy edge cluster
-			Destroy(edge_cluster, edge->data);
+			TOP_TREE_COUNT(user_function_counters.destroys, 1);
+			functions->Destroy(edge_cluster, edge->data);
 		}
 	}
 
@@ -428,8 +525,20 @@ void TopologyCluster::do_split(std::vector<std::shared_ptr<TopologyCluster>>* sp
 	is_splitted = true;
 }
 
+// Clusters of the edge are made again by every do_join, they are created by the first one and then reset in place
+// (user functions do not keep them), so repeated Expose and Restore do not allocate them
+void TopologyCluster::renew_simple_cluster(std::shared_ptr<ICluster> &cluster) {
+	if (cluster == NULL) {
+		cluster = std::make_shared<SimpleCluster>(functions);
+		return;
+	}
+	if (!cluster->data->Reset()) cluster->data = functions->InitClusterData();
+	cluster->boundary_left = NULL;
+	cluster->boundary_right = NULL;
+}
+
 // Test if the v is external boundary vertex of the cluster (with respect to superior vertices)
-bool TopologyCluster::is_external_boundary_vertex(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+bool TopologyCluster::is_external_boundary_vertex(BaseTree::Internal::Vertex *v) {
 	if (v->superior_vertex != NULL) v = v->superior_vertex;
 
 	if (boundary_left != v && boundary_right != v
@@ -437,7 +546,7 @@ bool TopologyCluster::is_external_boundary_vertex(std::shared_ptr<BaseTree::Inte
 	  && (boundary_right == NULL || boundary_right->superior_vertex != v)
 	) return false; // v isn't either boundary vertex, it cannot be external boundary vertex
 
-	for (auto n: outer_edges) {
+	for (const auto &n: outer_edges) {
 		if (n.edge->from == v || n.edge->to == v || n.edge->from->superior_vertex == v || n.edge->to->superior_vertex == v) return true;
 	}
 
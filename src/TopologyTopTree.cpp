@@ -1,10 +1,17 @@
 #include <queue>
 #include <vector>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "TopologyTopTree.hpp"
 #include "BaseTreeInternal.hpp"
 #include "TopologyCluster.hpp"
+#include "ParallelFor.hpp"
+#include "TopTreeStatistics.hpp"
 
 //#define DEBUG
 //#define DEBUG_GRAPHVIZ
@@ -17,52 +24,176 @@ namespace TopTree {
 // Hide data from .hpp file using PIMP idiom
 class TopologyTopTree::Internal {
 public:
+	Internal(const UserFunctions *functions): functions{functions}, simple_pool{new SimpleClusterPool(functions)} {}
+	// Simple clusters still referenced (by the user) return to the pool later
+	~Internal() { simple_pool->release(); }
+
+	const UserFunctions *functions; // Given to all clusters
 	std::list<std::shared_ptr<TopologyCluster> > root_clusters;
 	std::shared_ptr<BaseTree> base_tree;
 
-	std::shared_ptr<TopologyCluster> construct_basic_clusters(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> parent_edge=NULL);
-	std::shared_ptr<TopologyCluster> construct_topology_tree(std::shared_ptr<TopologyCluster> cluster, int level = 0, std::shared_ptr<BaseTree::Internal::Edge> parent_edge = NULL);
-	std::shared_ptr<BaseTree::Internal::Vertex> split_vertex(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> parent_edge = NULL);
-	std::shared_ptr<BaseTree::Internal::Vertex> repair_subvertex_after_cut(std::shared_ptr<BaseTree::Internal::Vertex> v);
-	std::shared_ptr<BaseTree::Internal::Vertex> get_vertex_to_link(std::shared_ptr<BaseTree::Internal::Vertex> v);
-
-	std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> cut(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w, std::shared_ptr<BaseTree::Internal::Edge> edge);
-	std::shared_ptr<TopologyCluster> link(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w, std::shared_ptr<BaseTree::Internal::Edge> edge);
-
-	std::list<std::shared_ptr<SimpleCluster>> expose_get_clusters(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> second_v, bool continue_above_common);
-	std::shared_ptr<SimpleCluster> expose_join_clusters(std::shared_ptr<BaseTree::Internal::Vertex> current, std::shared_ptr<BaseTree::Internal::Vertex> target, std::shared_ptr<SimpleCluster> parent_cluster);
-
-	//void soft_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w);
-	//std::shared_ptr<Cluster> hard_expose(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w);
+	// Clusters created during construction (every thread of the parallel construction has its own lists)
+	struct construction_lists {
+		std::vector<std::shared_ptr<TopologyCluster>> splitted_clusters;
+		std::vector<std::shared_ptr<TopologyCluster>> to_calculate_outer_edges;
+	};
+	std::shared_ptr<TopologyCluster> construct_basic_clusters(Ref<BaseTree::Internal::Vertex> v, construction_lists *lists, Ref<BaseTree::Internal::Edge> parent_edge=NULL);
+	std::shared_ptr<TopologyCluster> construct_topology_tree(std::shared_ptr<TopologyCluster> cluster, construction_lists *lists, int threads = 1, Ref<BaseTree::Internal::Edge> parent_edge = NULL);
+	std::shared_ptr<TopologyCluster> construct_component(std::shared_ptr<TopologyCluster> root_cluster, construction_lists *lists, int threads = 1);
+	void construct_parallel(int threads);
+	Ref<BaseTree::Internal::Vertex> split_vertex(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Edge> parent_edge = NULL);
+	Ref<BaseTree::Internal::Vertex> repair_subvertex_after_cut(Ref<BaseTree::Internal::Vertex> v);
+	Ref<BaseTree::Internal::Vertex> get_vertex_to_link(Ref<BaseTree::Internal::Vertex> v);
+	Ref<BaseTree::Internal::Vertex> new_subvertex(Ref<BaseTree::Internal::Vertex> v, bool with_cluster = false); // cluster is needed outside of construction
+	void remove_first_subvertex(Ref<BaseTree::Internal::Vertex> v);
+	Ref<BaseTree::Internal::Edge> get_real_edge(BaseTree::Internal::Vertex *subvertex); // some edge out of the superior vertex
+	void move_subvertex_edge(Ref<BaseTree::Internal::Vertex> from, Ref<BaseTree::Internal::Vertex> to, Ref<BaseTree::Internal::Edge> edge); // cut and link, direction is kept
+
+	Ref<BaseTree::Internal::Edge> find_edge(BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *w);
+	std::shared_ptr<TopologyCluster> get_vertex_cluster(BaseTree::Internal::Vertex *v);
+
+	std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> cut(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge);
+	std::shared_ptr<TopologyCluster> link(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge);
+	// Changes of the vertex level only (used by cut/link), changed clusters are added into the change list
+	void remove_edge(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge);
+	void add_edge(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge);
+
+	// Batch operations change only the vertex level, clusters above all of them are repaired at once by flush_batch()
+	void batch_cut(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge);
+	bool batch_link(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, std::shared_ptr<EdgeData> edge_data);
+	void flush_batch();
+
+	void expose_get_clusters(std::vector<std::shared_ptr<SimpleCluster>> &list, BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *second_v, bool continue_above_common);
+	void expose_add(BaseTree::Internal::Vertex *v, std::shared_ptr<SimpleCluster> cluster);
+	std::shared_ptr<SimpleCluster> expose_join_clusters(BaseTree::Internal::Vertex *current, BaseTree::Internal::Vertex *target, std::shared_ptr<SimpleCluster> parent_cluster);
+
+	// Read-only path query (see QueryPath) does the same steps as Expose, but data of the clusters are splitted
+	// into copies in a scratch of the calling thread, so the top tree is never changed. The scratch keeps its simple
+	// clusters for the next queries of the thread (on the same tree), so queries do not allocate once it is large enough.
+	static std::atomic<unsigned long long> global_id;
+	const unsigned long long id = ++global_id; // identifies the tree of the clusters in the scratches
+	struct path_query {
+		unsigned long long tree = 0;
+		const UserFunctions *functions = NULL;
+
+		// Copies of the clusters of the tree by open addressing on their addresses (entries of the previous queries
+		// have older epoch)
+		struct entry {
+			const ICluster *cluster = NULL;
+			unsigned int epoch = 0;
+			bool splitted = false; // cluster which Expose would split
+			int copy = -1; // index into clusters
+		};
+		std::vector<entry> entries;
+		size_t used_entries = 0;
+		unsigned int epoch = 0;
+
+		std::vector<std::shared_ptr<SimpleCluster>> clusters;
+		size_t used_clusters = 0;
+
+		std::vector<TopologyCluster*> to_split;
+		std::vector<std::shared_ptr<SimpleCluster>> list, second_list;
+		std::vector<std::pair<BaseTree::Internal::Vertex*, std::shared_ptr<SimpleCluster>>> expose_clusters; // of (superior) vertices
+
+		void start(unsigned long long tree, const UserFunctions *functions);
+		entry &find(const ICluster *cluster);
+		bool is_splitted(const ICluster *cluster);
+		std::shared_ptr<SimpleCluster> new_cluster();
+	};
+	std::shared_ptr<SimpleCluster> query_copy(path_query *query, const std::shared_ptr<ICluster> &cluster) const;
+	void query_split(path_query *query, TopologyCluster *cluster) const;
+	void query_get_clusters(path_query *query, std::vector<std::shared_ptr<SimpleCluster>> &list, BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *second_v, bool continue_above_common) const;
+	std::shared_ptr<SimpleCluster> query_join_clusters(path_query *query, BaseTree::Internal::Vertex *current, BaseTree::Internal::Vertex *target, std::shared_ptr<SimpleCluster> parent_cluster) const;
+
+	//void soft_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w);
+	//std::shared_ptr<Cluster> hard_expose(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w);
 	//void restore_hard_expose();
 	//void guarded_splay(std::shared_ptr<Cluster> node, std::shared_ptr<Cluster> guard = NULL);
 
 	std::vector<std::shared_ptr<TopologyCluster>> splitted_clusters;
 	std::vector<std::shared_ptr<TopologyCluster>> to_calculate_outer_edges;
 	std::vector<std::shared_ptr<SimpleCluster>> expose_simple_clusters;
+	SimpleClusterPool *simple_pool; // Temporary clusters of Expose are taken from the pool
+	// Scratch of Expose, it is kept between Exposes (with its capacity) so that they do not allocate
+	struct expose_entry {
+		std::shared_ptr<SimpleCluster> cluster;
+		int next; // next cluster of the same vertex (-1 at the end)
+	};
+	std::vector<std::shared_ptr<SimpleCluster>> expose_list; // clusters on the exposed path and hanging from it
+	std::vector<expose_entry> expose_graph; // lists of clusters of (superior) vertices, see Vertex::expose_first
+	size_t expose_capacity() const;
+	// Result of the last Expose (valid until Restore)
+	int last_expose_v = -1;
+	int last_expose_w = -1;
+	std::shared_ptr<SimpleCluster> last_expose_cluster = NULL;
+
+	// Deferred joins (see SetDeferredJoins), splitted clusters are kept in splitted_clusters between Exposes
+	bool deferred_joins = false;
+	void restore(bool join);
+	// Split set of the running Restore (see restore)
+	unsigned int restore_epoch = 0;
+	std::vector<TopologyCluster*> restore_set;
+
+	// Counters of GetStatistics (counted only with TOP_TREE_STATISTICS), simple clusters and user function calls are
+	// reported relative to their values at the construction (or reset)
+	struct Statistics {
+		long long update_levels = 0; // levels repaired by update_clusters
+		long long deleted_clusters = 0;
+		long long changed_clusters = 0;
+		long long abandoned_clusters = 0;
+		long long exposes = 0; // Exposes which had to construct the clusters
+		long long expose_hits = 0; // Exposes answered by the previously exposed clusters
+		long long expose_allocations = 0; // simple clusters allocated by Exposes and Exposes which grew their buffers
+		long long restores = 0; // Restores of an exposed path
+		long long restore_joins = 0; // Join callbacks invoked by them
+		long long split_vertices = 0; // vertices splitted into subvertices
+		long long added_subvertices = 0;
+		long long removed_subvertices = 0;
+		size_t simple_clusters_at_reset = 0;
+		UserFunctionCounters user_functions_at_reset = user_function_counters;
+	} statistics;
+	void (*restore_hook)(int joins) = NULL;
+	void join_off_path(std::shared_ptr<TopologyCluster> cluster_v, std::shared_ptr<TopologyCluster> cluster_w);
 
 	#ifdef DEBUG_GRAPHVIZ
 		void print_graphviz(std::shared_ptr<TopologyCluster> node, const std::string title="", bool full = false);
-		void print_graphviz_recursive(std::shared_ptr<TopologyCluster> cluster, std::shared_ptr<BaseTree::Internal::Edge> parent_edge = NULL, std::shared_ptr<TopologyCluster> parent = NULL, bool edges_to_childs = false, bool gray = false) const;
+		void print_graphviz_recursive(std::shared_ptr<TopologyCluster> cluster, Ref<BaseTree::Internal::Edge> parent_edge = NULL, std::shared_ptr<TopologyCluster> parent = NULL, bool edges_to_childs = false, bool gray = false) const;
 	#endif
 
-	bool in_same_tree(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w) {
-		// 1. Get topology clusters
-		auto v_root = v->topology_cluster;
-		if (!v->subvertices.empty()) v_root = v->subvertices.front()->topology_cluster;
-		auto w_root = w->topology_cluster;
-		if (!w->subvertices.empty()) w_root = w->subvertices.front()->topology_cluster;
+	std::shared_ptr<TopologyCluster> get_root(BaseTree::Internal::Vertex *v) {
+		// 1. Get topology cluster (vertex splitted into subvertices has none)
+		auto root = v->topology_cluster;
+		if (v->first_subvertex != NULL) root = v->first_subvertex->topology_cluster;
 
-		// 2. If one of them has no cluster -> it is independent vertex, they are not connected
-		if (v_root == NULL || w_root == NULL) return false;
+		// 2. Vertex without cluster is an independent vertex
+		if (root == NULL) return NULL;
+
+		// 3. Go up to the root - O(log N)
+		while (root->parent != NULL) root = root->parent;
+		return root;
+	}
 
-		// 3. Test if they aren't in the same tree (if they are already linked) - O(log N)
-		while (v_root->parent != NULL) v_root = v_root->parent;
-		while (w_root->parent != NULL) w_root = w_root->parent;
+	bool in_same_tree(BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *w) {
+		auto v_root = get_root(v);
+		auto w_root = get_root(w);
 
+		// If one of them has no cluster -> it is independent vertex, they are not connected
+		if (v_root == NULL || w_root == NULL) return false;
 		return (v_root == w_root);
 	}
 
+	void add_root(std::shared_ptr<TopologyCluster> root) {
+		if (root == NULL || root->listed_in_root_clusters) return;
+		root_clusters.push_back(root);
+		root->root_clusters_iterator = std::prev(root_clusters.end());
+		root->listed_in_root_clusters = true;
+	}
+	void remove_root(std::shared_ptr<TopologyCluster> root) {
+		if (root == NULL || !root->listed_in_root_clusters) return;
+		root_clusters.erase(root->root_clusters_iterator);
+		root->listed_in_root_clusters = false;
+	}
+
 	void recursive_delete_cluster(std::shared_ptr<TopologyCluster> cluster);
 private:
 	int graphviz_counter = 0;
@@ -78,16 +209,22 @@ private:
 
 	std::vector<std::shared_ptr<TopologyCluster>> found_roots;
 
+	// Used by batch operations
+	std::vector<Ref<BaseTree::Internal::Vertex>> batch_vertices; // vertices with changed edges (their roots are found after flush)
+	std::unordered_map<TopologyCluster*, TopologyCluster*> batch_components; // roots of trees joined by links waiting for flush (union-find)
+	TopologyCluster *batch_find_component(TopologyCluster *root);
+
 	void update_clusters();
+	void update_clusters_mark_changed(std::shared_ptr<TopologyCluster> cluster);
 	void update_clusters_join_with_neighbour(std::shared_ptr<TopologyCluster> cluster, std::shared_ptr<TopologyCluster> neighbour);
 	void update_clusters_only_child(std::shared_ptr<TopologyCluster> cluster);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
-TopologyTopTree::TopologyTopTree() : internal{std::make_unique<Internal>()} {}
+TopologyTopTree::TopologyTopTree(const UserFunctions *functions) : internal{std::make_unique<Internal>(functions)} {}
 
-TopologyTopTree::TopologyTopTree(std::shared_ptr<BaseTree> baseTree) : TopologyTopTree() {
+TopologyTopTree::TopologyTopTree(std::shared_ptr<BaseTree> baseTree, const UserFunctions *functions) : TopologyTopTree(functions) {
 	InitFromBaseTree(baseTree);
 }
 
@@ -100,29 +237,34 @@ TopologyTopTree::~TopologyTopTree() {
 }
 
 void TopologyTopTree::InitFromBaseTree(std::shared_ptr<BaseTree> baseTree) {
+	InitFromBaseTree(baseTree, 1);
+}
+
+void TopologyTopTree::InitFromBaseTree(std::shared_ptr<BaseTree> baseTree, int threads) {
 	internal->base_tree = baseTree;
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
 
 	for (auto v : internal->base_tree->internal->vertices) v->used = false;
 
-	for (auto v : internal->base_tree->internal->vertices) {
-		if (v->used || v->degree != 1) continue;
+	if (threads > 1) internal->construct_parallel(threads);
+	else {
+		Internal::construction_lists lists;
+		for (auto v : internal->base_tree->internal->vertices) {
+			if (v->used || v->degree != 1) continue;
 
-		#ifdef DEBUG
-			std::cerr << "Constructing basic clusters from vertex " << *v << std::endl;
-		#endif
-		auto root_cluster = internal->construct_basic_clusters(v);
-		#ifdef DEBUG_GRAPHVIZ
-			internal->print_graphviz(root_cluster, "Basic clusters");
-		#endif
-		while (root_cluster->outer_edges.size() > 0) {
-			root_cluster = internal->construct_topology_tree(root_cluster);
-			for (auto c: internal->to_calculate_outer_edges) c->calculate_outer_edges();
-			internal->to_calculate_outer_edges.clear();
+			#ifdef DEBUG
+				std::cerr << "Constructing basic clusters from vertex " << *v << std::endl;
+			#endif
+			auto root_cluster = internal->construct_basic_clusters(v, &lists);
+			#ifdef DEBUG_GRAPHVIZ
+				internal->print_graphviz(root_cluster, "Basic clusters");
+			#endif
+			internal->add_root(internal->construct_component(root_cluster, &lists));
 		}
-		internal->root_clusters.push_back(root_cluster);
-		root_cluster->root_clusters_iterator = std::prev(internal->root_clusters.end());
+		internal->splitted_clusters.swap(lists.splitted_clusters);
 	}
 
+	// User functions are called from this thread only
 	for (auto c: internal->splitted_clusters) c->do_join();
 	internal->splitted_clusters.clear();
 
@@ -147,7 +289,7 @@ void TopologyTopTree::Internal::recursive_delete_cluster(std::shared_ptr<Topolog
 ////////////////////////////////////////////////////////////////////////////////
 // Debug output - Graphviz
 
-void TopologyTopTree::Internal::print_graphviz_recursive(std::shared_ptr<TopologyCluster> cluster, std::shared_ptr<BaseTree::Internal::Edge> parent_edge, std::shared_ptr<TopologyCluster> parent, bool edges_to_childs, bool gray) const {
+void TopologyTopTree::Internal::print_graphviz_recursive(std::shared_ptr<TopologyCluster> cluster, Ref<BaseTree::Internal::Edge> parent_edge, std::shared_ptr<TopologyCluster> parent, bool edges_to_childs, bool gray) const {
 	if (cluster == NULL) return;
 
 	auto shape = (cluster->first == NULL ? "triangle" : (cluster->second == NULL ? "circle" : "Msquare"));
@@ -165,8 +307,8 @@ void TopologyTopTree::Internal::print_graphviz_recursive(std::shared_ptr<Topolog
 		if (cluster->first != NULL) std::cout << "\t\"" << cluster << "\" -> \"" << cluster->first << "\" [color=orange, weight=0.5]" << std::endl;
 		if (cluster->second != NULL) std::cout << "\t\"" << cluster << "\" -> \"" << cluster->second << "\" [color=orange, weight=0.5]" << std::endl;
 	}
-	for (auto o: cluster->outer_edges) {
-		if (o.edge != parent_edge) print_graphviz_recursive(o.cluster, o.edge, cluster, edges_to_childs, gray);
+	for (const auto &o: cluster->outer_edges) {
+		if (o.edge != parent_edge) print_graphviz_recursive(o.cluster->shared_from_this(), o.edge, cluster, edges_to_childs, gray);
 	}
 
 	// Parent test
@@ -203,6 +345,12 @@ void TopologyTopTree::Internal::print_graphviz(const std::shared_ptr<TopologyClu
 ////////////////////////////////////////////////////////////////////////////////
 /// Update procedure:
 
+void TopologyTopTree::Internal::update_clusters_mark_changed(std::shared_ptr<TopologyCluster> cluster) {
+	if (cluster->listed_in_change_list) return;
+	change_list.push_back(cluster);
+	cluster->listed_in_change_list = true;
+}
+
 void TopologyTopTree::Internal::update_clusters_join_with_neighbour(std::shared_ptr<TopologyCluster> cluster, std::shared_ptr<TopologyCluster> neighbour) {
 	#ifdef DEBUG
 		std::cerr << "... joining " << *cluster << " with neighbour " << *neighbour << std::endl;
@@ -215,7 +363,7 @@ void TopologyTopTree::Internal::update_clusters_join_with_neighbour(std::shared_
 	neighbour->listed_in_abandon_list = false;
 	if (cluster->parent == NULL && neighbour->parent == NULL) {
 		// Add new cluster to above level
-		auto parent = std::make_shared<TopologyCluster>();
+		auto parent = std::make_shared<TopologyCluster>(functions);
 		splitted_clusters.push_back(parent);
 		parent->set_first_child(cluster);
 		parent->set_second_child(neighbour);
@@ -264,7 +412,7 @@ void TopologyTopTree::Internal::update_clusters_only_child(std::shared_ptr<Topol
 	// This cluster is the only one child of its parent, ensure that parent exists
 	if (cluster->parent == NULL) {
 		// Have to create new parent
-		auto parent = std::make_shared<TopologyCluster>();
+		auto parent = std::make_shared<TopologyCluster>(functions);
 		splitted_clusters.push_back(parent);
 		parent->set_first_child(cluster);
 		parent->vertex = cluster->vertex;
@@ -286,201 +434,202 @@ void TopologyTopTree::Internal::update_clusters_only_child(std::shared_ptr<Topol
 }
 
 void TopologyTopTree::Internal::update_clusters() {
-	// When all lists empty -> end procedure
-	if (delete_list.size() == 0 && abandon_list.size() == 0 && change_list.size() == 0) {
+	// Repair level by level until all lists are empty
+	while (delete_list.size() > 0 || abandon_list.size() > 0 || change_list.size() > 0) {
+		TOP_TREE_COUNT(statistics.update_levels, 1);
+		TOP_TREE_COUNT(statistics.deleted_clusters, delete_list.size());
+		TOP_TREE_COUNT(statistics.changed_clusters, change_list.size());
+		TOP_TREE_COUNT(statistics.abandoned_clusters, abandon_list.size());
 		#ifdef DEBUG
-			std::cerr << "Ending with update clusters" << std::endl;
-		#endif
-		return;
-	}
-
-	#ifdef DEBUG
-		std::cerr << std::endl << "Delete list(" << delete_list.size() << "): ";
-		for (auto cluster: delete_list) std::cerr << *cluster << ", ";
-		std::cerr << std::endl;
+			std::cerr << std::endl << "Delete list(" << delete_list.size() << "): ";
+			for (auto cluster: delete_list) std::cerr << *cluster << ", ";
+			std::cerr << std::endl;
 
-		std::cerr << "Change list(" << change_list.size() << "): ";
-		for (auto cluster: change_list) std::cerr << *cluster << ", ";
-		std::cerr << std::endl;
-
-		std::cerr << "Abandon list(" << abandon_list.size() << "): ";
-		for (auto cluster: abandon_list) std::cerr << *cluster << ", ";
-		std::cerr << std::endl;
-	#endif
+			std::cerr << "Change list(" << change_list.size() << "): ";
+			for (auto cluster: change_list) std::cerr << *cluster << ", ";
+			std::cerr << std::endl;
 
-	to_calculate_outer_edges.clear();
+			std::cerr << "Abandon list(" << abandon_list.size() << "): ";
+			for (auto cluster: abandon_list) std::cerr << *cluster << ", ";
+			std::cerr << std::endl;
+		#endif
 
-	next_delete.clear();
-	next_change.clear();
-	next_abandon.clear();
+		to_calculate_outer_edges.clear();
 
-	// 1. Run through deleted vertices
-	for (auto cluster: delete_list) {
-		#ifdef DEBUG
-			std::cerr << "Deleting cluster " << *cluster << std::endl;
-		#endif
-		cluster->do_split(&splitted_clusters);
-		if (cluster->parent != NULL) {
-			if (cluster->parent->second == NULL) {
-				#ifdef DEBUG
-					std::cerr << "... no second child -> delete parent" << std::endl;
-				#endif
-				// No second child:
-				next_delete.push_back(cluster->parent);
-				cluster->parent->listed_in_delete_list = true;
-				// Remove child link
-				cluster->parent->first = NULL;
-			} else {
-				// There is another child
-				if (cluster == cluster->parent->first) cluster->parent->first = cluster->parent->second;
-				cluster->parent->second = NULL;
-				cluster->parent->first->do_split(&splitted_clusters); // split it because we need to recompute it after all operations
+		// 1. Run through deleted vertices
+		for (auto cluster: delete_list) {
+			#ifdef DEBUG
+				std::cerr << "Deleting cluster " << *cluster << std::endl;
+			#endif
+			cluster->do_split(&splitted_clusters);
+			if (cluster->parent != NULL) {
+				if (cluster->parent->second == NULL) {
+					#ifdef DEBUG
+						std::cerr << "... no second child -> delete parent" << std::endl;
+					#endif
+					// No second child:
+					next_delete.push_back(cluster->parent);
+					cluster->parent->listed_in_delete_list = true;
+					// Remove child link
+					cluster->parent->first = NULL;
+				} else {
+					// There is another child
+					if (cluster == cluster->parent->first) cluster->parent->first = cluster->parent->second;
+					cluster->parent->second = NULL;
+					cluster->parent->outer_edges_changed = true;
+					cluster->parent->first->do_split(&splitted_clusters); // split it because we need to recompute it after all operations
 
-				#ifdef DEBUG
-					std::cerr << "... another child exists: " << *cluster->parent->first << std::endl;
-				#endif
+					#ifdef DEBUG
+						std::cerr << "... another child exists: " << *cluster->parent->first << std::endl;
+					#endif
 
-				// Remove edge in the parent cluster
-				cluster->parent->edge = NULL;
+					// Remove edge in the parent cluster
+					cluster->parent->edge = NULL;
 
-				// Test another child (which is now the first child of parent)
-				if (!cluster->parent->first->listed_in_change_list && !cluster->parent->first->listed_in_delete_list) {
-					change_list.push_back(cluster->parent->first);
-					cluster->parent->first->listed_in_change_list = true;
+					// Test another child (which is now the first child of parent)
+					if (!cluster->parent->first->listed_in_change_list && !cluster->parent->first->listed_in_delete_list) {
+						change_list.push_back(cluster->parent->first);
+						cluster->parent->first->listed_in_change_list = true;
+					}
 				}
 			}
+			// Remove cluster from list and delete it
+			cluster->parent = NULL;
+			cluster->is_deleted = true; // there may be link from splitted_vertices list, we do not want do join this cluster again
+			// Remove only inner clusters (basic at vertex level should remain)
+			if (cluster->vertex == NULL || cluster->vertex->topology_cluster != cluster) {
+				// if (cluster->vertex != NULL) cluster->vertex->topology_cluster = NULL;
+				cluster->remove_all_outer_edges();
+			}
+			cluster->listed_in_delete_list = false;
+			cluster->unlink();
 		}
-		// Remove cluster from list and delete it
-		cluster->parent = NULL;
-		cluster->is_deleted = true; // there may be link from splitted_vertices list, we do not want do join this cluster again
-		// Remove only inner clusters (basic at vertex level should remain)
-		if (cluster->vertex == NULL || cluster->vertex->topology_cluster != cluster) {
-			// if (cluster->vertex != NULL) cluster->vertex->topology_cluster = NULL;
-			cluster->remove_all_outer_edges();
-		}
-		cluster->listed_in_delete_list = false;
-		cluster->unlink();
-	}
-
-	// 2. Run through changed list that have sibling
-	for (auto cluster: change_list) {
-		// Skip clusters removed from list and clusters with no parent or without sibling (parent have only one child)
-		if (!cluster->listed_in_change_list || cluster->parent == NULL || cluster->parent->second == NULL) continue;
 
-		cluster->do_split(&splitted_clusters);
-		auto sibling = (cluster->parent->first == cluster ? cluster->parent->second : cluster->parent->first);
-		sibling->do_split(&splitted_clusters);
+		// 2. Run through changed list that have sibling
+		for (auto cluster: change_list) {
+			// Skip clusters removed from list and clusters with no parent or without sibling (parent have only one child)
+			if (!cluster->listed_in_change_list || cluster->parent == NULL || cluster->parent->second == NULL) continue;
 
-		#ifdef DEBUG
-			std::cerr << "Checking cluster " << *cluster << std::endl;
-		#endif
+			cluster->do_split(&splitted_clusters);
+			auto sibling = (cluster->parent->first == cluster ? cluster->parent->second : cluster->parent->first);
+			sibling->do_split(&splitted_clusters);
 
-		// If connected with sibling by edge and parent is valid cluster
-		// Get common edge:
-		std::shared_ptr<BaseTree::Internal::Edge> common_edge = NULL;
-		for (auto o: cluster->outer_edges) if (o.cluster == sibling) common_edge = o.edge;
-		// Test parent
-		if (common_edge != NULL && (cluster->outer_edges.size() + sibling->outer_edges.size()) <= 4) {
-			#ifdef DEBUG
-				std::cerr << "... connected with sibling " << *sibling << " by edge " << *common_edge->data << std::endl;
-			#endif
-			// Everything OK, remove cluster and sibling from change list and add parent into next change list
-			cluster->listed_in_change_list = false;
-			sibling->listed_in_change_list = false;
-			next_change.push_back(cluster->parent);
-			cluster->parent->listed_in_change_list = true;
-			to_calculate_outer_edges.push_back(cluster->parent);
-		} else {
 			#ifdef DEBUG
-				if (common_edge == NULL) std::cerr << "... not connected with sibling " << *sibling << " by edge, parent " << *cluster->parent << " will be deleted" << std::endl;
-				else std::cerr << "... with sibling " << *sibling << " it is no longer valid cluster, parent (too many outer edges) " << *cluster->parent << " will be deleted" << std::endl;
+				std::cerr << "Checking cluster " << *cluster << std::endl;
 			#endif
-			// Parent goes into next delete list
-			cluster->parent->first = NULL;
-			cluster->parent->second = NULL;
-			next_delete.push_back(cluster->parent);
-			cluster->parent->listed_in_delete_list = true;
 
-			// This cluster and sibling are now abandon (move to abandon list)
-			cluster->parent = NULL;
-			cluster->listed_in_change_list = false;
-			abandon_list.push_back(cluster);
-			cluster->listed_in_abandon_list = true;
+			// If connected with sibling by edge and parent is valid cluster
+			// Get common edge:
+			Ref<BaseTree::Internal::Edge> common_edge = NULL;
+			for (const auto &o: cluster->outer_edges) if (o.cluster == sibling.get()) common_edge = o.edge;
+			// Test parent
+			if (common_edge != NULL && (cluster->outer_edges.size() + sibling->outer_edges.size()) <= 4) {
+				#ifdef DEBUG
+					std::cerr << "... connected with sibling " << *sibling << " by edge " << *common_edge->data << std::endl;
+				#endif
+				// Everything OK, remove cluster and sibling from change list and add parent into next change list
+				cluster->listed_in_change_list = false;
+				sibling->listed_in_change_list = false;
+				next_change.push_back(cluster->parent);
+				cluster->parent->listed_in_change_list = true;
+				to_calculate_outer_edges.push_back(cluster->parent);
+			} else {
+				#ifdef DEBUG
+					if (common_edge == NULL) std::cerr << "... not connected with sibling " << *sibling << " by edge, parent " << *cluster->parent << " will be deleted" << std::endl;
+					else std::cerr << "... with sibling " << *sibling << " it is no longer valid cluster, parent (too many outer edges) " << *cluster->parent << " will be deleted" << std::endl;
+				#endif
+				// Parent goes into next delete list
+				cluster->parent->first = NULL;
+				cluster->parent->second = NULL;
+				next_delete.push_back(cluster->parent);
+				cluster->parent->listed_in_delete_list = true;
 
-			sibling->parent = NULL;
-			sibling->listed_in_change_list = false;
-			abandon_list.push_back(sibling);
-			sibling->listed_in_abandon_list = true;
+				// This cluster and sibling are now abandon (move to abandon list)
+				cluster->parent = NULL;
+				cluster->listed_in_change_list = false;
+				abandon_list.push_back(cluster);
+				cluster->listed_in_abandon_list = true;
+
+				sibling->parent = NULL;
+				sibling->listed_in_change_list = false;
+				abandon_list.push_back(sibling);
+				sibling->listed_in_abandon_list = true;
+			}
 		}
-	}
 
-	// 3. Run through rest of changed list and whole abandon list
-	for (auto cluster: change_list) {
-		if (cluster->listed_in_change_list && !cluster->listed_in_abandon_list) {
-			abandon_list.push_back(cluster);
-			cluster->listed_in_abandon_list = true;
+		// 3. Run through rest of changed list and whole abandon list
+		for (auto cluster: change_list) {
+			if (cluster->listed_in_change_list && !cluster->listed_in_abandon_list) {
+				abandon_list.push_back(cluster);
+				cluster->listed_in_abandon_list = true;
+			}
+			cluster->listed_in_change_list = false;
 		}
-		cluster->listed_in_change_list = false;
-	}
-	for (auto cluster: abandon_list) {
-		cluster->do_split(&splitted_clusters);
-		if (!cluster->listed_in_abandon_list) continue;
+		for (auto cluster: abandon_list) {
+			cluster->do_split(&splitted_clusters);
+			if (!cluster->listed_in_abandon_list) continue;
 
-		#ifdef DEBUG
-			std::cerr << "Checking abandon cluster  " << *cluster << " with outer edges size " << cluster->outer_edges.size() << std::endl;
-			// for (auto x: cluster->outer_edges) std::cerr << "..." << *x.edge->data << "---" << *x.cluster << std::endl;
-		#endif
+			#ifdef DEBUG
+				std::cerr << "Checking abandon cluster  " << *cluster << " with outer edges size " << cluster->outer_edges.size() << std::endl;
+				// for (auto x: cluster->outer_edges) std::cerr << "..." << *x.edge->data << "---" << *x.cluster << std::endl;
+			#endif
 
-		if (cluster->outer_edges.size() == 3) {
-			// Find if there is neighbour with degree 1
-			std::shared_ptr<TopologyCluster> neighbour = NULL;
-			for (auto o: cluster->outer_edges) if (o.cluster->outer_edges.size() == 1) neighbour = o.cluster;
-
-			if (neighbour != NULL) update_clusters_join_with_neighbour(cluster, neighbour); // Join with neighbour
-			else update_clusters_only_child(cluster);
-		} else if (cluster->outer_edges.size() >= 1) {
-			// Find if there is neighbour with degree <= (4 - #outer_edges)
-			std::shared_ptr<TopologyCluster> neighbour = NULL;
-			for (auto o: cluster->outer_edges) {
-				// Test if neighbour have low degree and if it have no sibling - if yes choose it
-				if (o.cluster->outer_edges.size() <= (4 - cluster->outer_edges.size()) && (o.cluster->parent == NULL || o.cluster->parent->second == NULL)) neighbour = o.cluster;
-			}
+			if (cluster->outer_edges.size() == 3) {
+				// Find if there is neighbour with degree 1
+				std::shared_ptr<TopologyCluster> neighbour = NULL;
+				for (const auto &o: cluster->outer_edges) if (o.cluster->outer_edges.size() == 1) neighbour = o.cluster->shared_from_this();
+
+				if (neighbour != NULL) update_clusters_join_with_neighbour(cluster, neighbour); // Join with neighbour
+				else update_clusters_only_child(cluster);
+			} else if (cluster->outer_edges.size() >= 1) {
+				// Find if there is neighbour with degree <= (4 - #outer_edges)
+				std::shared_ptr<TopologyCluster> neighbour = NULL;
+				for (const auto &o: cluster->outer_edges) {
+					// Test if neighbour have low degree and if it have no sibling - if yes choose it
+					if (o.cluster->outer_edges.size() <= (4 - cluster->outer_edges.size()) && (o.cluster->parent == NULL || o.cluster->parent->second == NULL)) neighbour = o.cluster->shared_from_this();
+				}
 
-			if (neighbour != NULL) update_clusters_join_with_neighbour(cluster, neighbour); // Join with neighbour as in the first case
-			else update_clusters_only_child(cluster);
-		} else {
-			//0 outer edges -> it is root and nothing is needed
-			if (cluster->parent != NULL && cluster->parent->second == NULL && !cluster->parent->listed_in_delete_list) {
-				// only this one child of parent
-				next_delete.push_back(cluster->parent);
-				cluster->parent->listed_in_delete_list = true;
+				if (neighbour != NULL) update_clusters_join_with_neighbour(cluster, neighbour); // Join with neighbour as in the first case
+				else update_clusters_only_child(cluster);
+			} else {
+				//0 outer edges -> it is root and nothing is needed
+				if (cluster->parent != NULL && cluster->parent->second == NULL && !cluster->parent->listed_in_delete_list) {
+					// only this one child of parent
+					next_delete.push_back(cluster->parent);
+					cluster->parent->listed_in_delete_list = true;
+				}
+				cluster->parent = NULL;
+				found_roots.push_back(cluster);
+				#ifdef DEBUG
+					std::cerr << "Found root " << *cluster << std::endl;
+				#endif
 			}
-			cluster->parent = NULL;
-			found_roots.push_back(cluster);
+			cluster->listed_in_abandon_list = false;
+		}
+
+		// 4. Calculate outer edges for parent layer
+		for (auto c: to_calculate_outer_edges) {
+			#ifdef DEBUG
+				std::cerr << "Computing outer edges for " << *c << std::endl;
+			#endif
+			c->calculate_outer_edges(true); // with checking neighbours (neighbours may not be on this list and we need to add new edges into them)
 			#ifdef DEBUG
-				std::cerr << "Found root " << *cluster << std::endl;
+				std::cerr << "Outer edges for " << *c << " computed" << std::endl;
 			#endif
 		}
-		cluster->listed_in_abandon_list = false;
-	}
 
-	// 4. Calculate outer edges for parent layer
-	for (auto c: to_calculate_outer_edges) {
-		#ifdef DEBUG
-			std::cerr << "Computing outer edges for " << *c << std::endl;
-		#endif
-		c->calculate_outer_edges(true); // with checking neighbours (neighbours may not be on this list and we need to add new edges into them)
-		#ifdef DEBUG
-			std::cerr << "Outer edges for " << *c << " computed" << std::endl;
-		#endif
+		// Continue with above level (lists are swapped, so their capacity is kept for the next levels and calls)
+		std::swap(delete_list, next_delete);
+		std::swap(change_list, next_change);
+		std::swap(abandon_list, next_abandon);
+		next_delete.clear();
+		next_change.clear();
+		next_abandon.clear();
 	}
 
-	// Continue with above level
-	delete_list = next_delete;
-	change_list = next_change;
-	abandon_list = next_abandon;
-
-	update_clusters();
+	#ifdef DEBUG
+		std::cerr << "Ending with update clusters" << std::endl;
+	#endif
 }
 
 
@@ -500,15 +649,7 @@ std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr
 	#endif
 
 	// 1. Find edge
-	std::shared_ptr<BaseTree::Internal::Edge> edge = NULL;
-	for (auto n: v->neighbours) {
-		auto ee = n.edge.lock();
-		if ((BaseTree::Internal::Vertex::get_superior(ee->from) == v && BaseTree::Internal::Vertex::get_superior(ee->to) == w)
-		|| (BaseTree::Internal::Vertex::get_superior(ee->from) == w && BaseTree::Internal::Vertex::get_superior(ee->to) == v)) {
-			edge = n.edge.lock();
-			break;
-		}
-	}
+	auto edge = internal->find_edge(v, w);
 	if (edge == NULL) {
 		std::cerr << "ERROR: Vertices not linked by edge, cannot cut" << std::endl;
 		return std::make_tuple((std::shared_ptr<ICluster>)NULL, (std::shared_ptr<ICluster>)NULL, (std::shared_ptr<EdgeData>)NULL);
@@ -525,7 +666,7 @@ std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr
 	// 2.1 Remove original root from root list
 	auto root = vv->topology_cluster;
 	while (root->parent != NULL) root = root->parent;
-	internal->root_clusters.erase(root->root_clusters_iterator);
+	internal->remove_root(root);
 
 	// 3. Cut itself (save results)
 	auto result = internal->cut(vv, ww, edge);
@@ -543,10 +684,8 @@ std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr
 	while (root_w->parent != NULL) root_w = root_w->parent;
 
 	// 5.1 Add roots into root clusters list
-	internal->root_clusters.push_back(root_v);
-	root_v->root_clusters_iterator = std::prev(internal->root_clusters.end());
-	internal->root_clusters.push_back(root_w);
-	root_w->root_clusters_iterator = std::prev(internal->root_clusters.end());
+	internal->add_root(root_v);
+	internal->add_root(root_w);
 
 	// 6. Restore all splitted clusters
 	for (auto c: internal->splitted_clusters) c->do_join();
@@ -565,11 +704,21 @@ std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr
 	return std::make_tuple(root_v, root_w, edge->data);
 }
 
-std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> TopologyTopTree::Internal::cut(
-	std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w, std::shared_ptr<BaseTree::Internal::Edge> edge
-) {
-	// This function is not aware of splitted vertices (not needs it)
+Ref<BaseTree::Internal::Edge> TopologyTopTree::Internal::find_edge(BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *w) {
+	// Edges of subvertices are registered also at their superior vertex (the one with lower degree is searched, so
+	// cuts of leaves at hubs do not go through all their edges)
+	if (w->degree < v->degree) std::swap(v, w);
+	for (const auto &n: v->neighbours) {
+		auto &ee = n.edge;
+		if ((BaseTree::Internal::Vertex::get_superior(ee->from) == v && BaseTree::Internal::Vertex::get_superior(ee->to) == w)
+		|| (BaseTree::Internal::Vertex::get_superior(ee->from) == w && BaseTree::Internal::Vertex::get_superior(ee->to) == v)) {
+			return ee;
+		}
+	}
+	return NULL;
+}
 
+void TopologyTopTree::Internal::remove_edge(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge) {
 	// 0. Firstly test edge
 	if (edge->from == w && edge->to == v) std::swap(v, w);
 	if (edge->from != v || edge->to != w) {
@@ -589,18 +738,18 @@ std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> T
 	cluster_w->do_split(&splitted_clusters);
 
 	// 2. Remove edge from neighbours list
-	edge->from->neighbours.erase(edge->from_iter);
-	edge->to->neighbours.erase(edge->to_iter);
+	edge->from->remove_neighbour(edge->from_slot);
+	edge->to->remove_neighbour(edge->to_slot);
 	// 2.1 Update degrees
 	v->degree--;
 	w->degree--;
 	// Superior vertex
 	if (edge->from->superior_vertex != NULL && !edge->subvertice_edge) {
-		edge->from->superior_vertex->neighbours.erase(edge->superior_from_iter);
+		edge->from->superior_vertex->remove_neighbour(edge->superior_from_slot);
 		edge->from->superior_vertex->degree--;
 	}
 	if (edge->to->superior_vertex != NULL && !edge->subvertice_edge) {
-		edge->to->superior_vertex->neighbours.erase(edge->superior_to_iter);
+		edge->to->superior_vertex->remove_neighbour(edge->superior_to_slot);
 		edge->to->superior_vertex->degree--;
 	}
 
@@ -608,20 +757,27 @@ std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> T
 	cluster_v->calculate_outer_edges();
 	cluster_w->calculate_outer_edges();
 
-	// 3. Add both clusters into changed list (and empty other lists)
+	// 3. Add both clusters into changed list
+	update_clusters_mark_changed(cluster_v);
+	update_clusters_mark_changed(cluster_w);
+}
+
+std::tuple<std::shared_ptr<TopologyCluster>, std::shared_ptr<TopologyCluster>> TopologyTopTree::Internal::cut(
+	Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge
+) {
+	// This function is not aware of splitted vertices (not needs it)
+
+	// 1. Empty lists and remove edge (both clusters are added into the changed list)
 	delete_list.clear();
 	abandon_list.clear();
 	change_list.clear();
-	change_list.push_back(cluster_v);
-	cluster_v->listed_in_change_list = true;
-	change_list.push_back(cluster_w);
-	cluster_w->listed_in_change_list = true;
+	remove_edge(v, w, edge);
 
-	// 4. Run update procedure
+	// 2. Run update procedure
 	found_roots.clear();
 	update_clusters();
 
-	// 5. Get results
+	// 3. Get results
 	if (found_roots.size() != 2) {
 		std::cerr << "ERROR: Expecting 2 roots after cut operation, found " << found_roots.size() << " roots!" << std::endl;
 		exit(1);
@@ -650,27 +806,21 @@ std::shared_ptr<ICluster> TopologyTopTree::Link(int v_index, int w_index, std::s
 		return NULL;
 	}
 
-	// 2. Split vertices into subvertices if needed
+	// 2. Remove roots from clusters list (before splitting into subvertices, which may replace the roots)
+	internal->remove_root(internal->get_root(v));
+	internal->remove_root(internal->get_root(w));
+
+	// 2.1 Split vertices into subvertices if needed
 	auto vv = internal->get_vertex_to_link(v);
 	auto ww = internal->get_vertex_to_link(w);
 
-	// 2.1 Remove roots from clusters list
-	//auto root_v = vv->topology_cluster;
-	//while (root_v->parent != NULL) root_v = root_v->parent;
-	//std::cerr << "Deleting cluster " << *root_v << " from roots list with iterator " << *root_v->root_clusters_iterator << std::endl;
-	//if (root_v->root_clusters_iterator != internal->root_clusters.end()) internal->root_clusters.erase(root_v->root_clusters_iterator);
-	//auto root_w = ww->topology_cluster;
-	//while (root_w->parent != NULL) root_w = root_w->parent;
-	//if (root_w->root_clusters_iterator != internal->root_clusters.end()) internal->root_clusters.erase(root_w->root_clusters_iterator);
-
 	// 3. Create edge
-	auto edge = std::make_shared<BaseTree::Internal::Edge>(vv, ww, edge_data);
+	auto edge = internal->base_tree->internal->new_edge(vv, ww, edge_data);
 
 	// 4. Link vertices
 	auto result = internal->link(vv, ww, edge);
 	// 4.1 Add new root
-	internal->root_clusters.push_back(result);
-	result->root_clusters_iterator = std::prev(internal->root_clusters.end());
+	internal->add_root(result);
 
 	// 5. Restore all splitted clusters
 	for (auto c: internal->splitted_clusters) c->do_join();
@@ -685,75 +835,149 @@ std::shared_ptr<ICluster> TopologyTopTree::Link(int v_index, int w_index, std::s
 	return result;
 }
 
-std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_vertex_to_link(std::shared_ptr<BaseTree::Internal::Vertex> v) {
+int TopologyTopTree::ApplyBatch(const std::vector<LinkRequest> &links, const std::vector<std::pair<int, int>> &cuts) {
+	// Restore previous expose (if needed)
+	Restore();
+
+	// 1. Check that all cuts are valid before changing anything (every edge exists and is cut only once)
+	std::vector<Ref<BaseTree::Internal::Edge>> cut_edges;
+	std::unordered_set<BaseTree::Internal::Edge*> cut_edges_set;
+	for (auto c: cuts) {
+		auto edge = internal->find_edge(internal->base_tree->internal->vertices[c.first], internal->base_tree->internal->vertices[c.second]);
+		if (edge == NULL || !cut_edges_set.insert(edge.get()).second) return -1;
+		cut_edges.push_back(edge);
+	}
+
+	int done = 0;
+
+	// 2. Cuts
+	for (uint i = 0; i < cuts.size(); i++) {
+		auto &edge = cut_edges[i];
+		if (edge->from->superior_vertex != NULL || edge->to->superior_vertex != NULL) {
+			// Subvertices must be repaired after the cut, which needs valid clusters above them
+			internal->flush_batch();
+			Cut(cuts[i].first, cuts[i].second);
+		} else internal->batch_cut(edge->from, edge->to, edge);
+		done++;
+	}
+
+	// 3. Links (testing if vertices are in different trees needs clusters without pending cuts)
+	internal->flush_batch();
+	for (auto l: links) {
+		auto v = internal->base_tree->internal->vertices[l.v];
+		auto w = internal->base_tree->internal->vertices[l.w];
+
+		if (v->first_subvertex != NULL || w->first_subvertex != NULL || v->degree >= 3 || w->degree >= 3) {
+			// Vertex must be splitted into subvertices first, which needs valid clusters above it
+			internal->flush_batch();
+			if (Link(l.v, l.w, l.edge_data) != NULL) done++;
+		} else if (internal->batch_link(v, w, l.edge_data)) done++;
+	}
+	internal->flush_batch();
+
+	#ifdef DEBUG_GRAPHVIZ
+		for (auto root_cluster: internal->root_clusters) internal->print_graphviz(root_cluster, "After batch", true);
+	#endif
+
+	return done;
+}
+
+void TopologyTopTree::Internal::batch_cut(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge) {
+	// 1. Original root will be replaced by the roots found after flush
+	remove_root(get_root(v));
+
+	// 2. Remove edge on the vertex level only
+	remove_edge(v, w, edge);
+	batch_vertices.push_back(v);
+	batch_vertices.push_back(w);
+}
+
+TopologyCluster *TopologyTopTree::Internal::batch_find_component(TopologyCluster *root) {
+	auto it = batch_components.find(root);
+	if (it == batch_components.end() || it->second == root) return root;
+	return (it->second = batch_find_component(it->second));
+}
+
+bool TopologyTopTree::Internal::batch_link(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, std::shared_ptr<EdgeData> edge_data) {
+	// 1. Get roots (clusters above vertices are not changed until flush, so roots identify original trees)
+	auto root_v = get_vertex_cluster(v);
+	while (root_v->parent != NULL) root_v = root_v->parent;
+	auto root_w = get_vertex_cluster(w);
+	while (root_w->parent != NULL) root_w = root_w->parent;
+
+	// 2. Test if they aren't in the same tree even after previous links of this batch
+	auto component_v = batch_find_component(root_v.get());
+	auto component_w = batch_find_component(root_w.get());
+	if (component_v == component_w) {
+		#ifdef WARNINGS
+			std::cerr << "WARNING: Vertices " << *v << " and " << *w << " are already in the same tree, cannot link" << std::endl;
+		#endif
+		return false;
+	}
+	batch_components[component_v] = component_w;
+
+	// 3. Original roots will be replaced by the roots found after flush
+	remove_root(root_v);
+	remove_root(root_w);
+
+	// 4. Add edge on the vertex level only
+	auto edge = base_tree->internal->new_edge(v, w, edge_data);
+	add_edge(v, w, edge);
+	batch_vertices.push_back(v);
+	return true;
+}
+
+void TopologyTopTree::Internal::flush_batch() {
+	if (batch_vertices.empty()) return;
+
+	// 1. Repair clusters above all changed vertices at once
+	found_roots.clear();
+	update_clusters();
+
+	// 2. Add roots of all changed trees
+	for (auto v: batch_vertices) add_root(get_root(v));
+	batch_vertices.clear();
+	batch_components.clear();
+
+	// 3. Restore all splitted clusters
+	for (auto c: splitted_clusters) c->do_join();
+	splitted_clusters.clear();
+}
+
+Ref<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_vertex_to_link(Ref<BaseTree::Internal::Vertex> v) {
 	#ifdef DEBUG
 		std::cerr << "Getting vertex for link for vertex " << *v << std::endl;
 	#endif
 
-	if (!v->subvertices.empty()) {
+	if (v->first_subvertex != NULL) {
 		#ifdef DEBUG
 			std::cerr << "Will add subvertex to other subvertices of " << *v << std::endl;
 		#endif
 
-		if (v->subvertices.size() < 2) {
-			std::cerr << "ERROR: Expecting at least 2 subvertices for vertex " << *v << " but have " << v->subvertices.size() << " subvertices" << std::endl;
-			exit(1);
-		}
+		// Only the first subvertex may have a free slot (see repair_subvertex_after_cut)
+		auto first = v->first_subvertex;
+		if (first->degree < 3) return first;
 
-		// Have to add new subvertex, we add it as second subvertex in the chain
+		// Otherwise we have to add new subvertex, it is added before the first one in the chain (so it becomes the new
+		// first subvertex and only a constant number of cuts and links is needed)
 		// 1. Prepare new subvertex
-		auto subvertex = std::make_shared<BaseTree::Internal::Vertex>(std::make_shared<VertexData>());
-		subvertex->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
-		subvertex->superior_vertex = v;
-		subvertex->topology_cluster = std::make_shared<TopologyCluster>();
-		splitted_clusters.push_back(subvertex->topology_cluster);
-		subvertex->topology_cluster->vertex = subvertex;
+		auto subvertex = new_subvertex(v, true);
 
-		// 2. Cut between first and second subvertex
-		auto first = v->subvertices.begin();
-		auto second = std::next(first);
-		std::shared_ptr<BaseTree::Internal::Edge> edge;
-		//std::cerr << "First subvertex is " << *(*first)->topology_cluster << " and second " << *(*second)->topology_cluster << std::endl;
-		//std::cerr << "Searching for subvertice edge between " << **first << " and " << **second << std::endl;
-		for (auto n: (*first)->neighbours) {
-			auto ee = n.edge.lock();
-			//std::cerr << "...edge: " << *ee->from << "-" << *ee->to << std::endl;
-			if ((ee->from == *first && ee->to == *second) || (ee->from == *second && ee->to == *first)) {
-				edge = ee;
-				break;
-			}
-		}
-		//std::cerr << "Edge: " << edge << std::endl;
-		auto cut_result = cut(*first, *second, edge);
-		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			std::ostringstream ss;
-			ss << "Getting vertex for link fox " << *v << " - added new subvertex " << *subvertex;
-			print_graphviz(std::get<0>(cut_result), ss.str() + " after cut 1/2", true);
-			print_graphviz(std::get<1>(cut_result), ss.str() + " after cut 2/2", true);
-		#endif
-
-		// 3. Link first-new-second
-		// 3.1 Insert new subvertex a
-		subvertex->superior_vertex_subvertices_iter = v->subvertices.insert(second, subvertex);
-		// 3.2 Link itself
-		edge->from = *first;
-		edge->to = subvertex;
-		auto link_result = link(*first, subvertex, edge); // reuse original edge
-		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			print_graphviz(link_result, ss.str() + " after first link", true);
-		#endif
-
-		auto edge2 = std::make_shared<BaseTree::Internal::Edge>(subvertex, *second, std::make_shared<EdgeData>());
-		edge2->subvertice_edge = true;
-		v->subvertice_edges.push_back(edge2);
-		edge2->subvertice_edges_iterator = std::prev(v->subvertice_edges.end());
-		link_result = link(subvertex, *second, edge2);
+		// 2. First subvertex has 3 edges, move one of them (not subvertice edge) to the new subvertex
+		move_subvertex_edge(first, subvertex, get_real_edge(first));
 
+		// 3. Connect new subvertex to the chain
+		auto edge = base_tree->internal->new_edge(subvertex, first);
+		edge->subvertice_edge = true;
+		auto link_result = link(subvertex, first, edge);
 		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			print_graphviz(link_result, ss.str() + " after second link", true);
+			std::ostringstream ss;
+			ss << "Getting vertex for link for " << *v << " - added new subvertex " << *subvertex;
+			print_graphviz(link_result, ss.str() + " after link", true);
 		#endif
 
-		return subvertex;
+		v->first_subvertex = subvertex;
+		return subvertex; // new subvertex has one free slot for the new edge
 	} else if (v->degree == 3) {
 		// Have to split vertex
 		#ifdef DEBUG
@@ -761,37 +985,20 @@ std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_verte
 		#endif
 
 		// 1. Prepare two subvertices
-		auto subvertexA = std::make_shared<BaseTree::Internal::Vertex>(std::make_shared<VertexData>());
-		subvertexA->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
-		auto subvertexB = std::make_shared<BaseTree::Internal::Vertex>(std::make_shared<VertexData>());
-		subvertexB->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
-		subvertexA->superior_vertex = v;
-		subvertexB->superior_vertex = v;
-		subvertexA->topology_cluster = std::make_shared<TopologyCluster>();
-		splitted_clusters.push_back(subvertexA->topology_cluster);
-		subvertexA->topology_cluster->vertex = subvertexA;
-		subvertexB->topology_cluster = std::make_shared<TopologyCluster>();
-		splitted_clusters.push_back(subvertexB->topology_cluster);
-		subvertexB->topology_cluster->vertex = subvertexB;
-
-		// 2. Add subvertices to superior vertex's list of subvertices
-		v->subvertices.push_back(subvertexA);
-		subvertexA->superior_vertex_subvertices_iter = std::prev(v->subvertices.end());
-		v->subvertices.push_back(subvertexB);
-		subvertexB->superior_vertex_subvertices_iter = std::prev(v->subvertices.end());
+		TOP_TREE_COUNT(statistics.split_vertices, 1);
+		auto subvertexA = new_subvertex(v, true);
+		auto subvertexB = new_subvertex(v, true);
 
 		// 2. Reconnect first two edges to subvertexA and third edge to subvertexB
-		auto n = v->neighbours.begin();
-		while (n != v->neighbours.end()) {
-			// (because cut operation deletes from this std::list we need to get next pointer before calling cut)
-			auto next_n = std::next(n);
-			if (auto ee = (*n).edge.lock()) {
-				std::shared_ptr<BaseTree::Internal::Vertex> vv;
+		// (cut moves the last edge into the freed slot and link appends edges of subvertices,
+		// so go from the end and visit only the original slots)
+		for (int i = v->neighbours.size() - 1; i >= 0; i--) {
+			if (auto ee = v->neighbours[i].edge) {
+				Ref<BaseTree::Internal::Vertex> vv;
 				if (ee->from == v) vv = ee->to;
 				else if (ee->to == v) vv = ee->from;
 				else {
 					//std::cerr << "Skipping subvertice edge " << *ee->from << "-" << *ee->to << std::endl;
-					n = next_n;
 					continue;
 				}
 				#ifdef DEBUG
@@ -799,11 +1006,7 @@ std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_verte
 				#endif
 
 				auto subvertex = subvertexA;
-				(*n).subvertice_iter = v->subvertices.begin();
-				if (subvertexA->degree == 2) {
-					subvertex = subvertexB;
-					(*n).subvertice_iter = std::next((*n).subvertice_iter);
-				}
+				if (subvertexA->degree == 2) subvertex = subvertexB;
 
 				if (ee->from == v) {
 					auto result = cut(v, ee->to, ee);
@@ -831,7 +1034,6 @@ std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_verte
 					#endif
 				}
 			}
-			n = next_n;
 		}
 
 		#ifdef DEBUG
@@ -839,29 +1041,27 @@ std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::get_verte
 		#endif
 
 		// 3. Connect subvertices one to the other
-		auto edge = std::make_shared<BaseTree::Internal::Edge>(subvertexA, subvertexB, std::make_shared<EdgeData>());
+		auto edge = base_tree->internal->new_edge(subvertexA, subvertexB);
 		edge->subvertice_edge = true;
-		v->subvertice_edges.push_back(edge);
-		edge->subvertice_edges_iterator = std::prev(v->subvertice_edges.end());
 		link(subvertexA, subvertexB, edge);
 
+		v->first_subvertex = subvertexB;
 		return subvertexB; // subvertexB has one free slot for the new edge
 	} else return v; // else we can use the vertex itself
 }
 
-std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::link(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> w, std::shared_ptr<BaseTree::Internal::Edge> edge) {
-	// This function is not aware of splitted vertices (not needs it)
-
+std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::get_vertex_cluster(BaseTree::Internal::Vertex *v) {
+	// Vertex without edges has no cluster yet
 	if (v->topology_cluster == NULL) {
-		v->topology_cluster = std::make_shared<TopologyCluster>();
+		v->topology_cluster = std::make_shared<TopologyCluster>(functions);
 		v->topology_cluster->vertex = v;
 	}
-	auto cluster_v = v->topology_cluster;
-	if (w->topology_cluster == NULL) {
-		w->topology_cluster = std::make_shared<TopologyCluster>();
-		w->topology_cluster->vertex = w;
-	}
-	auto cluster_w = w->topology_cluster;
+	return v->topology_cluster;
+}
+
+void TopologyTopTree::Internal::add_edge(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge) {
+	auto cluster_v = get_vertex_cluster(v);
+	auto cluster_w = get_vertex_cluster(w);
 
 	#ifdef DEBUG
 		std::cerr << "==========" << std::endl;
@@ -878,8 +1078,8 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::link(std::shared_ptr
 	cluster_w->do_split(&splitted_clusters);
 
 	// 1. Add new edge (expecting that outer Link function ensures not adding edge to vertices with degree 3)
-	cluster_v->outer_edges.push_back(TopologyCluster::neighbour{edge, cluster_w});
-	cluster_w->outer_edges.push_back(TopologyCluster::neighbour{edge, cluster_v});
+	cluster_v->outer_edges.push_back(TopologyCluster::neighbour{edge, cluster_w.get()});
+	cluster_w->outer_edges.push_back(TopologyCluster::neighbour{edge, cluster_v.get()});
 	// 1.1 Update edge
 	edge->from = v;
 	edge->to = w;
@@ -889,20 +1089,25 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::link(std::shared_ptr
 	cluster_v->calculate_outer_edges();
 	cluster_w->calculate_outer_edges();
 
-	// 2. Add both clusters into changed list (and empty other lists)
+	// 2. Add both clusters into changed list
+	update_clusters_mark_changed(cluster_v);
+	update_clusters_mark_changed(cluster_w);
+}
+
+std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::link(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Vertex> w, Ref<BaseTree::Internal::Edge> edge) {
+	// This function is not aware of splitted vertices (not needs it)
+
+	// 1. Empty lists and add edge (both clusters are added into the changed list)
 	delete_list.clear();
 	abandon_list.clear();
 	change_list.clear();
-	change_list.push_back(cluster_v);
-	cluster_v->listed_in_change_list = true;
-	change_list.push_back(cluster_w);
-	cluster_w->listed_in_change_list = true;
+	add_edge(v, w, edge);
 
-	// 3. Run update procedure
+	// 2. Run update procedure
 	found_roots.clear();
 	update_clusters();
 
-	// 4. Get results
+	// 3. Get results
 	if (found_roots.size() != 1) {
 		std::cerr << "ERROR: Expecting 1 root after link operation, found " << found_roots.size() << " roots!" << std::endl;
 		exit(1);
@@ -918,172 +1123,89 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::link(std::shared_ptr
 	// expecting that do_join will be called from outside Cut function
 }
 
-std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::repair_subvertex_after_cut(std::shared_ptr<BaseTree::Internal::Vertex> v) {
-	std::shared_ptr<BaseTree::Internal::Vertex> first_neighbour = NULL;
-	std::shared_ptr<BaseTree::Internal::Edge> first_neighbour_edge = NULL;
-	std::shared_ptr<BaseTree::Internal::Vertex> second_neighbour = NULL;
-	std::shared_ptr<BaseTree::Internal::Edge> second_neighbour_edge = NULL;
-
-	for (auto n: v->neighbours) {
-		if (n.edge.lock()->subvertice_edge) {
-			if (first_neighbour == NULL) {
-				//first_neighbour = n.vertex.lock();
-				first_neighbour_edge = n.edge.lock();
-				if (first_neighbour_edge->from == v) first_neighbour = first_neighbour_edge->to;
-				else first_neighbour = first_neighbour_edge->from;
-			} else {
-				//second_neighbour = n.vertex.lock();
-				second_neighbour_edge = n.edge.lock();
-				if (second_neighbour_edge->from == v) second_neighbour = second_neighbour_edge->to;
-				else second_neighbour = second_neighbour_edge->from;
-			}
-		}
-	}
-
+Ref<BaseTree::Internal::Vertex> TopologyTopTree::Internal::repair_subvertex_after_cut(Ref<BaseTree::Internal::Vertex> v) {
 	#ifdef DEBUG
 		std::cerr << "Repairing subvertex " << *v << " after cut" << std::endl;
 	#endif
 
-	if (second_neighbour == NULL) {
-		// This vertex is one of end subvertices
-		int subvertice_edges_counter = 0;
-		for (auto n: first_neighbour->neighbours) if (n.edge.lock()->subvertice_edge) subvertice_edges_counter++;
-		if (subvertice_edges_counter == 1) {
-			auto w = first_neighbour;
-			// There is second endpoint (with 2 valid edges) -> we join them back into superior vertex
-			// 1. Superior vertex may not have its TopologyCluster, create it
-			if (v->superior_vertex->topology_cluster == NULL) {
-				v->superior_vertex->topology_cluster = std::make_shared<TopologyCluster>();
-				splitted_clusters.push_back(v->superior_vertex->topology_cluster);
-				v->superior_vertex->topology_cluster->vertex = v->superior_vertex;
-				#ifdef DEBUG
-					std::cerr << "Created cluster for superior vertex " << *v->superior_vertex << " with " << v->superior_vertex->neighbours.size() << " neighbours" << std::endl;
-				#endif
-			}
+	auto superior_vertex = v->superior_vertex;
+	if (superior_vertex->degree <= 3) {
+		// Superior vertex has only 3 edges now -> we join all subvertices back into it
+		// 1. Superior vertex may not have its TopologyCluster, create it
+		if (superior_vertex->topology_cluster == NULL) {
+			superior_vertex->topology_cluster = std::make_shared<TopologyCluster>(functions);
+			splitted_clusters.push_back(superior_vertex->topology_cluster);
+			superior_vertex->topology_cluster->vertex = superior_vertex;
+			#ifdef DEBUG
+				std::cerr << "Created cluster for superior vertex " << *superior_vertex << " with " << superior_vertex->neighbours.size() << " neighbours" << std::endl;
+			#endif
+		}
 
-			// 2. Run through neighbours and cut them, saving into list
-			std::vector<std::pair<std::shared_ptr<BaseTree::Internal::Vertex>, std::shared_ptr<BaseTree::Internal::Edge>>> neighbours_list;
-			// 2.A - neighbours from the first endpoint
-			auto n = v->neighbours.begin();
-			while (n != v->neighbours.end()) {
-				// (because cut operation deletes from this std::list we need to get next pointer before calling cut)
-				auto next_n = std::next(n);
-				if (auto ee = (*n).edge.lock()) {
+		// 2. Run through the chain of subvertices and cut all their edges, saving the real ones into list
+		std::vector<Ref<BaseTree::Internal::Vertex>> subvertices;
+		BaseTree::Internal::Vertex *previous = NULL;
+		for (auto s = superior_vertex->first_subvertex.get(); s != NULL;) {
+			auto next = s->next_subvertex(previous);
+			subvertices.push_back(s);
+			previous = s;
+			s = next;
+		}
+		std::vector<std::pair<Ref<BaseTree::Internal::Vertex>, Ref<BaseTree::Internal::Edge>>> neighbours_list;
+		for (auto &s: subvertices) {
+			while (!s->neighbours.empty()) {
+				// (cut removes the edge from the neighbours)
+				if (auto ee = s->neighbours.back().edge) {
 					auto vv = ee->from;
-					if (vv == v) vv = ee->to;
+					if (vv == s) vv = ee->to;
 
 					if (!ee->subvertice_edge) neighbours_list.push_back(std::make_pair(vv, ee));
-					auto result = cut(v, vv, ee);
+					auto result = cut(s, vv, ee);
 					#ifdef DEBUG_GRAPHVIZ_VERBOSE
 						std::ostringstream ss;
-						ss << "Repair subvertex " << *v << " - joining into superior - after A cut ";
+						ss << "Repair subvertex " << *v << " - joining into superior - after cut ";
 						print_graphviz(std::get<0>(result), ss.str() + "1/2", true);
 						print_graphviz(std::get<1>(result), ss.str() + "2/2", true);
 					#endif
 				}
-				n = next_n;
 			}
-			// 2.B - neighbours from the second endpoint
-			n = w->neighbours.begin();
-			while (n != w->neighbours.end()) {
-				// (because cut operation deletes from this std::list we need to get next pointer before calling cut)
-				auto next_n = std::next(n);
-				if (auto ee = (*n).edge.lock()) {
-					auto vv = ee->from;
-					if (vv == w) vv = ee->to;
+		}
+		for (auto &s: subvertices) s->unlink();
+		superior_vertex->first_subvertex = NULL;
+		TOP_TREE_COUNT(statistics.removed_subvertices, subvertices.size());
+
+		// 3. Connect all to the superior vertex
+		std::shared_ptr<TopologyCluster> result;
+		for (auto n: neighbours_list) {
+			result = link(superior_vertex, n.first, n.second);
+			#ifdef DEBUG_GRAPHVIZ_VERBOSE
+				std::ostringstream ss;
+				ss << "Repair subvertex " << *v << " - joining into superior - after link";
+				print_graphviz(result, ss.str(), true);
+			#endif
+		}
 
-					if (!ee->subvertice_edge) neighbours_list.push_back(std::make_pair(vv, ee));
-					auto result = cut(w, vv, ee);
-					#ifdef DEBUG_GRAPHVIZ_VERBOSE
-						std::ostringstream ss;
-						ss << "Repair subvertex " << *v << " - joining into superior - after B cut ";
-						print_graphviz(std::get<0>(result), ss.str() + "1/2", true);
-						print_graphviz(std::get<1>(result), ss.str() + "2/2", true);
-					#endif
-				}
-				n = next_n;
-			}
-			v->superior_vertex->subvertices.clear();
-
-			// 3. Connect all to the superior vertex
-			std::shared_ptr<TopologyCluster> result;
-			for (auto n: neighbours_list) {
-				result = link(v->superior_vertex, n.first, n.second);
-				#ifdef DEBUG_GRAPHVIZ_VERBOSE
-					std::ostringstream ss;
-					ss << "Repair subvertex " << *v << " - joining into superior - after link";
-					print_graphviz(result, ss.str(), true);
-				#endif
-			}
+		return superior_vertex;
+	}
 
-			auto superior_vertex = v->superior_vertex;
-			v->unlink();
-			w->unlink();
+	// All subvertices except the first one have 3 edges (the first one has 2 or 3), so the free slot is moved from
+	// this subvertex to the first one (constant number of cuts and links)
+	auto first = superior_vertex->first_subvertex;
+	if (first != v) move_subvertex_edge(first, v, get_real_edge(first));
+	// First subvertex without edges out of the superior vertex is removed
+	if (first->degree == 1) remove_first_subvertex(superior_vertex);
 
-			return superior_vertex;
-		} else {
-			// We "steal" one edge from the neighbour and then we repair on this vertex
-			for (auto n: first_neighbour->neighbours) {
-				if (auto ee = n.edge.lock()) {
-					// Get opposite vertex
-					auto vv = ee->from;
-					if (vv == first_neighbour) vv = ee->to;
-					if (!ee->subvertice_edge) {
-
-						auto result = cut(first_neighbour, vv, ee);
-						#ifdef DEBUG_GRAPHVIZ_VERBOSE
-							std::ostringstream ss;
-							ss << "Repair subvertex " << *v << " - stealing from neighbour - after cut ";
-							print_graphviz(std::get<0>(result), ss.str() + "1/2", true);
-							print_graphviz(std::get<1>(result), ss.str() + "2/2", true);
-						#endif
-						auto result2 = link(v, vv, ee);
-						#ifdef DEBUG_GRAPHVIZ_VERBOSE
-							ss.clear();
-							ss << "Repair subvertex " << *v << " - stealing from neighbour - after link";
-							print_graphviz(result2, ss.str(), true);
-						#endif
-						break;
-					}
-				}
-			}
-			return repair_subvertex_after_cut(first_neighbour);
-		}
-	} else {
-		// It is vertex inside "chain" -> remove it and join neighbours
-		auto result = cut(first_neighbour, v, first_neighbour_edge);
-		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			std::ostringstream ss;
-			ss << "Repair subvertex " << *v << " - ";
-			print_graphviz(std::get<0>(result), ss.str() + "After first chain cut 1/2", true);
-			print_graphviz(std::get<1>(result), ss.str() + "After first chain cut 2/2", true);
-		#endif
-		v->superior_vertex->subvertice_edges.erase(first_neighbour_edge->subvertice_edges_iterator); // erase first subvertice edge
-		result = cut(second_neighbour, v, second_neighbour_edge);
-		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			print_graphviz(std::get<0>(result), ss.str() + "After second chain cut 1/2", true);
-			print_graphviz(std::get<1>(result), ss.str() + "After second chain cut 2/2", true);
-		#endif
-		auto result2 = link(first_neighbour, second_neighbour, second_neighbour_edge); // reuse second subvertice edge
-		#ifdef DEBUG_GRAPHVIZ_VERBOSE
-			print_graphviz(result2, ss.str() + "After chain link", true);
-		#endif
-		// Delete vertex from supervertice's subvertices list
-		v->superior_vertex->subvertices.erase(v->superior_vertex_subvertices_iter);
-		v->unlink();
-		return first_neighbour;
-	}
+	return superior_vertex->first_subvertex;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Expose
 
-std::list<std::shared_ptr<SimpleCluster>> TopologyTopTree::Internal::expose_get_clusters(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> second_v, bool continue_above_common) {
-	std::list<std::shared_ptr<SimpleCluster>> list;
-
+void TopologyTopTree::Internal::expose_get_clusters(std::vector<std::shared_ptr<SimpleCluster>> &list, BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *second_v, bool continue_above_common) {
 	auto last_cluster = v->topology_cluster;
 	auto cluster = last_cluster->parent; // we starts one level above base cluster
-	bool was_added = false;
+	// Edge and sibling of every cluster above the vertex are added, also of the lowest clusters which have the vertex as
+	// an external boundary vertex (and could be added whole): they are already splitted by the Expose, so changes of the
+	// data of their copy would not get into their edges and splitted children
 	while (cluster != NULL) {
 		#ifdef DEBUG
 			std::cerr << "Testing cluster " << *cluster << " - vertex " << *v << " external: " << cluster->is_external_boundary_vertex(v) << std::endl;
@@ -1094,113 +1216,106 @@ std::list<std::shared_ptr<SimpleCluster>> TopologyTopTree::Internal::expose_get_
 			if (last_cluster == cluster->first) sibling = cluster->second;
 			else if (last_cluster == cluster->second) sibling = cluster->first;
 
-			if (was_added || !cluster->is_external_boundary_vertex(v) || cluster->edge->from == second_v || cluster->edge->to == second_v || sibling->is_splitted) {
-				if (!was_added && last_cluster->is_top_cluster) {
-					#ifdef DEBUG
-						std::cerr << "    Adding first cluster " << *last_cluster << std::endl;
-					#endif
-
-					std::shared_ptr<ICluster> first = NULL;
-					std::shared_ptr<ICluster> second = NULL;
-					if (last_cluster->first != NULL && last_cluster->first->is_top_cluster) first = last_cluster->first;
-					if (last_cluster->second != NULL && last_cluster->second->is_top_cluster) {
-						if (first == NULL) first = last_cluster->second;
-						else second = last_cluster->second;
-					}
-
-					auto new_simple_cluster = SimpleCluster::construct(first, second);
-					new_simple_cluster->boundary_left = last_cluster->boundary_left;
-					new_simple_cluster->boundary_right = last_cluster->boundary_right;
-					//new_simple_cluster->data = last_cluster->data;
-					CopyClusterData(last_cluster, new_simple_cluster);
-					new_simple_cluster->edge = last_cluster->edge;
-					expose_simple_clusters.push_back(new_simple_cluster); // to allow splitting it in Restore operation
-					list.push_back(new_simple_cluster);
-				}
-				was_added = true;
-
-				// Test sibling
-				if (sibling->is_splitted) {
+			// Test sibling
+			if (sibling->is_splitted) {
+				#ifdef DEBUG
+					std::cerr << "Sibling is already splitted (second branch)" << std::endl;
+				#endif
+				// If we are in the same area as the other run stop the cycle
+				if (!continue_above_common) {
 					#ifdef DEBUG
-						std::cerr << "Sibling is already splitted (second branch)" << std::endl;
+						std::cerr << "Not continue above common, stopping" << std::endl;
 					#endif
-					// If we are in the same area as the other run stop the cycle
-					if (!continue_above_common) {
-						#ifdef DEBUG
-							std::cerr << "Not continue above common, stopping" << std::endl;
-						#endif
-						break;
-					}
-				}
-
-				std::shared_ptr<SimpleCluster> edge_cluster = NULL;
-				if (!cluster->edge->subvertice_edge) {
-					edge_cluster = std::make_shared<SimpleCluster>();
-					edge_cluster->boundary_left = cluster->edge->from;
-					edge_cluster->boundary_right = cluster->edge->to;
-					edge_cluster->edge = cluster->edge;
-					expose_simple_clusters.push_back(edge_cluster); // to allow splitting it in Restore operation
-					Create(edge_cluster, cluster->edge->data);
+					break;
 				}
+			}
 
-				std::shared_ptr<SimpleCluster> sibling_cluster = NULL;
-				if (sibling->is_top_cluster && !sibling->is_splitted) {
-					sibling_cluster = SimpleCluster::construct(sibling->first, sibling->second);
-					sibling_cluster->boundary_left = sibling->boundary_left;
-					sibling_cluster->boundary_right = sibling->boundary_right;
-					//sibling_cluster->data = sibling->data;
-					CopyClusterData(sibling, sibling_cluster);
-					sibling_cluster->edge = sibling->edge;
-				}
+			std::shared_ptr<SimpleCluster> edge_cluster = NULL;
+			if (!cluster->edge->subvertice_edge) {
+				edge_cluster = simple_pool->create();
+				edge_cluster->boundary_left = cluster->edge->from;
+				edge_cluster->boundary_right = cluster->edge->to;
+				edge_cluster->edge = cluster->edge;
+				expose_simple_clusters.push_back(edge_cluster); // to allow splitting it in Restore operation
+				TOP_TREE_COUNT(user_function_counters.creates, 1);
+				functions->Create(edge_cluster, cluster->edge->data);
+			}
 
-				std::shared_ptr<SimpleCluster> new_cluster = NULL;
-				if (edge_cluster != NULL && sibling_cluster != NULL) {
-					#ifdef DEBUG
-						std::cerr << "    Joining edge with endpoints " << *edge_cluster->boundary_left << "-" << *edge_cluster->boundary_right
-							  << " with cluster with endpoints " << *sibling_cluster->boundary_left << "-" << *sibling_cluster->boundary_right << std::endl;
-					#endif
-					// Combine them into one newly created SimpleCluster
-					auto new_simple_cluster = SimpleCluster::construct(edge_cluster, sibling);
-					if (sibling->is_rake_branch) {
-						new_simple_cluster->boundary_left = edge_cluster->boundary_left;
-						new_simple_cluster->boundary_right = edge_cluster->boundary_right;
-					} else {
-						// Find common vertex and construct compress cluster around it
-						auto common_vertex = TopologyCluster::get_common_vertex(sibling_cluster, edge_cluster, !cluster->edge->subvertice_edge);
+			std::shared_ptr<SimpleCluster> sibling_cluster = NULL;
+			if (sibling->is_top_cluster && !sibling->is_splitted) {
+				// Sibling is not splitted, so it is the only child of its copy (Split of the copy in Restore copies the data
+				// back into the sibling, its own children get the changes when it is splitted)
+				sibling_cluster = SimpleCluster::construct(simple_pool, sibling, NULL);
+				expose_simple_clusters.push_back(sibling_cluster); // to allow splitting it in Restore operation
+				sibling_cluster->boundary_left = sibling->boundary_left;
+				sibling_cluster->boundary_right = sibling->boundary_right;
+				//sibling_cluster->data = sibling->data;
+				functions->CopyClusterData(sibling, sibling_cluster);
+				sibling_cluster->edge = sibling->edge;
+			}
 
-						new_simple_cluster->boundary_left = (common_vertex == edge_cluster->boundary_left || common_vertex == edge_cluster->boundary_left->superior_vertex ? edge_cluster->boundary_right : edge_cluster->boundary_left);
-						new_simple_cluster->boundary_right = (common_vertex == sibling_cluster->boundary_left || common_vertex == sibling_cluster->boundary_left->superior_vertex ? sibling_cluster->boundary_right : sibling_cluster->boundary_left);
-					}
-					Join(edge_cluster, sibling_cluster, new_simple_cluster);
-					expose_simple_clusters.push_back(new_simple_cluster); // to allow splitting it in Restore operation
-					new_cluster = new_simple_cluster;
-				} else if (edge_cluster != NULL) new_cluster = edge_cluster;
-				else if (sibling_cluster != NULL) new_cluster = sibling_cluster;
+			std::shared_ptr<SimpleCluster> new_cluster = NULL;
+			if (edge_cluster != NULL && sibling_cluster != NULL) {
+				#ifdef DEBUG
+					std::cerr << "    Joining edge with endpoints " << *edge_cluster->boundary_left << "-" << *edge_cluster->boundary_right
+						  << " with cluster with endpoints " << *sibling_cluster->boundary_left << "-" << *sibling_cluster->boundary_right << std::endl;
+				#endif
+				// Combine them into one newly created SimpleCluster
+				auto new_simple_cluster = SimpleCluster::construct(simple_pool, edge_cluster, sibling_cluster);
+				if (sibling->is_rake_branch) {
+					new_simple_cluster->boundary_left = edge_cluster->boundary_left;
+					new_simple_cluster->boundary_right = edge_cluster->boundary_right;
+					TopologyCluster::move_boundary_over_rake(sibling_cluster, new_simple_cluster->boundary_left, new_simple_cluster->boundary_right);
+				} else {
+					// Find common vertex and construct compress cluster around it
+					auto common_vertex = TopologyCluster::get_common_vertex(sibling_cluster, edge_cluster, !cluster->edge->subvertice_edge);
 
-				if (new_cluster != NULL) {
-					#ifdef DEBUG
-						std::cerr << "    Adding new cluster with endpoints " << *new_cluster->boundary_left << "-" << *new_cluster->boundary_right << std::endl;
-					#endif
-					list.push_back(new_cluster);
+					new_simple_cluster->boundary_left = (common_vertex == edge_cluster->boundary_left || common_vertex == edge_cluster->boundary_left->superior_vertex ? edge_cluster->boundary_right : edge_cluster->boundary_left);
+					new_simple_cluster->boundary_right = (common_vertex == sibling_cluster->boundary_left || common_vertex == sibling_cluster->boundary_left->superior_vertex ? sibling_cluster->boundary_right : sibling_cluster->boundary_left);
 				}
+				TOP_TREE_COUNT(user_function_counters.joins, 1);
+				functions->Join(edge_cluster, sibling_cluster, new_simple_cluster);
+				expose_simple_clusters.push_back(new_simple_cluster); // to allow splitting it in Restore operation
+				new_cluster = new_simple_cluster;
+			} else if (edge_cluster != NULL) new_cluster = edge_cluster;
+			else if (sibling_cluster != NULL) new_cluster = sibling_cluster;
+
+			if (new_cluster != NULL) {
+				#ifdef DEBUG
+					std::cerr << "    Adding new cluster with endpoints " << *new_cluster->boundary_left << "-" << *new_cluster->boundary_right << std::endl;
+				#endif
+				list.push_back(new_cluster);
 			}
 		}
 		last_cluster = cluster;
 		cluster = cluster->parent;
 	}
-	return list;
 }
 
-std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::expose_join_clusters(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Vertex> target, std::shared_ptr<SimpleCluster> parent_cluster) {
+void TopologyTopTree::Internal::expose_add(BaseTree::Internal::Vertex *v, std::shared_ptr<SimpleCluster> cluster) {
+	int index = expose_graph.size();
+	expose_graph.push_back(expose_entry{cluster, -1});
+	if (v->expose_last == -1) v->expose_first = index;
+	else expose_graph[v->expose_last].next = index;
+	v->expose_last = index;
+}
+
+// Capacity of all buffers used by Expose and Restore (it changes only when some of them grows)
+size_t TopologyTopTree::Internal::expose_capacity() const {
+	return expose_list.capacity() + expose_graph.capacity() + expose_simple_clusters.capacity() + splitted_clusters.capacity() + restore_set.capacity();
+}
+
+std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::expose_join_clusters(BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *target, std::shared_ptr<SimpleCluster> parent_cluster) {
 	#ifdef DEBUG
 		std::cerr << "Starting joining from vertex " << *v << std::endl;
 	#endif
 
 	// If this is leaf
-	if ((parent_cluster != NULL && v->expose_clusters.size() == 1) || v->expose_clusters.size() == 0) return parent_cluster;
+	if (v->expose_first == -1 || (parent_cluster != NULL && expose_graph[v->expose_first].next == -1)) return parent_cluster;
 
 	std::shared_ptr<SimpleCluster> constructed_cluster = NULL;
-	for (auto c: v->expose_clusters) {
+	for (int i = v->expose_first; i != -1; i = expose_graph[i].next) {
+		auto c = expose_graph[i].cluster;
 		if (c == parent_cluster) continue;
 
 		auto other_vertex = BaseTree::Internal::Vertex::get_superior(c->boundary_left);
@@ -1214,7 +1329,7 @@ std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::expose_join_clusters(s
 		else {
 			// We do rake join
 			// 1. Construct cluster
-			auto new_cluster = SimpleCluster::construct(constructed_cluster, child_cluster);
+			auto new_cluster = SimpleCluster::construct(simple_pool, constructed_cluster, child_cluster);
 			expose_simple_clusters.push_back(new_cluster); // to allow splitting it in Restore operation
 
 			// 2. Set boundaries
@@ -1237,14 +1352,15 @@ std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::expose_join_clusters(s
 			#endif
 
 			// 3. Join itself
-			Join(constructed_cluster, child_cluster, new_cluster);
+			TOP_TREE_COUNT(user_function_counters.joins, 1);
+			functions->Join(constructed_cluster, child_cluster, new_cluster);
 			constructed_cluster = new_cluster;
 		}
 	}
 
 	if (parent_cluster == NULL) return constructed_cluster;
 
-	auto new_cluster = SimpleCluster::construct(parent_cluster, constructed_cluster);
+	auto new_cluster = SimpleCluster::construct(simple_pool, parent_cluster, constructed_cluster);
 	expose_simple_clusters.push_back(new_cluster); // to allow splitting it in Restore operation
 	if (v == target) {
 		// Rake onto parent_cluster
@@ -1261,14 +1377,29 @@ std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::expose_join_clusters(s
 			<< *constructed_cluster->boundary_left << "-" << *constructed_cluster->boundary_right << " into "
 			<< *new_cluster->boundary_left << "-" << *new_cluster->boundary_right << std::endl;
 	#endif
-	Join(parent_cluster, constructed_cluster, new_cluster);
+	TOP_TREE_COUNT(user_function_counters.joins, 1);
+	functions->Join(parent_cluster, constructed_cluster, new_cluster);
 
 	return new_cluster;
 }
 
 std::shared_ptr<ICluster> TopologyTopTree::Expose(int v_index, int w_index) {
-	// Restore previous expose (if needed)
-	Restore();
+	// The same path is still exposed (Restore was not called, so there was no update since then)
+	auto last = internal->last_expose_cluster;
+	if (last != NULL && !last->was_splitted && internal->last_expose_v == v_index && internal->last_expose_w == w_index) {
+		#ifdef DEBUG
+			std::cerr << "Expose of path between " << v_index << " and " << w_index << " reused" << std::endl;
+		#endif
+		TOP_TREE_COUNT(internal->statistics.expose_hits, 1);
+		return last;
+	}
+
+	// Restore previous expose (if needed), original clusters may stay splitted
+	#ifdef TOP_TREE_STATISTICS
+		size_t allocations = internal->simple_pool->get_allocations();
+		size_t capacity = internal->expose_capacity();
+	#endif
+	internal->restore(!internal->deferred_joins);
 
 	// 0. Get vertices and their clusters
 	auto v = internal->base_tree->internal->vertices[v_index];
@@ -1293,8 +1424,8 @@ std::shared_ptr<ICluster> TopologyTopTree::Expose(int v_index, int w_index) {
 	}
 
 	// If vertex is splitted into subvertices choose some
-	if (!v->subvertices.empty()) v = v->subvertices.front();
-	if (!w->subvertices.empty()) w = w->subvertices.front();
+	if (v->first_subvertex != NULL) v = v->first_subvertex;
+	if (w->first_subvertex != NULL) w = w->first_subvertex;
 	// Get clusters
 	auto cluster_v = v->topology_cluster;
 	auto cluster_w = w->topology_cluster;
@@ -1302,15 +1433,15 @@ std::shared_ptr<ICluster> TopologyTopTree::Expose(int v_index, int w_index) {
 	// 1. Split from both base clusters
 	cluster_v->do_split(&internal->splitted_clusters);
 	cluster_w->do_split(&internal->splitted_clusters);
+	if (internal->deferred_joins) internal->join_off_path(cluster_v, cluster_w);
 
-
-	// 2. Get all clusters that contains v/w as non-boundary vertex and save them into two lists
-	auto first_list = internal->expose_get_clusters(v, w, true);
-	auto second_list = internal->expose_get_clusters(w, v, false);
-	// 2.1 Join lists (second in reverse order)
-	std::list<std::shared_ptr<SimpleCluster>> clusters_list;
-	for (auto it = first_list.begin(); it != first_list.end(); ++it) clusters_list.push_back(*it);
-	for (auto it = second_list.rbegin(); it != second_list.rend(); ++it) clusters_list.push_back(*it);
+	// 2. Get all clusters that contains v/w as non-boundary vertex and save them into one list
+	auto &clusters_list = internal->expose_list;
+	internal->expose_get_clusters(clusters_list, v, w, true);
+	size_t first_size = clusters_list.size();
+	internal->expose_get_clusters(clusters_list, w, v, false);
+	// 2.1 Clusters from the second vertex in reverse order
+	std::reverse(clusters_list.begin() + first_size, clusters_list.end());
 
 	#ifdef DEBUG
 		std::cerr << "Clusters list: ";
@@ -1320,14 +1451,16 @@ std::shared_ptr<ICluster> TopologyTopTree::Expose(int v_index, int w_index) {
 
 	// 3. Make graph from all clusters
 	// 3.1 Empty all vertices
-	for (auto c: clusters_list) {
-		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_clusters.clear();
-		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_clusters.clear();
+	for (auto &c: clusters_list) {
+		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_first = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_last = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_first = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_last = -1;
 	}
 	// 3.2 Register each cluster
-	for (auto c: clusters_list) {
-		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_clusters.push_back(c);
-		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_clusters.push_back(c);
+	for (auto &c: clusters_list) {
+		internal->expose_add(BaseTree::Internal::Vertex::get_superior(c->boundary_left), c);
+		internal->expose_add(BaseTree::Internal::Vertex::get_superior(c->boundary_right), c);
 	}
 
 	// 4. Run DFS
@@ -1336,48 +1469,396 @@ std::shared_ptr<ICluster> TopologyTopTree::Expose(int v_index, int w_index) {
 		std::cerr << "Final cluster is: " << *final_cluster->boundary_left << "-" << *final_cluster->boundary_right << std::endl;
 	#endif
 
-	// Cleaning
-	for (auto c: clusters_list) {
-		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_clusters.clear();
-		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_clusters.clear();
+	// Cleaning (scratch keeps its capacity for the next Expose)
+	for (auto &c: clusters_list) {
+		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_first = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_left)->expose_last = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_first = -1;
+		BaseTree::Internal::Vertex::get_superior(c->boundary_right)->expose_last = -1;
 	}
+	clusters_list.clear();
+	internal->expose_graph.clear();
+
+	// Remember the result for next Expose
+	TOP_TREE_COUNT(internal->statistics.exposes, 1);
+	#ifdef TOP_TREE_STATISTICS
+		internal->statistics.expose_allocations += internal->simple_pool->get_allocations() - allocations;
+		if (internal->expose_capacity() != capacity) internal->statistics.expose_allocations++; // some buffer had to grow
+	#endif
+	internal->last_expose_v = v_index;
+	internal->last_expose_w = w_index;
+	internal->last_expose_cluster = final_cluster;
 
 	return final_cluster;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// Read-only path query
+
+std::atomic<unsigned long long> TopologyTopTree::Internal::global_id{0};
+
+void TopologyTopTree::Internal::path_query::start(unsigned long long tree, const UserFunctions *functions) {
+	// Clusters of other tree may have other type of data
+	if (this->tree != tree) {
+		this->tree = tree;
+		this->functions = functions;
+		clusters.clear();
+	}
+	used_clusters = 0;
+
+	// Forget all copies, entries are cleared only when the epoch overflows
+	if (++epoch == 0) {
+		for (auto &e: entries) e.epoch = 0;
+		epoch = 1;
+	}
+	used_entries = 0;
+
+	list.clear();
+	second_list.clear();
+	expose_clusters.clear();
+}
+
+TopologyTopTree::Internal::path_query::entry &TopologyTopTree::Internal::path_query::find(const ICluster *cluster) {
+	// Keep at most half of the entries used
+	if (2 * (used_entries + 1) > entries.size()) {
+		std::vector<entry> old(std::max((size_t) 64, 2 * entries.size()));
+		old.swap(entries);
+		used_entries = 0;
+		for (auto &e: old) if (e.epoch == epoch) find(e.cluster) = e;
+	}
+
+	size_t mask = entries.size() - 1;
+	size_t i = (size_t) (((uint64_t) reinterpret_cast<uintptr_t>(cluster) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while (entries[i].epoch == epoch && entries[i].cluster != cluster) i = (i + 1) & mask;
+	if (entries[i].epoch != epoch) {
+		entries[i] = entry();
+		entries[i].cluster = cluster;
+		entries[i].epoch = epoch;
+		used_entries++;
+	}
+	return entries[i];
+}
+
+bool TopologyTopTree::Internal::path_query::is_splitted(const ICluster *cluster) {
+	if (entries.empty()) return false;
+	size_t mask = entries.size() - 1;
+	size_t i = (size_t) (((uint64_t) reinterpret_cast<uintptr_t>(cluster) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while (entries[i].epoch == epoch) {
+		if (entries[i].cluster == cluster) return entries[i].splitted;
+		i = (i + 1) & mask;
+	}
+	return false;
+}
+
+std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::path_query::new_cluster() {
+	if (used_clusters == clusters.size()) {
+		clusters.push_back(std::make_shared<SimpleCluster>(functions));
+		return clusters[used_clusters++];
+	}
+
+	// Cluster of a previous query (its result is valid only until the next query of the thread)
+	auto &cluster = clusters[used_clusters++];
+	if (!cluster->data->Reset()) cluster->data = functions->InitClusterData();
+	return cluster;
+}
+
+std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::query_copy(path_query *query, const std::shared_ptr<ICluster> &cluster) const {
+	auto &e = query->find(cluster.get());
+	if (e.copy == -1) {
+		e.copy = query->used_clusters;
+		auto copy = query->new_cluster();
+		copy->boundary_left = cluster->boundary_left;
+		copy->boundary_right = cluster->boundary_right;
+		functions->CopyClusterData(cluster, copy);
+	}
+	return query->clusters[e.copy];
+}
+
+// The same as TopologyCluster::do_split, but it splits copies of the clusters (from the top, so the copy of this
+// cluster was already splitted from its parent)
+void TopologyTopTree::Internal::query_split(path_query *query, TopologyCluster *cluster) const {
+	query->find(cluster).splitted = true;
+	const auto &first = cluster->first;
+	const auto &second = cluster->second;
+	if (first == NULL && second == NULL) return; // it is the basic cluster at vertex level
+
+	auto copy = query_copy(query, cluster->shared_from_this());
+	if (second == NULL) {
+		functions->CopyClusterData(copy, query_copy(query, first));
+	} else if (cluster->edge->subvertice_edge) {
+		if (first->is_top_cluster && second->is_top_cluster) functions->Split(query_copy(query, first), query_copy(query, second), copy);
+		else if (first->is_top_cluster) functions->CopyClusterData(copy, query_copy(query, first));
+		else if (second->is_top_cluster) functions->CopyClusterData(copy, query_copy(query, second));
+	} else {
+		auto combined_edge_cluster = query_copy(query, cluster->combined_edge_cluster);
+		auto edge_cluster = query_copy(query, cluster->edge_cluster);
+
+		// 1. Split with the second
+		if (second->is_top_cluster) functions->Split(query_copy(query, second), combined_edge_cluster, copy);
+		else functions->CopyClusterData(copy, combined_edge_cluster);
+
+		// 2. Split with the first
+		if (first->is_top_cluster) functions->Split(query_copy(query, first), edge_cluster, combined_edge_cluster);
+		else functions->CopyClusterData(combined_edge_cluster, edge_cluster);
+
+		// 3. Edge cluster is not destroyed (it would write into the edge), its copy is used instead of a new one
+	}
+}
+
+// The same as expose_get_clusters, data are taken from the splitted copies
+void TopologyTopTree::Internal::query_get_clusters(path_query *query, std::vector<std::shared_ptr<SimpleCluster>> &list, BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *second_v, bool continue_above_common) const {
+	TopologyCluster *last_cluster = v->topology_cluster.get();
+	TopologyCluster *cluster = last_cluster->parent.get(); // we starts one level above base cluster
+	bool was_added = false;
+	while (cluster != NULL) {
+		if (cluster->edge != NULL) {
+			// Get sibling
+			const auto &sibling = (last_cluster == cluster->first.get() ? cluster->second : cluster->first);
+			bool sibling_splitted = query->is_splitted(sibling.get());
+
+			if (was_added || !cluster->is_external_boundary_vertex(v) || cluster->edge->from == second_v || cluster->edge->to == second_v || sibling_splitted) {
+				if (!was_added && last_cluster->is_top_cluster) {
+					auto new_simple_cluster = query->new_cluster();
+					new_simple_cluster->boundary_left = last_cluster->boundary_left;
+					new_simple_cluster->boundary_right = last_cluster->boundary_right;
+					functions->CopyClusterData(query_copy(query, last_cluster->shared_from_this()), new_simple_cluster);
+					list.push_back(new_simple_cluster);
+				}
+				was_added = true;
+
+				// If we are in the same area as the other run stop the cycle
+				if (sibling_splitted && !continue_above_common) break;
+
+				std::shared_ptr<SimpleCluster> edge_cluster = NULL;
+				if (!cluster->edge->subvertice_edge) {
+					edge_cluster = query->new_cluster();
+					edge_cluster->boundary_left = cluster->edge->from;
+					edge_cluster->boundary_right = cluster->edge->to;
+					functions->CopyClusterData(query_copy(query, cluster->edge_cluster), edge_cluster);
+				}
+
+				std::shared_ptr<SimpleCluster> sibling_cluster = NULL;
+				if (sibling->is_top_cluster && !sibling_splitted) {
+					sibling_cluster = query->new_cluster();
+					sibling_cluster->boundary_left = sibling->boundary_left;
+					sibling_cluster->boundary_right = sibling->boundary_right;
+					functions->CopyClusterData(query_copy(query, sibling), sibling_cluster);
+				}
+
+				std::shared_ptr<SimpleCluster> new_cluster = NULL;
+				if (edge_cluster != NULL && sibling_cluster != NULL) {
+					// Combine them into one new SimpleCluster
+					auto new_simple_cluster = query->new_cluster();
+					if (sibling->is_rake_branch) {
+						new_simple_cluster->boundary_left = edge_cluster->boundary_left;
+						new_simple_cluster->boundary_right = edge_cluster->boundary_right;
+						TopologyCluster::move_boundary_over_rake(sibling_cluster, new_simple_cluster->boundary_left, new_simple_cluster->boundary_right);
+					} else {
+						// Find common vertex and construct compress cluster around it
+						auto common_vertex = TopologyCluster::get_common_vertex(sibling_cluster, edge_cluster, !cluster->edge->subvertice_edge);
+
+						new_simple_cluster->boundary_left = (common_vertex == edge_cluster->boundary_left || common_vertex == edge_cluster->boundary_left->superior_vertex ? edge_cluster->boundary_right : edge_cluster->boundary_left);
+						new_simple_cluster->boundary_right = (common_vertex == sibling_cluster->boundary_left || common_vertex == sibling_cluster->boundary_left->superior_vertex ? sibling_cluster->boundary_right : sibling_cluster->boundary_left);
+					}
+					functions->Join(edge_cluster, sibling_cluster, new_simple_cluster);
+					new_cluster = new_simple_cluster;
+				} else if (edge_cluster != NULL) new_cluster = edge_cluster;
+				else if (sibling_cluster != NULL) new_cluster = sibling_cluster;
+
+				if (new_cluster != NULL) list.push_back(new_cluster);
+			}
+		}
+		last_cluster = cluster;
+		cluster = cluster->parent.get();
+	}
+}
+
+// The same as expose_join_clusters, clusters of vertices are kept in the query
+std::shared_ptr<SimpleCluster> TopologyTopTree::Internal::query_join_clusters(path_query *query, BaseTree::Internal::Vertex *v, BaseTree::Internal::Vertex *target, std::shared_ptr<SimpleCluster> parent_cluster) const {
+	size_t count = 0;
+	for (const auto &c: query->expose_clusters) if (c.first == v) count++;
+
+	// If this is leaf
+	if ((parent_cluster != NULL && count == 1) || count == 0) return parent_cluster;
+
+	std::shared_ptr<SimpleCluster> constructed_cluster = NULL;
+	for (size_t i = 0; i < query->expose_clusters.size(); i++) {
+		if (query->expose_clusters[i].first != v) continue;
+		auto c = query->expose_clusters[i].second;
+		if (c == parent_cluster) continue;
+
+		auto other_vertex = BaseTree::Internal::Vertex::get_superior(c->boundary_left);
+		if (other_vertex == v) other_vertex = BaseTree::Internal::Vertex::get_superior(c->boundary_right);
+		std::shared_ptr<SimpleCluster> child_cluster;
+
+		if (other_vertex == v) child_cluster = c; // cluster around subvertice edge, there is no continuation from it
+		else child_cluster = query_join_clusters(query, other_vertex, target, c);
+
+		if (constructed_cluster == NULL) constructed_cluster = child_cluster;
+		else {
+			// We do rake join
+			auto new_cluster = query->new_cluster();
+			other_vertex = BaseTree::Internal::Vertex::get_superior(child_cluster->boundary_left);
+			if (other_vertex == v) other_vertex = BaseTree::Internal::Vertex::get_superior(child_cluster->boundary_right);
+			if (other_vertex == target) {
+				// rake on the child cluster
+				new_cluster->boundary_left = child_cluster->boundary_left;
+				new_cluster->boundary_right = child_cluster->boundary_right;
+			} else {
+				// otherwise rake to the constructed cluster
+				new_cluster->boundary_left = constructed_cluster->boundary_left;
+				new_cluster->boundary_right = constructed_cluster->boundary_right;
+			}
+			functions->Join(constructed_cluster, child_cluster, new_cluster);
+			constructed_cluster = new_cluster;
+		}
+	}
+
+	if (parent_cluster == NULL) return constructed_cluster;
+
+	auto new_cluster = query->new_cluster();
+	if (v == target) {
+		// Rake onto parent_cluster
+		new_cluster->boundary_left = parent_cluster->boundary_left;
+		new_cluster->boundary_right = parent_cluster->boundary_right;
+	} else {
+		// Compress with parent cluster
+		new_cluster->boundary_left = (BaseTree::Internal::Vertex::get_superior(parent_cluster->boundary_left) == v ? parent_cluster->boundary_right : parent_cluster->boundary_left);
+		new_cluster->boundary_right = (BaseTree::Internal::Vertex::get_superior(constructed_cluster->boundary_left) == v ? constructed_cluster->boundary_right : constructed_cluster->boundary_left);
+	}
+	functions->Join(parent_cluster, constructed_cluster, new_cluster);
+
+	return new_cluster;
+}
+
+std::shared_ptr<ICluster> TopologyTopTree::QueryPath(int v_index, int w_index) {
+	// Tree with unrestored Expose is not queried (QueryPath never changes the tree)
+	if (!internal->expose_simple_clusters.empty() || !internal->splitted_clusters.empty()) return NULL;
+
+	// 0. Get vertices and their clusters
+	BaseTree::Internal::Vertex *v = internal->base_tree->internal->vertices[v_index].get();
+	BaseTree::Internal::Vertex *w = internal->base_tree->internal->vertices[w_index].get();
+	if (v_index == w_index || !internal->in_same_tree(v, w)) return NULL;
+
+	// If vertex is splitted into subvertices choose some
+	if (v->first_subvertex != NULL) v = v->first_subvertex.get();
+	if (w->first_subvertex != NULL) w = w->first_subvertex.get();
+
+	// Scratch of the calling thread
+	static thread_local Internal::path_query query;
+	query.start(internal->id, internal->functions);
+
+	// 1. Split copies of all clusters above both base clusters (from the root down)
+	auto &to_split = query.to_split;
+	to_split.clear();
+	for (auto c = v->topology_cluster.get(); c != NULL; c = c->parent.get()) to_split.push_back(c);
+	for (auto it = to_split.rbegin(); it != to_split.rend(); ++it) internal->query_split(&query, *it);
+	to_split.clear();
+	for (auto c = w->topology_cluster.get(); c != NULL && !query.is_splitted(c); c = c->parent.get()) to_split.push_back(c);
+	for (auto it = to_split.rbegin(); it != to_split.rend(); ++it) internal->query_split(&query, *it);
+
+	// 2. Get all clusters that contains v/w as non-boundary vertex, join lists (second in reverse order)
+	internal->query_get_clusters(&query, query.list, v, w, true);
+	internal->query_get_clusters(&query, query.second_list, w, v, false);
+	for (auto it = query.second_list.rbegin(); it != query.second_list.rend(); ++it) query.list.push_back(*it);
+
+	// 3. Make graph from all clusters and join them by DFS
+	for (const auto &c: query.list) {
+		query.expose_clusters.push_back(std::make_pair(BaseTree::Internal::Vertex::get_superior(c->boundary_left), c));
+		query.expose_clusters.push_back(std::make_pair(BaseTree::Internal::Vertex::get_superior(c->boundary_right), c));
+	}
+	return internal->query_join_clusters(&query, BaseTree::Internal::Vertex::get_superior(v), BaseTree::Internal::Vertex::get_superior(w), NULL);
+}
+
+void TopologyTopTree::Internal::join_off_path(std::shared_ptr<TopologyCluster> cluster_v, std::shared_ptr<TopologyCluster> cluster_w) {
+	// 1. Mark clusters above both base clusters (they stay splitted)
+	for (auto c = cluster_v; c != NULL; c = c->parent) c->on_expose_path = true;
+	for (auto c = cluster_w; c != NULL && !c->on_expose_path; c = c->parent) c->on_expose_path = true;
+
+	// 2. Join clusters left splitted by previous Exposes and their ancestors up to the marked ones
+	for (auto c: splitted_clusters) {
+		while (c != NULL && c->is_splitted && !c->on_expose_path) {
+			c->do_join();
+			c = c->parent;
+		}
+	}
+	splitted_clusters.erase(std::remove_if(splitted_clusters.begin(), splitted_clusters.end(), [](const std::shared_ptr<TopologyCluster> &c) {
+		return !c->is_splitted;
+	}), splitted_clusters.end());
+
+	// 3. Unmark
+	for (auto c = cluster_v; c != NULL && c->on_expose_path; c = c->parent) c->on_expose_path = false;
+	for (auto c = cluster_w; c != NULL && c->on_expose_path; c = c->parent) c->on_expose_path = false;
+}
+
+void TopologyTopTree::SetDeferredJoins(bool deferred) {
+	internal->deferred_joins = deferred;
+}
+
 void TopologyTopTree::Restore() {
-	if (internal->expose_simple_clusters.empty()) return; // no need to restore anything
+	internal->restore(true);
+}
+
+void TopologyTopTree::Internal::restore(bool join) {
+	last_expose_cluster = NULL;
+	if (expose_simple_clusters.empty() && splitted_clusters.empty()) return; // no need to restore anything
 
 	#ifdef DEBUG
 		std::cerr << "Restore STARTED " << std::endl;
 	#endif
 
 	// 1. Split temporary clusters
-	for (auto c: internal->expose_simple_clusters) {
+	for (auto c: expose_simple_clusters) {
 		c->do_split();
 		c->unlink(true);
 	}
-	internal->expose_simple_clusters.clear();
+	expose_simple_clusters.clear();
 
 	#ifdef DEBUG
 		std::cerr << "Restore - simple clusters all splitted " << std::endl;
 	#endif
 
 
-	// 2. Join original clusters
+	// 2. Join original clusters (deferred joins keep them splitted, they are joined by the next Expose or Restore)
+	if (!join) return;
 	// 2.1 Firstly ensure that they are already splitted
-	for (auto c: internal->splitted_clusters) c->do_split();
-	// 2.2 Join them back
-	for (auto c: internal->splitted_clusters) {
-		while (c != NULL && c->is_splitted) {
-			c->do_join();
-			c = c->parent;
+	for (auto &c: splitted_clusters) c->do_split();
+	// 2.2 Collect the split set: listed clusters and their splitted ancestors, each of them only once (clusters are
+	// stamped by the epoch of this Restore, the list may contain the same cluster many times and ancestor chains of
+	// the neighbouring clusters are shared)
+	restore_epoch++;
+	restore_set.clear();
+	for (auto &listed: splitted_clusters) {
+		for (auto c = listed.get(); c != NULL && c->is_splitted && c->restore_epoch != restore_epoch; c = c->parent.get()) {
+			c->restore_epoch = restore_epoch;
+			c->restore_waiting = 0;
+			restore_set.push_back(c);
 		}
 	}
-	internal->splitted_clusters.clear();
+	// 2.3 Join them back from the bottom level up, cluster is joined after all its childs from the split set
+	for (auto c: restore_set) {
+		if (c->parent != NULL && c->parent->restore_epoch == restore_epoch) c->parent->restore_waiting++;
+	}
+	size_t ready = 0;
+	for (auto c: restore_set) {
+		if (c->restore_waiting == 0) restore_set[ready++] = c;
+	}
+	int joins = 0;
+	for (size_t i = 0; i < ready; i++) {
+		auto c = restore_set[i];
+		joins += c->do_join();
+		auto parent = c->parent.get();
+		if (parent != NULL && parent->restore_epoch == restore_epoch && --parent->restore_waiting == 0) restore_set[ready++] = parent;
+	}
+	splitted_clusters.clear();
+
+	// 3. Report the number of Join callbacks
+	TOP_TREE_COUNT(statistics.restores, 1);
+	TOP_TREE_COUNT(statistics.restore_joins, joins);
+	if (restore_hook != NULL) restore_hook(joins);
 
 	#ifdef DEBUG_GRAPHVIZ
-		for (auto root_cluster: internal->root_clusters) internal->print_graphviz(root_cluster, "After RESTORE", true);
+		for (auto root_cluster: root_clusters) print_graphviz(root_cluster, "After RESTORE", true);
 	#endif
 
 	#ifdef DEBUG
@@ -1385,6 +1866,42 @@ void TopologyTopTree::Restore() {
 	#endif
 }
 
+void TopologyTopTree::SetRestoreHook(void (*hook)(int joins)) {
+	internal->restore_hook = hook;
+}
+
+std::vector<std::pair<std::string, long long>> TopologyTopTree::GetStatistics() const {
+	#ifdef TOP_TREE_STATISTICS
+		auto &s = internal->statistics;
+		return {
+			{"update_levels", s.update_levels},
+			{"deleted_clusters", s.deleted_clusters},
+			{"changed_clusters", s.changed_clusters},
+			{"abandoned_clusters", s.abandoned_clusters},
+			{"exposes", s.exposes},
+			{"expose_hits", s.expose_hits},
+			{"expose_allocations", s.expose_allocations},
+			{"restores", s.restores},
+			{"restore_joins", s.restore_joins},
+			{"expose_simple_clusters", (long long) (internal->simple_pool->get_creations() - s.simple_clusters_at_reset)},
+			{"split_vertices", s.split_vertices},
+			{"added_subvertices", s.added_subvertices},
+			{"removed_subvertices", s.removed_subvertices},
+			{"joins", user_function_counters.joins - s.user_functions_at_reset.joins},
+			{"splits", user_function_counters.splits - s.user_functions_at_reset.splits},
+			{"creates", user_function_counters.creates - s.user_functions_at_reset.creates},
+			{"destroys", user_function_counters.destroys - s.user_functions_at_reset.destroys}
+		};
+	#else
+		return {};
+	#endif
+}
+
+void TopologyTopTree::ResetStatistics() {
+	internal->statistics = Internal::Statistics();
+	internal->statistics.simple_clusters_at_reset = internal->simple_pool->get_creations();
+}
+
 std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> TopologyTopTree::SplitRoot(std::shared_ptr<ICluster> root) {
 	auto cluster = std::dynamic_pointer_cast<SimpleCluster>(root);
 	if (cluster->first == NULL || cluster->second == NULL) {
@@ -1398,71 +1915,110 @@ std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> TopologyTopTree:
 ////////////////////////////////////////////////////////////////////////////////
 /// Functions for construction:
 
-std::shared_ptr<BaseTree::Internal::Vertex> TopologyTopTree::Internal::split_vertex(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> parent_edge) {
+// Vertex is splitted into a chain of subvertices, not into a balanced tree of them. Link and cut at the vertex change
+// only the first subvertex of the chain (constant number of operations). Balanced tree was slower on stars (subvertices
+// without real edges are clustered worse): 160 vs 90 us per move and 100 vs 70 us per query with 10000 leaves.
+Ref<BaseTree::Internal::Vertex> TopologyTopTree::Internal::split_vertex(Ref<BaseTree::Internal::Vertex> v, Ref<BaseTree::Internal::Edge> parent_edge) {
+	TOP_TREE_COUNT(statistics.split_vertices, 1);
+
 	// Create subvertices
-	auto current = std::make_shared<BaseTree::Internal::Vertex>(std::make_shared<VertexData>());
-	current->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
-	current->superior_vertex = v;
-	v->subvertices.push_back(current);
+	auto current = new_subvertex(v);
+	v->first_subvertex = current;
 	auto vertex_to_return = current; // by default we return the first vertex
 
-	auto current_iter = std::prev(v->subvertices.end());
-	for (auto n = v->neighbours.begin(); n != v->neighbours.end(); ++n) {
+	for (uint i = 0; i < v->neighbours.size(); i++) {
 		// Copy this edge into subvertice and notice what subvertice it is
-		auto edge = (*n).edge.lock();
-		//auto target_vertex = (*n).vertex.lock();
-		auto target_vertex = edge->from;
-		if (target_vertex == v) target_vertex = edge->to;
+		auto &edge = v->neighbours[i].edge;
 
 		// 1. If this subvertice is full create a new one
-		if (current->degree == 2 && n != std::prev(v->neighbours.end())) {
+		if (current->degree == 2 && i + 1 != v->neighbours.size()) {
 			#ifdef DEBUG
 				std::cerr << "Creating new subvertex for " << *v << std::endl;
 			#endif
-			auto temp = std::make_shared<BaseTree::Internal::Vertex>(std::make_shared<VertexData>());
-			temp->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
-			temp->superior_vertex = v;
-			v->subvertices.push_back(temp);
-			temp->superior_vertex_subvertices_iter = std::prev(v->subvertices.end());
+			auto temp = new_subvertex(v);
 
 			// Add edge between them (subvertice edge)
-			auto inner_edge = std::make_shared<BaseTree::Internal::Edge>(current, temp, std::make_shared<EdgeData>());
+			auto inner_edge = base_tree->internal->new_edge(current, temp);
 			inner_edge->subvertice_edge = true;
 			inner_edge->register_at_vertices();
 
-			v->subvertice_edges.push_back(inner_edge);
-			inner_edge->subvertice_edges_iterator = std::prev(v->subvertice_edges.end());
-
 			current = temp;
-
-			current_iter = std::prev(v->subvertices.end());
 		}
 
 		// 2. Test if this edge is the parent edge (so it will be connected with this subvertex) and if so remember it so we will return this one
 		if (edge == parent_edge) vertex_to_return = current;
 
 		// 3. Add this edge to current subvertice
+		int slot = current->neighbours.size();
 		current->neighbours.push_back(BaseTree::Internal::neighbour{edge});
 		current->degree++;
-		(*n).subvertice_iter = current_iter;
 
-		// 4. Update edge itself - its from/to will be updated to this vertex and iter will be added
+		// 4. Update edge itself - its from/to will be updated to this vertex and slot will be added
 		if (edge->from == v) {
 			edge->from = current;
-			edge->superior_from_iter = edge->from_iter;
-			edge->from_iter = std::prev(current->neighbours.end());
+			edge->superior_from_slot = edge->from_slot;
+			edge->from_slot = slot;
 		} else {
 			edge->to = current;
-			edge->superior_to_iter = edge->to_iter;
-			edge->to_iter = std::prev(current->neighbours.end());
+			edge->superior_to_slot = edge->to_slot;
+			edge->to_slot = slot;
 		}
 	}
 	return vertex_to_return;
 }
 
+Ref<BaseTree::Internal::Vertex> TopologyTopTree::Internal::new_subvertex(Ref<BaseTree::Internal::Vertex> v, bool with_cluster) {
+	TOP_TREE_COUNT(statistics.added_subvertices, 1);
+	auto subvertex = base_tree->internal->new_vertex();
+	subvertex->index = v->index; // index of the subvertex is the same as index of the superior vertex (from the Join point of view it is the same vertex)
+	subvertex->superior_vertex = v;
 
-std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_basic_clusters(std::shared_ptr<BaseTree::Internal::Vertex> v, std::shared_ptr<BaseTree::Internal::Edge> parent_edge) {
-	if (v->degree > 3) return construct_basic_clusters(split_vertex(v, parent_edge), parent_edge);
+	if (with_cluster) {
+		subvertex->topology_cluster = std::make_shared<TopologyCluster>(functions);
+		splitted_clusters.push_back(subvertex->topology_cluster);
+		subvertex->topology_cluster->vertex = subvertex;
+	}
+	return subvertex;
+}
+
+void TopologyTopTree::Internal::remove_first_subvertex(Ref<BaseTree::Internal::Vertex> v) {
+	// First subvertex has only the subvertice edge to the second one, which becomes the first (it has a free slot now)
+	auto first = v->first_subvertex;
+	auto second = first->next_subvertex(NULL);
+	auto result = cut(first, second, first->neighbours[0].edge);
+	#ifdef DEBUG_GRAPHVIZ_VERBOSE
+		std::ostringstream ss;
+		ss << "Removing first subvertex " << *first << " - ";
+		print_graphviz(std::get<0>(result), ss.str() + "after cut 1/2", true);
+		print_graphviz(std::get<1>(result), ss.str() + "after cut 2/2", true);
+	#endif
+	v->first_subvertex = second;
+	first->unlink();
+	TOP_TREE_COUNT(statistics.removed_subvertices, 1);
+}
+
+Ref<BaseTree::Internal::Edge> TopologyTopTree::Internal::get_real_edge(BaseTree::Internal::Vertex *subvertex) {
+	for (const auto &n: subvertex->neighbours) if (!n.edge->subvertice_edge) return n.edge;
+
+	std::cerr << "ERROR: Subvertex " << *subvertex << " has no edge out of its superior vertex" << std::endl;
+	exit(1);
+}
+
+void TopologyTopTree::Internal::move_subvertex_edge(Ref<BaseTree::Internal::Vertex> from, Ref<BaseTree::Internal::Vertex> to, Ref<BaseTree::Internal::Edge> edge) {
+	if (edge->from == from) {
+		auto other = edge->to;
+		cut(from, other, edge);
+		link(to, other, edge);
+	} else {
+		auto other = edge->from;
+		cut(other, from, edge);
+		link(other, to, edge);
+	}
+}
+
+
+std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_basic_clusters(Ref<BaseTree::Internal::Vertex> v, construction_lists *lists, Ref<BaseTree::Internal::Edge> parent_edge) {
+	if (v->degree > 3) return construct_basic_clusters(split_vertex(v, parent_edge), lists, parent_edge);
 
 	// Otherwise...
 	// 1. Sanity check
@@ -1472,13 +2028,13 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_basic_clus
 	}
 
 	// 2. Construct basic topology clusters from this vertex and connect with outgoing edges with others
-	auto cluster = std::make_shared<TopologyCluster>();
-	splitted_clusters.push_back(cluster);
+	auto cluster = std::make_shared<TopologyCluster>(functions);
+	lists->splitted_clusters.push_back(cluster);
 	cluster->vertex = v;
 	v->topology_cluster = cluster;
 	v->used = true;
-	for (auto n : v->neighbours) {
-		if (auto ee = n.edge.lock()) {
+	for (const auto &n : v->neighbours) {
+		if (auto &ee = n.edge) {
 			if (ee == parent_edge) continue;
 			// Get oposite vertex
 			auto vv = ee->from;
@@ -1489,10 +2045,10 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_basic_clus
 				return NULL;
 			}
 			vv->used = true;
-			auto child = construct_basic_clusters(vv, ee);
-			cluster->outer_edges.push_back(TopologyCluster::neighbour{ee, child});
+			auto child = construct_basic_clusters(vv, lists, ee);
+			cluster->outer_edges.push_back(TopologyCluster::neighbour{ee, child.get()});
 			cluster->outer_edges_count++;
-			child->outer_edges.push_back(TopologyCluster::neighbour{ee, cluster});
+			child->outer_edges.push_back(TopologyCluster::neighbour{ee, cluster.get()});
 			child->outer_edges_count++;
 		}
 	}
@@ -1501,7 +2057,7 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_basic_clus
 	return cluster;
 }
 
-std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_tree(std::shared_ptr<TopologyCluster> cluster, int level, std::shared_ptr<BaseTree::Internal::Edge> parent_edge) {
+std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_tree(std::shared_ptr<TopologyCluster> cluster, construction_lists *lists, int threads, Ref<BaseTree::Internal::Edge> parent_edge) {
 	std::shared_ptr<TopologyCluster> first = NULL;
 	std::shared_ptr<TopologyCluster> second = NULL;
 
@@ -1513,12 +2069,36 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_t
 	#endif
 
 	// 1. Construct clusters for both children
-	for (auto o : cluster->outer_edges) {
+	const TopologyCluster::neighbour *first_child = NULL;
+	const TopologyCluster::neighbour *second_child = NULL;
+	for (const auto &o : cluster->outer_edges) {
 		if (o.edge == parent_edge) continue;
-		if (first == NULL) first = construct_topology_tree(o.cluster, level, o.edge);
-		else second = construct_topology_tree(o.cluster, level, o.edge);
+		if (first_child == NULL) first_child = &o;
+		else second_child = &o;
+	}
+	if (second_child != NULL && threads > 1 && first_child->cluster->construction_size >= PARALLEL_CONSTRUCTION_GRAIN && second_child->cluster->construction_size >= PARALLEL_CONSTRUCTION_GRAIN) {
+		// 1.1 Both subtrees are large: the first one is constructed by a new thread, threads are divided according to sizes of subtrees
+		long long first_size = first_child->cluster->construction_size;
+		long long second_size = second_child->cluster->construction_size;
+		int first_threads = std::max(1, std::min(threads - 1, (int) (threads * first_size / (first_size + second_size))));
+
+		construction_lists first_lists;
+		std::thread worker([&]() { first = construct_topology_tree(first_child->cluster->shared_from_this(), &first_lists, first_threads, first_child->edge); });
+		second = construct_topology_tree(second_child->cluster->shared_from_this(), lists, threads - first_threads, second_child->edge);
+		worker.join();
+
+		lists->splitted_clusters.insert(lists->splitted_clusters.end(), first_lists.splitted_clusters.begin(), first_lists.splitted_clusters.end());
+		lists->to_calculate_outer_edges.insert(lists->to_calculate_outer_edges.end(), first_lists.to_calculate_outer_edges.begin(), first_lists.to_calculate_outer_edges.end());
+	} else {
+		if (first_child != NULL) first = construct_topology_tree(first_child->cluster->shared_from_this(), lists, threads, first_child->edge);
+		if (second_child != NULL) second = construct_topology_tree(second_child->cluster->shared_from_this(), lists, threads, second_child->edge);
 	}
 
+	// 2. Size of this subtree (saved into the returned cluster, it is used for dividing the work on the next level)
+	int size = 1;
+	if (first != NULL) size += first->construction_size;
+	if (second != NULL) size += second->construction_size;
+
 	// 3. Check if this cluster could be added to one of the child clusters:
 	if (first != NULL && second != NULL) {
 		// Both children, we could add this cluster only to some with only one cluster and without other edges
@@ -1529,6 +2109,7 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_t
 			first->second = cluster;
 			cluster->parent = first;
 			first->outer_edges_count += cluster->outer_edges_count - 2;
+			first->construction_size = size;
 			// outer edges will be calculated after finishing making all clusters on this level of topology tree
 			return first;
 		} else if (second->second == NULL && second->outer_edges_count == 1) {
@@ -1538,6 +2119,7 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_t
 			second->second = cluster;
 			cluster->parent = second;
 			second->outer_edges_count += cluster->outer_edges_count - 2;
+			second->construction_size = size;
 			// outer edges will be calculated after finishing making all clusters on this level of topology tree
 			return second;
 		}
@@ -1548,6 +2130,7 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_t
 		first->second = cluster;
 		cluster->parent = first;
 		first->outer_edges_count += cluster->outer_edges_count - 2;
+		first->construction_size = size;
 		return first;
 	}
 
@@ -1555,15 +2138,122 @@ std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_topology_t
 	#ifdef DEBUG
 		std::cerr << "Creating new cluster " << cluster->outer_edges_count << std::endl;
 	#endif
-	auto new_cluster = std::make_shared<TopologyCluster>();
-	splitted_clusters.push_back(new_cluster);
+	auto new_cluster = std::make_shared<TopologyCluster>(functions);
+	lists->splitted_clusters.push_back(new_cluster);
 	new_cluster->first = cluster;
 	new_cluster->vertex = cluster->vertex;
 	cluster->parent = new_cluster;
 	new_cluster->outer_edges_count = cluster->outer_edges_count;
-	to_calculate_outer_edges.push_back(new_cluster);
+	new_cluster->construction_size = size;
+	lists->to_calculate_outer_edges.push_back(new_cluster);
 
 	return new_cluster;
 }
 
+std::shared_ptr<TopologyCluster> TopologyTopTree::Internal::construct_component(std::shared_ptr<TopologyCluster> root_cluster, construction_lists *lists, int threads) {
+	// Construct level by level until only the root remains
+	while (root_cluster->outer_edges.size() > 0) {
+		root_cluster = construct_topology_tree(root_cluster, lists, threads);
+		auto &list = lists->to_calculate_outer_edges;
+		parallel_for(threads, list.size(), [&](size_t i) { list[i]->calculate_outer_edges(); });
+		list.clear();
+	}
+	return root_cluster;
+}
+
+void TopologyTopTree::Internal::construct_parallel(int threads) {
+	// 1. Walk all components from their leaves by this thread (vertices with high degree are splitted into subvertices
+	//    on the way as in the serial construction, it allocates in the base tree); order of vertices and sizes of subtrees are saved
+	struct entry {
+		Ref<BaseTree::Internal::Vertex> vertex;
+		Ref<BaseTree::Internal::Edge> parent_edge;
+		int parent;
+		int size;
+	};
+	std::vector<entry> order;
+	std::vector<int> component_entries; // first entries of components
+	std::vector<std::pair<int, uint>> stack; // entry and its next neighbour
+	for (const auto &v: base_tree->internal->vertices) {
+		if (v->used || v->degree != 1) continue;
+
+		v->used = true;
+		component_entries.push_back(order.size());
+		order.push_back(entry{v, NULL, -1, 1});
+		stack.push_back(std::make_pair(order.size() - 1, 0));
+		while (!stack.empty()) {
+			int current = stack.back().first;
+			auto &u = order[current].vertex;
+			if (stack.back().second < u->neighbours.size()) {
+				auto ee = u->neighbours[stack.back().second++].edge;
+				if (ee == order[current].parent_edge) continue;
+				auto vv = ee->from;
+				if (vv == u) vv = ee->to;
+
+				if (vv->used) {
+					std::cerr << "ERROR: Vertex " << *vv << " already used in Topology Tree, underlying tree isn't acyclic!" << std::endl;
+					exit(1);
+				}
+				vv->used = true;
+				if (vv->degree > 3) {
+					vv = split_vertex(vv, ee);
+					vv->used = true;
+				}
+				order.push_back(entry{vv, ee, current, 1});
+				stack.push_back(std::make_pair(order.size() - 1, 0));
+			} else {
+				if (order[current].parent >= 0) order[order[current].parent].size += order[current].size;
+				stack.pop_back();
+			}
+		}
+	}
+
+	// 2. Create basic clusters (in parallel, continuous parts of the order are given to threads)
+	parallel_for(threads, order.size(), [&](size_t i) {
+		auto cluster = std::make_shared<TopologyCluster>(functions);
+		cluster->vertex = order[i].vertex;
+		cluster->construction_size = order[i].size;
+		order[i].vertex->topology_cluster = cluster;
+	});
+
+	// 3. Connect basic clusters by outer edges (edge to the parent is the last one as in the serial construction)
+	parallel_for(threads, order.size(), [&](size_t i) {
+		BaseTree::Internal::Vertex *v = order[i].vertex.get();
+		auto &cluster = v->topology_cluster;
+		for (const auto &n: v->neighbours) {
+			if (n.edge == order[i].parent_edge) continue;
+			BaseTree::Internal::Vertex *vv = (n.edge->from == v ? n.edge->to : n.edge->from);
+			cluster->outer_edges.push_back(TopologyCluster::neighbour{n.edge, vv->topology_cluster.get()});
+		}
+		if (order[i].parent >= 0) cluster->outer_edges.push_back(TopologyCluster::neighbour{order[i].parent_edge, order[order[i].parent].vertex->topology_cluster.get()});
+		cluster->outer_edges_count = cluster->outer_edges.size();
+	});
+
+	long long total_size = order.size();
+	std::vector<std::shared_ptr<TopologyCluster>> components;
+	for (int c: component_entries) components.push_back(order[c].vertex->topology_cluster);
+	order.clear();
+
+	// 5. Construct components: large ones one by one by all threads, then the others in parallel (each one by a single thread)
+	std::vector<std::shared_ptr<TopologyCluster>> roots(components.size());
+	std::vector<construction_lists> lists(threads);
+	auto is_large = [&](size_t i) { return components[i]->construction_size * threads >= total_size; };
+	for (size_t i = 0; i < components.size(); i++) {
+		if (is_large(i)) roots[i] = construct_component(components[i], &lists[0], threads);
+	}
+	std::atomic<size_t> next_component{0};
+	auto worker = [&](int t) {
+		for (size_t i = next_component++; i < components.size(); i = next_component++) {
+			if (!is_large(i)) roots[i] = construct_component(components[i], &lists[t], 1);
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++) workers.emplace_back(worker, t);
+	worker(0);
+	for (auto &w: workers) w.join();
+
+	// 6. Save roots and created clusters, they are joined afterwards (basic clusters are joined recursively from their parents)
+	for (const auto &root: roots) add_root(root);
+	for (auto &l: lists) splitted_clusters.insert(splitted_clusters.end(), l.splitted_clusters.begin(), l.splitted_clusters.end());
+}
+
 }
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <iostream>
+
+#include "TraceRecorder.hpp"
+#include "BaseTreeInternal.hpp"
+
+namespace TopTree {
+
+TraceRecorder::TraceRecorder(ITopTree *top_tree, const char *filename, int (*edge_value)(const std::shared_ptr<EdgeData> &edge_data)):
+	top_tree{top_tree}, edge_value{edge_value}
+{
+	file = fopen(filename, "wb");
+	if (file == NULL) {
+		std::cerr << "ERROR: Cannot open trace file " << filename << " for writing" << std::endl;
+		exit(1);
+	}
+
+	TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, TRACE_MAGIC);
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(TraceRecord);
+	fwrite(&header, sizeof(header), 1, file);
+}
+
+TraceRecorder::~TraceRecorder() {
+	if (fclose(file) != 0) std::cerr << "ERROR: Cannot write the trace file" << std::endl;
+	delete top_tree;
+}
+
+void TraceRecorder::write(TraceOp op, bool failed, int v, int w, int value) {
+	TraceRecord record{op, failed, 0, v, w, value};
+	if (fwrite(&record, sizeof(record), 1, file) != 1) {
+		std::cerr << "ERROR: Cannot write the trace file" << std::endl;
+		exit(1);
+	}
+	records++;
+}
+
+void TraceRecorder::InitFromBaseTree(std::shared_ptr<BaseTree> base_tree) {
+	// 1. Edges of the underlying tree and the number of vertices (before the top tree adds its own ones)
+	for (auto e: base_tree->internal->edges) {
+		write(TRACE_EDGE, false, e->from->index, e->to->index, edge_value == NULL ? 0 : edge_value(e->data));
+	}
+	write(TRACE_INIT, false, base_tree->internal->vertices.size(), 0);
+
+	// 2. Construct the top tree
+	top_tree->InitFromBaseTree(base_tree);
+}
+
+std::shared_ptr<ICluster> TraceRecorder::Expose(int v, int w) {
+	auto result = top_tree->Expose(v, w);
+	write(TRACE_EXPOSE, result == NULL, v, w);
+	return result;
+}
+
+std::shared_ptr<ICluster> TraceRecorder::QueryPath(int v, int w) {
+	auto result = top_tree->QueryPath(v, w);
+	write(TRACE_QUERY_PATH, result == NULL, v, w);
+	return result;
+}
+
+std::tuple<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>, std::shared_ptr<EdgeData>> TraceRecorder::Cut(int v, int w) {
+	auto result = top_tree->Cut(v, w);
+	write(TRACE_CUT, std::get<2>(result) == NULL, v, w);
+	return result;
+}
+
+std::shared_ptr<ICluster> TraceRecorder::Link(int v, int w, std::shared_ptr<EdgeData> edge_data) {
+	// Value is read before Link, user functions may change the edge data
+	int value = (edge_value == NULL ? 0 : edge_value(edge_data));
+	auto result = top_tree->Link(v, w, edge_data);
+	write(TRACE_LINK, result == NULL, v, w, value);
+	return result;
+}
+
+void TraceRecorder::Restore() {
+	top_tree->Restore();
+	write(TRACE_RESTORE, false, 0, 0);
+}
+
+std::pair<std::shared_ptr<ICluster>, std::shared_ptr<ICluster>> TraceRecorder::SplitRoot(std::shared_ptr<ICluster> root) {
+	return top_tree->SplitRoot(root);
+}
+
+}
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <iostream>
+#include <chrono>
+
+#include "examples/maximum_edge_weight.hpp"
+
+#include "TopologyTopTree.hpp"
+
+#define MAX_WEIGHT 10000
+
+// Batches of changes in a random tree: each batch cuts B random subtrees (edge to the parent)
+// and links them back to random vertices outside of them. The same changes are applied
+// by single Cut/Link operations and by ApplyBatch of the TopologyTopTree.
+// With maximal degree D <= 3 no vertex is ever splitted into subvertices, so all operations
+// of a batch are repaired together (otherwise some of them are done one by one).
+
+struct batch {
+	std::vector<std::pair<int, int>> cuts;
+	std::vector<std::pair<int, int>> links;
+	std::vector<int> weights;
+};
+
+std::vector<std::pair<int, int>> vertices; // pair(edge to, edge weight)
+std::vector<struct batch> batches;
+
+double run(bool use_batch, int N) {
+	// Init tree
+	auto base_tree = std::make_shared<TopTree::BaseTree>();
+	for (int i = 0; i < N; i++) base_tree->AddVertex(std::make_shared<MaxEdge::MyVertexData>(std::to_string(i)));
+	for (int i = 1; i < N; i++) base_tree->AddEdge(i, vertices[i].first, std::make_shared<MaxEdge::MyEdgeData>(i, vertices[i].second, ""));
+	auto top_tree = new MaxEdge::TopologyTopTree(base_tree);
+
+	// Start measure time and apply all batches
+	int operations = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (auto &b: batches) {
+		if (use_batch) {
+			std::vector<TopTree::TopologyTopTree::LinkRequest> links;
+			for (uint i = 0; i < b.links.size(); i++) {
+				links.push_back(TopTree::TopologyTopTree::LinkRequest{b.links[i].first, b.links[i].second, std::make_shared<MaxEdge::MyEdgeData>(0, b.weights[i], "")});
+			}
+			operations += top_tree->ApplyBatch(links, b.cuts);
+		} else {
+			for (auto c: b.cuts) {
+				if (std::get<2>(top_tree->Cut(c.first, c.second)) != NULL) operations++;
+			}
+			for (uint i = 0; i < b.links.size(); i++) {
+				if (top_tree->Link(b.links[i].first, b.links[i].second, std::make_shared<MaxEdge::MyEdgeData>(0, b.weights[i], "")) != NULL) operations++;
+			}
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	// Cleaning
+	delete(top_tree);
+
+	if (operations != 2 * (int) (batches.size() * batches[0].cuts.size())) {
+		std::cerr << "ERROR: Only " << operations << " operations succeeded" << std::endl;
+	}
+
+	auto execution_time = end - begin;
+	return ((long double) std::chrono::duration_cast<std::chrono::microseconds>(execution_time).count()) / operations;
+}
+
+int find_root(const std::vector<int> &parent, int v) {
+	while (parent[v] >= 0) v = parent[v];
+	return v;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 7) {
+		std::cerr << "Usage: " << argv[0] << " seed N B K D warmups" << std::endl;
+		return 1;
+	}
+	// Init random generator
+	auto seed = strtoull(argv[1], NULL, 16);
+	srand(seed);
+	// Get size of tree, size of batch, number of batches, maximal degree (0 = unlimited) and number of warmups
+	int N = atoi(argv[2]);
+	int B = atoi(argv[3]);
+	int K = atoi(argv[4]);
+	int D = atoi(argv[5]);
+	int W = atoi(argv[6]);
+	if (B < 1 || B >= N) {
+		std::cerr << "Size of batch must be between 1 and N-1" << std::endl;
+		return 1;
+	}
+	if (D == 1 || D == 2) {
+		std::cerr << "Maximal degree must be at least 3 (or 0 for unlimited)" << std::endl;
+		return 1;
+	}
+	if (D == 0) D = N;
+
+	// Generate tree and list of batches
+	// a) original tree = each vertex is connected to one with lower number (which has free degree)
+	std::vector<int> parent(N, -1);
+	std::vector<int> degree(N, 0);
+	vertices.push_back(std::pair<int,int>(0,0));
+	for (int i = 1; i < N; i++) {
+		do parent[i] = rand() % i; while (degree[parent[i]] >= D);
+		degree[i]++;
+		degree[parent[i]]++;
+		vertices.push_back(std::pair<int,int>(parent[i], rand() % MAX_WEIGHT));
+	}
+	// b) batches: cut B different subtrees and link each of them to a vertex outside of it
+	std::vector<int> last_batch(N, -1);
+	for (int k = 0; k < K; k++) {
+		struct batch b;
+		while ((int) b.cuts.size() < B) {
+			int v = 1 + rand() % (N - 1);
+			if (parent[v] < 0 || last_batch[v] == k) continue;
+			last_batch[v] = k;
+			b.cuts.push_back(std::make_pair(v, parent[v]));
+			degree[v]--;
+			degree[parent[v]]--;
+			parent[v] = -1;
+		}
+		for (auto c: b.cuts) {
+			int u;
+			do u = rand() % N; while (degree[u] >= D || find_root(parent, u) == c.first);
+			parent[c.first] = u;
+			degree[c.first]++;
+			degree[u]++;
+			b.links.push_back(std::make_pair(c.first, u));
+			b.weights.push_back(rand() % MAX_WEIGHT);
+		}
+		batches.push_back(b);
+	}
+
+	// Run both variants
+	for (int i = 0; i < W; i++) run(false, N);
+	auto time_single = run(false, N);
+	for (int i = 0; i < W; i++) run(true, N);
+	auto time_batch = run(true, N);
+
+	// Microseconds per operation (cut or link) for single operations and for batches
+	std::cout << time_single << " " << time_batch << std::endl;
+}
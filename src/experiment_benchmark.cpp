@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "examples/maximum_edge_weight.hpp"
+#include "LatencyHistogram.hpp"
+#include "TraceRecorder.hpp"
+#include "TreeGenerator.hpp"
+
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
+
+#define TopTree SplayTopTree
+#include "../top-trees/include/add_weight_cluster.hpp"
+#undef TopTree
+
+using SplayMaxPath = MaxPathTopTree;
+using SplayMaxEdge = Edge<AddWeightCluster,int,None>;
+
+#define MAX_WEIGHT 10000
+
+// Benchmark of all three implementations (self-adjusting top trees, topology top trees and splay top trees from the
+// top-trees library) on the maximum edge weight problem. Every scenario is given by a tree shape, a mix of operations
+// and a size; the tree and the operations are generated once and replayed on all implementations. Vertex i > 0 has
+// always a parent with lower number, so changes of the tree move a vertex to a new parent (cut + link) and the tree
+// stays connected. Each operation is timed separately (steady_clock) into the histogram of its type and percentiles
+// are printed as JSON or CSV. When built with make STATISTICS=1 the counters of the top trees (ITopTree::GetStatistics)
+// summed over the measured runs are printed too (in CSV as rows with the name of the counter instead of the operation).
+// With --record the calls of one run of the scenario on STTopTree are written into a trace for experiment_replay.
+
+enum opType { CUT, LINK, GET_WEIGHT, ADD_WEIGHT, INIT, OP_TYPES };
+const char *op_names[OP_TYPES] = {"cut", "link", "query", "update", "init"};
+
+struct operation {
+	opType op; // CUT (followed by LINK of the same vertex), GET_WEIGHT or ADD_WEIGHT
+	int vertex_a;
+	int vertex_b; // new parent for the CUT
+	int weight;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Scenarios
+
+// Tree shapes (see TreeGenerator), their index is a part of the seed of each scenario
+const std::vector<TopTree::TreeGenerator::Shape> &shapes = TopTree::TreeGenerator::GetShapes();
+
+// Percents of the tree changes and of the queries (the rest are updates of weights on paths)
+struct mix {
+	const char *name;
+	int changes;
+	int queries;
+};
+
+const std::vector<mix> mixes = {
+	{"mixed", 66, 17}, // as in experiment_edge_weight
+	{"queries", 10, 80},
+	{"changes", 90, 5},
+};
+
+std::vector<int> parents; // initial tree
+std::vector<int> weights; // weights of the initial edges
+std::vector<struct operation> operations;
+
+void generate(const TopTree::TreeGenerator::Shape &s, const mix &m, int N, int K, std::mt19937_64 &random) {
+	TopTree::TreeGenerator generator(s, N, random);
+	parents.assign(N, 0);
+	weights.assign(N, 0);
+	for (int i = 1; i < N; i++) {
+		parents[i] = generator.AddVertex(i);
+		weights[i] = random() % MAX_WEIGHT;
+	}
+
+	operations.clear();
+	for (int i = 0; i < K; i++) {
+		int type = random() % 100;
+		if (type < m.changes) {
+			int v = 1 + random() % (N - 1);
+			operations.push_back(operation{CUT, v, generator.GetParent(v), (int) (random() % MAX_WEIGHT)});
+		} else {
+			int a = random() % N;
+			int b = random() % (N - 1);
+			if (b >= a) b++;
+			operations.push_back(operation{type < m.changes + m.queries ? GET_WEIGHT : ADD_WEIGHT, a, b, (int) (random() % MAX_WEIGHT)});
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Implementations
+
+// Latencies of operations in nanoseconds (init is measured per vertex)
+struct samples {
+	TopTree::LatencyHistogram op[OP_TYPES];
+	std::vector<std::pair<std::string, long long>> statistics; // counters of the operations (without initialization)
+};
+
+class Implementation {
+public:
+	virtual ~Implementation() {}
+	virtual const char *name() const = 0;
+
+	virtual void init(int N) = 0;
+	virtual void cut(int v, int parent) = 0;
+	virtual void link(int v, int parent, int weight) = 0;
+	virtual void query(int a, int b) = 0;
+	virtual void update(int a, int b, int weight) = 0;
+	virtual void clear() = 0;
+	virtual std::vector<std::pair<std::string, long long>> get_statistics() const { return {}; }
+
+	// Replays all operations on a new tree, latencies are added to the samples (when given)
+	void run(int N, samples *result) {
+		std::vector<int> parent = parents;
+
+		auto begin = std::chrono::steady_clock::now();
+		init(N);
+		auto end = std::chrono::steady_clock::now();
+		if (result != NULL) result->op[INIT].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / N);
+
+		for (auto op: operations) {
+			begin = std::chrono::steady_clock::now();
+			switch (op.op) {
+			case CUT:
+				cut(op.vertex_a, parent[op.vertex_a]);
+				end = std::chrono::steady_clock::now();
+				if (result != NULL) result->op[CUT].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+				begin = std::chrono::steady_clock::now();
+				link(op.vertex_a, op.vertex_b, op.weight);
+				parent[op.vertex_a] = op.vertex_b;
+				op.op = LINK;
+				break;
+			case GET_WEIGHT:
+				query(op.vertex_a, op.vertex_b);
+				break;
+			case ADD_WEIGHT:
+				update(op.vertex_a, op.vertex_b, op.weight);
+				break;
+			default:
+				break;
+			}
+			end = std::chrono::steady_clock::now();
+			if (result != NULL) result->op[op.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+		}
+
+		if (result != NULL) {
+			auto counters = get_statistics();
+			if (result->statistics.empty()) result->statistics = counters;
+			else for (size_t i = 0; i < counters.size(); i++) result->statistics[i].second += counters[i].second;
+		}
+		clear();
+	}
+};
+
+// Value of edges in the recorded traces
+int edge_weight(const std::shared_ptr<TopTree::EdgeData> &edge_data) {
+	return std::static_pointer_cast<MaxEdge::MyEdgeData>(edge_data)->weight;
+}
+
+// STTopTree or TopologyTopTree (constructed from the whole initial tree), calls are recorded into the trace when given
+template<class T>
+class TopTreeImplementation: public Implementation {
+public:
+	TopTreeImplementation(const char *label, const char *trace = NULL): label{label}, trace{trace} {}
+	const char *name() const { return label; }
+
+	void init(int N) {
+		top_tree = new T();
+		if (trace != NULL) worker = new MaximumEdgeWeight(new TopTree::TraceRecorder(top_tree, trace, edge_weight));
+		else worker = new MaximumEdgeWeight(top_tree);
+		for (int i = 0; i < N; i++) worker->add_vertex(std::to_string(i));
+		for (int i = 1; i < N; i++) worker->add_edge(i, parents[i], weights[i]);
+		worker->initialize();
+		top_tree->ResetStatistics();
+	}
+	void cut(int v, int parent) {
+		if (!worker->remove_edge(v, parent)) {
+			std::cerr << "ERROR: Problem during removing edge " << v << "-" << parent << " in " << label << std::endl;
+			exit(1);
+		}
+	}
+	void link(int v, int parent, int weight) {
+		if (worker->add_edge(v, parent, weight) < 0) {
+			std::cerr << "ERROR: Problem during adding edge " << v << "-" << parent << " in " << label << std::endl;
+			exit(1);
+		}
+	}
+	void query(int a, int b) { worker->get_max_weight_on_path(a, b); }
+	void update(int a, int b, int weight) { worker->add_weight_on_path(a, b, weight); }
+	void clear() {
+		delete worker; // deletes the top tree too
+		worker = NULL;
+		top_tree = NULL;
+	}
+	std::vector<std::pair<std::string, long long>> get_statistics() const { return top_tree->GetStatistics(); }
+private:
+	const char *label;
+	const char *trace;
+	T *top_tree = NULL;
+	MaximumEdgeWeight *worker = NULL;
+};
+
+// Splay top trees from the top-trees library (initial tree is linked edge by edge)
+class SplayImplementation: public Implementation {
+public:
+	const char *name() const { return "splay"; }
+
+	void init(int N) {
+		tree = new SplayMaxPath(N);
+		edges.assign(N, NULL);
+		for (int i = 1; i < N; i++) edges[i] = tree->link_ptr(i, parents[i], weights[i]);
+	}
+	void cut(int v, int parent) {
+		tree->cut_ptr(edges[v]);
+		edges[v] = NULL;
+	}
+	void link(int v, int parent, int weight) { edges[v] = tree->link_ptr(v, parent, weight); }
+	void query(int a, int b) {
+		tree->expose(a);
+		tree->expose(b);
+		tree->deexpose(a);
+		tree->deexpose(b);
+	}
+	void update(int a, int b, int weight) {
+		auto c1 = tree->expose(a);
+		auto c2 = tree->expose(b);
+		if (c1 == c2 && c1 && c2) c1->add_weight(weight);
+		tree->deexpose(a);
+		tree->deexpose(b);
+	}
+	void clear() {
+		delete tree;
+		tree = NULL;
+	}
+private:
+	SplayMaxPath *tree = NULL;
+	std::vector<SplayMaxEdge*> edges; // to the parent of each vertex
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Output
+
+struct statistics {
+	uint64_t count = 0;
+	double mean = 0;
+	double p50 = 0;
+	double p90 = 0;
+	double p99 = 0;
+	double p999 = 0;
+	double max = 0;
+};
+
+// Statistics in microseconds
+statistics get_statistics(const TopTree::LatencyHistogram &histogram) {
+	statistics s;
+	s.count = histogram.count();
+	s.mean = histogram.mean() / 1000.0;
+	s.p50 = histogram.percentile(0.5) / 1000.0;
+	s.p90 = histogram.percentile(0.9) / 1000.0;
+	s.p99 = histogram.percentile(0.99) / 1000.0;
+	s.p999 = histogram.percentile(0.999) / 1000.0;
+	s.max = histogram.max() / 1000.0;
+	return s;
+}
+
+enum outputFormat { JSON, CSV };
+
+void print_result(outputFormat format, bool first, const char *implementation, const TopTree::TreeGenerator::Shape &s, const mix &m, int N, int repetitions, samples &result) {
+	if (format == CSV) {
+		for (int i = 0; i < OP_TYPES; i++) {
+			auto st = get_statistics(result.op[i]);
+			std::cout << implementation << "," << s.name << "," << m.name << "," << N << "," << repetitions << "," << op_names[i] << ","
+				<< st.count << "," << st.mean << "," << st.p50 << "," << st.p90 << "," << st.p99 << "," << st.p999 << "," << st.max << std::endl;
+		}
+		for (auto &counter: result.statistics) {
+			std::cout << implementation << "," << s.name << "," << m.name << "," << N << "," << repetitions << "," << counter.first << ","
+				<< counter.second << ",,,,,," << std::endl;
+		}
+	} else {
+		if (!first) std::cout << "," << std::endl;
+		std::cout << "  {\"implementation\": \"" << implementation << "\", \"shape\": \"" << s.name << "\", \"mix\": \"" << m.name
+			<< "\", \"size\": " << N << ", \"repetitions\": " << repetitions << ", \"ops\": {";
+		for (int i = 0; i < OP_TYPES; i++) {
+			auto st = get_statistics(result.op[i]);
+			std::cout << (i == 0 ? "" : ",") << std::endl << "    \"" << op_names[i] << "\": {\"count\": " << st.count << ", \"mean_us\": " << st.mean
+				<< ", \"p50_us\": " << st.p50 << ", \"p90_us\": " << st.p90 << ", \"p99_us\": " << st.p99 << ", \"p999_us\": " << st.p999 << ", \"max_us\": " << st.max << "}";
+		}
+		std::cout << std::endl << "  }";
+		if (!result.statistics.empty()) {
+			std::cout << ", \"statistics\": {";
+			for (size_t i = 0; i < result.statistics.size(); i++) {
+				std::cout << (i == 0 ? "" : ", ") << "\"" << result.statistics[i].first << "\": " << result.statistics[i].second;
+			}
+			std::cout << "}";
+		}
+		std::cout << "}";
+	}
+}
+
+void usage(const char *program) {
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+		<< "  --seed S            seed of the random generator (hexadecimal, default 0)" << std::endl
+		<< "  --shape NAME        tree shape, can be repeated (default random):";
+	for (auto &s: shapes) std::cerr << " " << s.name;
+	std::cerr << " all" << std::endl
+		<< "  --mix NAME          mix of operations, can be repeated (default mixed):";
+	for (auto &m: mixes) std::cerr << " " << m.name;
+	std::cerr << " all" << std::endl
+		<< "  --size N            number of vertices, can be repeated (default 10000)" << std::endl
+		<< "  --ops K             number of operations (default 10000)" << std::endl
+		<< "  --warmup W          not measured runs of each implementation (default 1)" << std::endl
+		<< "  --repetitions R     measured runs of each implementation (default 3)" << std::endl
+		<< "  --implementation I  implementation, can be repeated (default all): top topology splay" << std::endl
+		<< "  --format F          output format: json (default) or csv" << std::endl
+		<< "  --record FILE       record calls of the (only) scenario into the trace file (see experiment_replay)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long long seed = 0;
+	std::vector<int> selected_shapes; // indices into shapes
+	std::vector<int> selected_mixes; // indices into mixes
+	std::vector<int> sizes;
+	int K = 10000;
+	int W = 1;
+	int R = 3;
+	std::vector<std::string> selected_implementations;
+	outputFormat format = JSON;
+	const char *trace = NULL;
+
+	// 1. Parse arguments
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		if (!strcmp(argv[i - 1], "--seed")) seed = strtoull(value, NULL, 16);
+		else if (!strcmp(argv[i - 1], "--shape")) {
+			for (uint s = 0; s < shapes.size(); s++) if (!strcmp(value, shapes[s].name) || !strcmp(value, "all")) selected_shapes.push_back(s);
+		} else if (!strcmp(argv[i - 1], "--mix")) {
+			for (uint m = 0; m < mixes.size(); m++) if (!strcmp(value, mixes[m].name) || !strcmp(value, "all")) selected_mixes.push_back(m);
+		} else if (!strcmp(argv[i - 1], "--size")) sizes.push_back(atoi(value));
+		else if (!strcmp(argv[i - 1], "--ops")) K = atoi(value);
+		else if (!strcmp(argv[i - 1], "--warmup")) W = atoi(value);
+		else if (!strcmp(argv[i - 1], "--repetitions")) R = atoi(value);
+		else if (!strcmp(argv[i - 1], "--implementation")) selected_implementations.push_back(value);
+		else if (!strcmp(argv[i - 1], "--format") && !strcmp(value, "json")) format = JSON;
+		else if (!strcmp(argv[i - 1], "--format") && !strcmp(value, "csv")) format = CSV;
+		else if (!strcmp(argv[i - 1], "--record")) trace = value;
+		else {
+			std::cerr << "Unknown argument " << argv[i - 1] << " " << value << std::endl;
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (selected_shapes.empty()) selected_shapes.push_back(0);
+	if (selected_mixes.empty()) selected_mixes.push_back(0);
+	if (sizes.empty()) sizes.push_back(10000);
+	if (trace != NULL && selected_shapes.size() * selected_mixes.size() * sizes.size() != 1) {
+		std::cerr << "Only one scenario can be recorded" << std::endl;
+		return 1;
+	}
+	for (int N: sizes) {
+		if (N < 3) {
+			std::cerr << "At least three vertices are needed" << std::endl;
+			return 1;
+		}
+	}
+
+	// 2. Prepare implementations
+	std::vector<Implementation*> implementations;
+	auto selected = [&selected_implementations](const char *name) {
+		return selected_implementations.empty() || std::find(selected_implementations.begin(), selected_implementations.end(), name) != selected_implementations.end();
+	};
+	if (selected("top")) implementations.push_back(new TopTreeImplementation<MaxEdge::STTopTree>("top"));
+	if (selected("topology")) implementations.push_back(new TopTreeImplementation<MaxEdge::TopologyTopTree>("topology"));
+	if (selected("splay")) implementations.push_back(new SplayImplementation());
+
+	// 3. Run all scenarios (each of them has its own random generator, so it does not depend on the others)
+	bool first = true;
+	if (format == JSON) std::cout << "[" << std::endl;
+	else std::cout << "implementation,shape,mix,size,repetitions,op,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us" << std::endl;
+	for (int s: selected_shapes) {
+		for (int m: selected_mixes) {
+			for (int N: sizes) {
+				std::seed_seq seeds{seed, (unsigned long long) s, (unsigned long long) m, (unsigned long long) N};
+				std::mt19937_64 random(seeds);
+				generate(shapes[s], mixes[m], N, K, random);
+				if (trace != NULL) TopTreeImplementation<MaxEdge::STTopTree>("top", trace).run(N, NULL);
+
+				for (auto implementation: implementations) {
+					samples result;
+					for (int i = 0; i < W; i++) implementation->run(N, NULL);
+					for (int i = 0; i < R; i++) implementation->run(N, &result);
+					print_result(format, first, implementation->name(), shapes[s], mixes[m], N, R, result);
+					first = false;
+				}
+			}
+		}
+	}
+	if (format == JSON) std::cout << std::endl << "]" << std::endl;
+
+	for (auto implementation: implementations) delete implementation;
+}
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <iostream>
+#include <chrono>
+
+#include "examples/maximum_edge_weight.hpp"
+
+#include "TopologyTopTree.hpp"
+
+#define MAX_WEIGHT 10000
+
+// Cuts and links on long paths and caterpillars (path with one leaf at every vertex) in the TopologyTopTree. Every
+// operation repairs clusters on all levels above the changed edge, so most of the time is spent by calculating the
+// outer edges of clusters. Each cut is followed by linking the same edge back (with a new weight), the expose
+// operations add weight on paths between random vertices.
+
+enum opType { CUT_LINK, EXPOSE };
+struct operation {
+	opType op;
+	int vertex_a;
+	int vertex_b;
+	int weight;
+};
+
+struct result {
+	double change_time; // microseconds per cut or link
+	double expose_time; // microseconds per expose
+	long long checksum; // sum of maximums on the paths at the end
+};
+
+std::vector<std::pair<int, int>> edges;
+std::vector<int> weights;
+std::vector<struct operation> operations;
+std::vector<std::pair<int, int>> queries;
+
+result run(int N) {
+	auto worker = new MaximumEdgeWeight(new MaxEdge::TopologyTopTree());
+	for (int i = 0; i < N; i++) worker->add_vertex(std::to_string(i));
+	for (uint i = 0; i < edges.size(); i++) worker->add_edge(edges[i].first, edges[i].second, weights[i]);
+	worker->initialize();
+
+	int changes = 0;
+	int exposes = 0;
+	std::chrono::steady_clock::duration change_time(0);
+	std::chrono::steady_clock::duration expose_time(0);
+	for (auto op: operations) {
+		auto begin = std::chrono::steady_clock::now();
+		if (op.op == CUT_LINK) {
+			worker->remove_edge(op.vertex_a, op.vertex_b);
+			worker->add_edge(op.vertex_a, op.vertex_b, op.weight);
+			change_time += std::chrono::steady_clock::now() - begin;
+			changes += 2;
+		} else {
+			worker->add_weight_on_path(op.vertex_a, op.vertex_b, op.weight);
+			expose_time += std::chrono::steady_clock::now() - begin;
+			exposes++;
+		}
+	}
+
+	long long checksum = 0;
+	for (auto q: queries) checksum += worker->get_max_weight_on_path(q.first, q.second).max_weight;
+	delete worker;
+
+	return result{
+		changes == 0 ? 0 : ((double) std::chrono::duration_cast<std::chrono::nanoseconds>(change_time).count()) / changes / 1000,
+		exposes == 0 ? 0 : ((double) std::chrono::duration_cast<std::chrono::nanoseconds>(expose_time).count()) / exposes / 1000,
+		checksum
+	};
+}
+
+void generate_operations(int N, int K, int E) {
+	operations.clear();
+	queries.clear();
+	for (int i = 0; i < K; i++) {
+		if (rand() % 100 < E) {
+			int a = rand() % N;
+			int b = rand() % (N - 1);
+			if (b >= a) b++;
+			operations.push_back(operation{EXPOSE, a, b, rand() % MAX_WEIGHT});
+		} else {
+			auto e = edges[rand() % edges.size()];
+			operations.push_back(operation{CUT_LINK, e.first, e.second, rand() % MAX_WEIGHT});
+		}
+	}
+	for (int i = 0; i < 100; i++) queries.push_back(std::make_pair(rand() % (N / 2), N / 2 + rand() % (N - N / 2)));
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 5) {
+		std::cerr << "Usage: " << argv[0] << " seed N K E" << std::endl;
+		return 1;
+	}
+	// Init random generator
+	auto seed = strtoull(argv[1], NULL, 16);
+	srand(seed);
+	// Number of vertices, number of operations and percent of expose operations
+	int N = atoi(argv[2]);
+	int K = atoi(argv[3]);
+	int E = atoi(argv[4]);
+	if (N < 4) {
+		std::cerr << "At least four vertices are needed" << std::endl;
+		return 1;
+	}
+
+	// a) path 0 - 1 - ... - (N-1)
+	for (int i = 0; i < N - 1; i++) {
+		edges.push_back(std::make_pair(i, i + 1));
+		weights.push_back(rand() % MAX_WEIGHT);
+	}
+	generate_operations(N, K, E);
+	auto path = run(N);
+
+	// b) caterpillar: path of the first half of vertices, each of them with one leaf from the second half
+	edges.clear();
+	weights.clear();
+	int S = N / 2;
+	for (int i = 0; i < S - 1; i++) {
+		edges.push_back(std::make_pair(i, i + 1));
+		weights.push_back(rand() % MAX_WEIGHT);
+	}
+	for (int i = S; i < N; i++) {
+		edges.push_back(std::make_pair(i, (i - S) % S));
+		weights.push_back(rand() % MAX_WEIGHT);
+	}
+	generate_operations(N, K, E);
+	auto caterpillar = run(N);
+
+	// Time per cut/link and per expose on the path and on the caterpillar, checksums
+	std::cout << path.change_time << " " << path.expose_time << " " << caterpillar.change_time << " " << caterpillar.expose_time
+		<< " " << path.checksum << " " << caterpillar.checksum << std::endl;
+}
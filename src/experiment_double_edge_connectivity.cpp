@@ -4,6 +4,8 @@
 #include <chrono>
 
 #include "examples/double_edge_connectivity.hpp"
+#include "LatencyHistogram.hpp"
+#include "TreeGenerator.hpp"
 
 #include "STTopTree.hpp"
 #include "TopologyTopTree.hpp"
@@ -40,10 +42,18 @@ struct operation getRandomOp(int N, double R) {
 std::vector<std::pair<int, int>> initial_edges; // pair(edge to, edge weight)
 std::vector<struct operation> operations;
 
+// Counters of the top tree (only when built with make STATISTICS=1), printed to stderr so that the output stays the same
+void print_statistics(const char *name, const std::vector<std::pair<std::string, long long>> &statistics) {
+	if (statistics.empty()) return;
+	std::cerr << name << ":";
+	for (auto &counter: statistics) std::cerr << " " << counter.first << "=" << counter.second;
+	std::cerr << std::endl;
+}
 
-std::tuple<double, double> run(DoubleConnectivity *worker, uint N, uint M) {
+// Latency of every operation is recorded into the histogram of its type (when given)
+std::tuple<double, double> run(DoubleConnectivity *worker, uint N, uint M, TopTree::LatencyHistogram *histograms = NULL) {
 	// Vector for indexing edges
-	std::vector<std::shared_ptr<MyEdgeData>> edges;
+	std::vector<std::shared_ptr<DoubleEdge::MyEdgeData>> edges;
 
 	// Init graph
 	auto begin = std::chrono::system_clock::now();
@@ -63,6 +73,8 @@ std::tuple<double, double> run(DoubleConnectivity *worker, uint N, uint M) {
 	begin = std::chrono::system_clock::now();
 	int op_skipped = 0;
 	for (auto op: operations) {
+		std::chrono::steady_clock::time_point op_begin; // only when latencies are recorded (clock reads are not free)
+		if (histograms != NULL) op_begin = std::chrono::steady_clock::now();
 		switch (op.op) {
 		case INSERT: {
 			if (op.vertex_a == op.vertex_b) {
@@ -97,6 +109,7 @@ std::tuple<double, double> run(DoubleConnectivity *worker, uint N, uint M) {
 			#endif
 		break;}
 		}
+		if (histograms != NULL) histograms[op.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - op_begin).count());
 	}
 	end = std::chrono::system_clock::now();
 	auto execution_time = end-begin;
@@ -110,7 +123,7 @@ std::tuple<double, double> run(DoubleConnectivity *worker, uint N, uint M) {
 		((long double) std::chrono::duration_cast<std::chrono::microseconds>(execution_time).count()) / op_count);
 }
 
-std::tuple<double, double> run_splay(uint N, uint M) {
+std::tuple<double, double> run_splay(uint N, uint M, TopTree::LatencyHistogram *histograms = NULL) {
 	// Vector for indexing edges
 	std::vector<std::shared_ptr<EdgeData>> edges;
 
@@ -134,6 +147,8 @@ std::tuple<double, double> run_splay(uint N, uint M) {
 	int i = 0;
 	int op_skipped = 0;
 	for (auto op: operations) {
+		std::chrono::steady_clock::time_point op_begin;
+		if (histograms != NULL) op_begin = std::chrono::steady_clock::now();
 		switch (op.op) {
 		case INSERT: {
 	
@@ -164,6 +179,7 @@ std::tuple<double, double> run_splay(uint N, uint M) {
 			auto result = tree.two_edge_connected(op.vertex_a, op.vertex_b);
 		break;}
 		}
+		if (histograms != NULL) histograms[op.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - op_begin).count());
 	}
 	end = std::chrono::system_clock::now();
 	auto execution_time = end-begin;
@@ -175,6 +191,11 @@ std::tuple<double, double> run_splay(uint N, uint M) {
 }
 
 
+// Tail latencies (microseconds) of all types of operations
+void print_tail_latencies(const TopTree::LatencyHistogram *histograms) {
+	for (int i = 0; i < OPS_COUNT; i++) std::cout << " " << histograms[i].percentile(0.99) / 1000.0 << " " << histograms[i].percentile(0.999) / 1000.0;
+}
+
 int main(int argc, char const *argv[]) {
 	// Init random generator
 	auto seed = strtoull(argv[1], NULL, 16);
@@ -186,26 +207,46 @@ int main(int argc, char const *argv[]) {
 	int W = atoi(argv[5]);
 	double R = atof(argv[6]);
 	int enable_setnicka = atoi(argv[7]);
+	// Optional shape of the spanning tree of the original graph (see TreeGenerator), only random edges when not given
+	const TopTree::TreeGenerator::Shape *shape = NULL;
+	if (argc > 8 && (shape = TopTree::TreeGenerator::FindShape(argv[8])) == NULL) {
+		std::cerr << "Unknown shape " << argv[8] << ", known shapes:";
+		for (auto &s: TopTree::TreeGenerator::GetShapes()) std::cerr << " " << s.name;
+		std::cerr << std::endl;
+		return 1;
+	}
 
-	// Generate tree and list of operations
-	// a) original graph = each vertex is connected to one with lower number
-	for (int i = 0; i < M; i++) initial_edges.push_back(std::pair<int,int>(rand() % N, rand() % N));
+	// Generate graph and list of operations
+	// a) original graph = edges of the tree of the given shape (if any) and random edges up to M edges
+	if (shape != NULL) {
+		std::mt19937_64 random(seed);
+		TopTree::TreeGenerator generator(*shape, N, random);
+		for (int i = 1; i < N && (int) initial_edges.size() < M; i++) initial_edges.push_back(std::pair<int,int>(i, generator.AddVertex(i)));
+	}
+	while ((int) initial_edges.size() < M) initial_edges.push_back(std::pair<int,int>(rand() % N, rand() % N));
 	// b) operations (type and two vertices)
 	for (int i = 0; i < K; i++) operations.push_back(getRandomOp(N, R));
 
-	//Run both implementations
+	//Run both implementations (histograms are filled only by the measured runs)
+	TopTree::LatencyHistogram top_tree_histograms[OPS_COUNT];
+	TopTree::LatencyHistogram topology_top_tree_histograms[OPS_COUNT];
+	TopTree::LatencyHistogram splay_top_tree_histograms[OPS_COUNT];
 	auto time_top_tree = std::tuple<double,double>(0, 0);
 	auto time_topology_top_tree = std::tuple<double,double>(0, 0);
 	if (enable_setnicka) {
 		for (int i = 0; i < W; i++) {
-			run(new DoubleConnectivity(std::make_shared<TopTree::STTopTree>()), N, M);
+			run(new DoubleConnectivity(std::make_shared<DoubleEdge::STTopTree>()), N, M);
 		}
-		time_top_tree = run(new DoubleConnectivity(std::make_shared<TopTree::STTopTree>()), N, M);
+		auto top_tree = std::make_shared<DoubleEdge::STTopTree>();
+		time_top_tree = run(new DoubleConnectivity(top_tree), N, M, top_tree_histograms);
+		print_statistics("top", top_tree->GetStatistics());
 
 		for (int i = 0; i < W; i++) {
-			run(new DoubleConnectivity(std::make_shared<TopTree::TopologyTopTree>()), N, M);
+			run(new DoubleConnectivity(std::make_shared<DoubleEdge::TopologyTopTree>()), N, M);
 		}
-		time_topology_top_tree = run(new DoubleConnectivity(std::make_shared<TopTree::TopologyTopTree>()), N, M);
+		auto topology_top_tree = std::make_shared<DoubleEdge::TopologyTopTree>();
+		time_topology_top_tree = run(new DoubleConnectivity(topology_top_tree), N, M, topology_top_tree_histograms);
+		print_statistics("topology", topology_top_tree->GetStatistics());
 	}
 
 
@@ -213,11 +254,16 @@ int main(int argc, char const *argv[]) {
 		run_splay(N,M);
 	}
 	auto time_splay_top_tree = std::tuple<double,double>(0, 0);
-	time_splay_top_tree = run_splay(N,M);
+	time_splay_top_tree = run_splay(N,M, splay_top_tree_histograms);
 
 	std::cout << std::get<0>(time_top_tree) << " " << std::get<1>(time_top_tree) << " "
 		<< std::get<0>(time_topology_top_tree) << " " << std::get<1>(time_topology_top_tree) << " " 
-		<< std::get<0>(time_splay_top_tree) << " " << std::get<1>(time_splay_top_tree) << std::endl;
+		<< std::get<0>(time_splay_top_tree) << " " << std::get<1>(time_splay_top_tree);
+	// p99 and p999 of INSERT, DELETE and QUERY for each implementation (zeros when not run)
+	print_tail_latencies(top_tree_histograms);
+	print_tail_latencies(topology_top_tree_histograms);
+	print_tail_latencies(splay_top_tree_histograms);
+	std::cout << std::endl;
 
 	return 0;
 }
@@ -4,6 +4,8 @@
 #include <ctime>
 
 #include "examples/maximum_edge_weight.hpp"
+#include "LatencyHistogram.hpp"
+#include "TreeGenerator.hpp"
 
 #include "STTopTree.hpp"
 #include "TopologyTopTree.hpp"
@@ -31,7 +33,17 @@ struct operation {
 std::vector<std::pair<int, int>> vertices; // pair(edge to, edge weight)
 std::vector<struct operation> operations;
 
-std::pair<double, double> run(MaximumEdgeWeight *worker, int N) {
+// Counters of the top tree (only when built with make STATISTICS=1), printed to stderr so that the output stays the same
+void print_statistics(const char *name, const std::vector<std::pair<std::string, long long>> &statistics) {
+	if (statistics.empty()) return;
+	std::cerr << name << ":";
+	for (auto &counter: statistics) std::cerr << " " << counter.first << "=" << counter.second;
+	std::cerr << std::endl;
+}
+
+// Latency of every operation is recorded into the histogram of its type (when given), counters of the top tree are
+// printed when the name is given
+std::pair<double, double> run(MaximumEdgeWeight *worker, int N, TopTree::LatencyHistogram *histograms = NULL, const char *name = NULL) {
 	// Vector for indexing edges
 	std::vector<std::pair<int, int>> edges;
 	
@@ -56,6 +68,8 @@ std::pair<double, double> run(MaximumEdgeWeight *worker, int N) {
 	begin = std::chrono::system_clock::now();
 	int op_skipped = 0;
 	for (auto op: operations) {
+		std::chrono::steady_clock::time_point op_begin; // only when latencies are recorded (clock reads are not free)
+		if (histograms != NULL) op_begin = std::chrono::steady_clock::now();
 		switch (op.op) {
 		case ADD_EDGE: {
 			int weight = op.param % MAX_WEIGHT;
@@ -101,10 +115,12 @@ std::pair<double, double> run(MaximumEdgeWeight *worker, int N) {
 			#endif
 		break;}
 		}
+		if (histograms != NULL) histograms[op.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - op_begin).count());
 	}
 	end = std::chrono::system_clock::now();
 
 	// Cleaning
+	if (name != NULL) print_statistics(name, worker->get_top_tree()->GetStatistics());
 	delete(worker);
 
 	int op_count = operations.size() - op_skipped;
@@ -115,7 +131,23 @@ std::pair<double, double> run(MaximumEdgeWeight *worker, int N) {
 	//return std::make_pair(init_time, execution_time);
 }
 
-std::pair<double, double> run_splay(int N) {
+// Construction of the top tree from the whole underlying tree (by the given number of threads), returns time per vertex
+template<class T>
+double run_construction(int N, int threads) {
+	auto base_tree = std::make_shared<TopTree::BaseTree>();
+	for (int i = 0; i < N; i++) base_tree->AddVertex(std::make_shared<MaxEdge::MyVertexData>(std::to_string(i)));
+	for (int i = 1; i < N; i++) base_tree->AddEdge(i, vertices[i].first, std::make_shared<MaxEdge::MyEdgeData>(i, vertices[i].second, ""));
+	auto top_tree = new T();
+
+	auto begin = std::chrono::steady_clock::now();
+	top_tree->InitFromBaseTree(base_tree, threads);
+	auto end = std::chrono::steady_clock::now();
+
+	delete(top_tree);
+	return ((long double) std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) / N;
+}
+
+std::pair<double, double> run_splay(int N, TopTree::LatencyHistogram *histograms = NULL) {
 	std::vector<std::pair<int,int>> edges;
 	std::vector<SplayMaxEdge*> edge_ptrs;
 	std::vector<std::vector<std::pair<int,int>>> adjacency_list;
@@ -152,6 +184,8 @@ std::pair<double, double> run_splay(int N) {
 	int op_skipped = 0;
 	int i = 0;
 	for (auto op : operations) {
+		std::chrono::steady_clock::time_point op_begin;
+		if (histograms != NULL) op_begin = std::chrono::steady_clock::now();
 		switch (op.op) {
 		case ADD_EDGE: {
 			//std::cerr << "Adding edge: (" << op.vertex_a << "," << op.vertex_b << ")" << std::endl;
@@ -218,6 +252,7 @@ std::pair<double, double> run_splay(int N) {
 			tree->deexpose(op.vertex_b);
 		break;}
 		}
+		if (histograms != NULL) histograms[op.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - op_begin).count());
 		i++;
 	}
 
@@ -232,6 +267,11 @@ std::pair<double, double> run_splay(int N) {
 	//return std::pair<double,double>(init_time,execution_time );
 }
 
+// Tail latencies (microseconds) of all types of operations
+void print_tail_latencies(const TopTree::LatencyHistogram *histograms) {
+	for (int i = 0; i < OPS_COUNT; i++) std::cout << " " << histograms[i].percentile(0.99) / 1000.0 << " " << histograms[i].percentile(0.999) / 1000.0;
+}
+
 int main(int argc, char *argv[]) {
 	// Init random generator
 	auto seed = strtoull(argv[1], NULL, 16);
@@ -241,11 +281,27 @@ int main(int argc, char *argv[]) {
 	int K = atoi(argv[3]);
 	int W = atoi(argv[4]);
 	double R = atof(argv[5]);
+	// Optional number of threads for the parallel construction (0 = all hardware threads)
+	int T = (argc > 6 ? atoi(argv[6]) : 0);
+	// Optional shape of the original tree (see TreeGenerator), random recursive tree by rand() when not given
+	const TopTree::TreeGenerator::Shape *shape = NULL;
+	if (argc > 7 && (shape = TopTree::TreeGenerator::FindShape(argv[7])) == NULL) {
+		std::cerr << "Unknown shape " << argv[7] << ", known shapes:";
+		for (auto &s: TopTree::TreeGenerator::GetShapes()) std::cerr << " " << s.name;
+		std::cerr << std::endl;
+		return 1;
+	}
 
 	// Generate tree and list of operations
 	// a) original graph = each vertex is connected to one with lower number
 	vertices.push_back(std::pair<int,int>(0,0));
-	for (int i = 1; i < N; i++) vertices.push_back(std::pair<int,int>(rand() % i, rand() % MAX_WEIGHT));
+	if (shape != NULL) {
+		std::mt19937_64 random(seed);
+		TopTree::TreeGenerator generator(*shape, N, random);
+		for (int i = 1; i < N; i++) vertices.push_back(std::pair<int,int>(generator.AddVertex(i), rand() % MAX_WEIGHT));
+	} else {
+		for (int i = 1; i < N; i++) vertices.push_back(std::pair<int,int>(rand() % i, rand() % MAX_WEIGHT));
+	}
 	// b) operations (type and two vertices)
 	for (int i = 0; i < K; i++) {
 		opType op;
@@ -273,23 +329,51 @@ int main(int argc, char *argv[]) {
 
 	//std::cerr << "Generating of operations ended" << std::endl;
 
-	// Run implementations
+	// Run implementations (histograms are filled only by the measured runs)
+	TopTree::LatencyHistogram top_tree_histograms[OPS_COUNT];
+	TopTree::LatencyHistogram topology_top_tree_histograms[OPS_COUNT];
+	TopTree::LatencyHistogram splay_top_tree_histograms[OPS_COUNT];
 	for (int i = 0; i < W; i++) {
-		run(new MaximumEdgeWeight(new TopTree::STTopTree()), N);
+		run(new MaximumEdgeWeight(new MaxEdge::STTopTree()), N);
 	}
-	auto time_top_tree = run(new MaximumEdgeWeight(new TopTree::STTopTree()), N);
+	auto time_top_tree = run(new MaximumEdgeWeight(new MaxEdge::STTopTree()), N, top_tree_histograms, "top");
 	//auto time_top_tree = std::make_pair(0, 0);
 
 	for (int i = 0; i < W; i++) {
-		run(new MaximumEdgeWeight(new TopTree::TopologyTopTree()), N);
+		run(new MaximumEdgeWeight(new MaxEdge::TopologyTopTree()), N);
 	}
-	auto time_topology_top_tree = run(new MaximumEdgeWeight(new TopTree::TopologyTopTree()), N);
+	auto time_topology_top_tree = run(new MaximumEdgeWeight(new MaxEdge::TopologyTopTree()), N, topology_top_tree_histograms, "topology");
 	//auto time_topology_top_tree = std::make_pair(0, 0);
 
+	for (int i = 0; i < W; i++) {
+		run_construction<MaxEdge::TopologyTopTree>(N, 1);
+	}
+	auto time_topology_bulk_construction = run_construction<MaxEdge::TopologyTopTree>(N, 1);
+	for (int i = 0; i < W; i++) {
+		run_construction<MaxEdge::TopologyTopTree>(N, T);
+	}
+	auto time_topology_parallel_construction = run_construction<MaxEdge::TopologyTopTree>(N, T);
+
+	for (int i = 0; i < W; i++) {
+		run_construction<MaxEdge::STTopTree>(N, 1);
+	}
+	auto time_top_bulk_construction = run_construction<MaxEdge::STTopTree>(N, 1);
+	for (int i = 0; i < W; i++) {
+		run_construction<MaxEdge::STTopTree>(N, T);
+	}
+	auto time_top_parallel_construction = run_construction<MaxEdge::STTopTree>(N, T);
+
 	for (int i = 0; i < W; i++) {
 		run_splay(N);
 	}
-	auto time_splay_top_tree = run_splay(N);
+	auto time_splay_top_tree = run_splay(N, splay_top_tree_histograms);
 
-	std::cout << time_top_tree.first << " " << time_top_tree.second << " " << time_topology_top_tree.first << " " << time_topology_top_tree.second <<  " " << time_splay_top_tree.first << " " <<  time_splay_top_tree.second << std::endl;
+	std::cout << time_top_tree.first << " " << time_top_tree.second << " " << time_topology_top_tree.first << " " << time_topology_top_tree.second <<  " " << time_splay_top_tree.first << " " <<  time_splay_top_tree.second
+		<< " " << time_topology_bulk_construction << " " << time_topology_parallel_construction
+		<< " " << time_top_bulk_construction << " " << time_top_parallel_construction;
+	// p99 and p999 of ADD_EDGE, REMOVE_EDGE, GET_WEIGHT and ADD_WEIGHT for each implementation
+	print_tail_latencies(top_tree_histograms);
+	print_tail_latencies(topology_top_tree_histograms);
+	print_tail_latencies(splay_top_tree_histograms);
+	std::cout << std::endl;
 }
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <iostream>
+#include <chrono>
+
+#include "examples/maximum_edge_weight.hpp"
+
+#include "TopologyTopTree.hpp"
+
+#define MAX_WEIGHT 10000
+
+// Trees with vertices of very high degree in the TopologyTopTree: a star (all vertices are leaves of one hub) and
+// a power-law tree (each new vertex is connected to an endpoint of a random edge, so to a vertex chosen with
+// probability given by its degree). Operations move a leaf to another vertex (chosen the same way, so mostly to
+// hubs) or query a path between two random vertices. Hubs are splitted into many subvertices, so the moves measure
+// their maintenance after cuts and links.
+
+enum opType { MOVE_LEAF, GET_WEIGHT };
+struct operation {
+	opType op;
+	int vertex_a;
+	int vertex_b;
+	int weight;
+};
+
+struct result {
+	double init_time; // microseconds per vertex
+	double move_time; // microseconds per move
+	double query_time; // microseconds per query
+	long long checksum; // sum of maximums on the queried paths
+};
+
+std::vector<std::pair<int, int>> vertices; // pair(edge to, edge weight)
+std::vector<struct operation> operations;
+
+result run(int N) {
+	auto worker = new MaximumEdgeWeight(new MaxEdge::TopologyTopTree());
+	std::vector<int> neighbour(N); // the only neighbour of leaves
+
+	// Init tree (all edges are in the BaseTree before initialization, so the construction is measured)
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < N; i++) worker->add_vertex(std::to_string(i));
+	for (int i = 1; i < N; i++) {
+		worker->add_edge(i, vertices[i].first, vertices[i].second);
+		neighbour[i] = vertices[i].first;
+	}
+	worker->initialize();
+	auto init_time = std::chrono::steady_clock::now() - begin;
+
+	int moves = 0;
+	int queries = 0;
+	long long checksum = 0;
+	std::chrono::steady_clock::duration move_time(0);
+	std::chrono::steady_clock::duration query_time(0);
+	for (auto op: operations) {
+		begin = std::chrono::steady_clock::now();
+		if (op.op == MOVE_LEAF) {
+			if (!worker->remove_edge(op.vertex_a, neighbour[op.vertex_a])) {
+				std::cerr << "ERROR: Problem during removing edge " << op.vertex_a << "-" << neighbour[op.vertex_a] << std::endl;
+			}
+			worker->add_edge(op.vertex_a, op.vertex_b, op.weight);
+			neighbour[op.vertex_a] = op.vertex_b;
+			move_time += std::chrono::steady_clock::now() - begin;
+			moves++;
+		} else {
+			checksum += worker->get_max_weight_on_path(op.vertex_a, op.vertex_b).max_weight;
+			query_time += std::chrono::steady_clock::now() - begin;
+			queries++;
+		}
+	}
+	delete worker;
+
+	return result{
+		((double) std::chrono::duration_cast<std::chrono::nanoseconds>(init_time).count()) / N / 1000,
+		moves == 0 ? 0 : ((double) std::chrono::duration_cast<std::chrono::nanoseconds>(move_time).count()) / moves / 1000,
+		queries == 0 ? 0 : ((double) std::chrono::duration_cast<std::chrono::nanoseconds>(query_time).count()) / queries / 1000,
+		checksum
+	};
+}
+
+// Operations on the generated tree, leaves are moved to the vertices given by the target function
+void generate_operations(int N, int K, int (*target)(int N)) {
+	// Degrees are simulated to know which vertices are leaves at the time of the move
+	std::vector<int> degree(N, 0);
+	std::vector<int> neighbour(N);
+	for (int i = 1; i < N; i++) {
+		degree[i]++;
+		degree[vertices[i].first]++;
+		neighbour[i] = vertices[i].first;
+	}
+
+	operations.clear();
+	for (int i = 0; i < K; i++) {
+		if (rand() % 2 == 0) {
+			int leaf;
+			do leaf = rand() % N; while (degree[leaf] != 1);
+			int to = target(N);
+			if (to == leaf || degree[neighbour[leaf]] == 1) continue; // it would not be a leaf move
+			degree[neighbour[leaf]]--;
+			degree[to]++;
+			neighbour[leaf] = to;
+			operations.push_back(operation{MOVE_LEAF, leaf, to, rand() % MAX_WEIGHT});
+		} else {
+			int a = rand() % N;
+			int b = rand() % (N - 1);
+			if (b >= a) b++;
+			operations.push_back(operation{GET_WEIGHT, a, b, 0});
+		}
+	}
+}
+
+// Targets of the moves
+std::vector<int> endpoints; // of the initial edges (vertex is there as many times as is its degree)
+int star_target(int N) { return 0; }
+int power_law_target(int N) { return endpoints[rand() % endpoints.size()]; }
+
+int main(int argc, char *argv[]) {
+	if (argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " seed N K" << std::endl;
+		return 1;
+	}
+	// Init random generator
+	auto seed = strtoull(argv[1], NULL, 16);
+	srand(seed);
+	// Number of vertices and number of operations
+	int N = atoi(argv[2]);
+	int K = atoi(argv[3]);
+	if (N < 3) {
+		std::cerr << "At least three vertices are needed" << std::endl;
+		return 1;
+	}
+
+	// a) star with the center 0
+	vertices.push_back(std::pair<int,int>(0,0));
+	for (int i = 1; i < N; i++) vertices.push_back(std::pair<int,int>(0, rand() % MAX_WEIGHT));
+	generate_operations(N, K, star_target);
+	auto star = run(N);
+
+	// b) power-law tree (preferential attachment)
+	vertices.clear();
+	vertices.push_back(std::pair<int,int>(0,0));
+	vertices.push_back(std::pair<int,int>(0, rand() % MAX_WEIGHT));
+	endpoints = {0, 1};
+	for (int i = 2; i < N; i++) {
+		int to = endpoints[rand() % endpoints.size()];
+		vertices.push_back(std::pair<int,int>(to, rand() % MAX_WEIGHT));
+		endpoints.push_back(to);
+		endpoints.push_back(i);
+	}
+	generate_operations(N, K, power_law_target);
+	auto power_law = run(N);
+
+	// Microseconds per vertex (initialization), per move and per query on the star and on the power-law tree, checksums
+	std::cout << star.init_time << " " << star.move_time << " " << star.query_time << " "
+		<< power_law.init_time << " " << power_law.move_time << " " << power_law.query_time << " "
+		<< star.checksum << " " << power_law.checksum << std::endl;
+}
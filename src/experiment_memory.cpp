@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <iostream>
+
+#include "examples/maximum_edge_weight.hpp"
+
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
+
+#define MAX_WEIGHT 10000
+
+std::vector<std::pair<int, int>> vertices; // pair(edge to, edge weight)
+
+// Bytes currently allocated from the heap (both small blocks and mmaped chunks)
+size_t allocated_bytes() {
+	auto info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// Returns memory per vertex of the BaseTree alone and of the BaseTree together with top tree built above it
+std::pair<double, double> run(TopTree::ITopTree *top_tree, bool arena_storage, int N) {
+	size_t begin = allocated_bytes();
+
+	auto worker = new MaximumEdgeWeight(top_tree, arena_storage);
+	for (uint i = 0; i < vertices.size(); i++) worker->add_vertex(std::to_string(i));
+	for (uint i = 1; i < vertices.size(); i++) worker->add_edge(i, vertices[i].first, vertices[i].second);
+	size_t base_tree = allocated_bytes() - begin;
+
+	worker->initialize();
+	size_t total = allocated_bytes() - begin;
+
+	delete(worker);
+
+	return std::make_pair(((double) base_tree) / N, ((double) total) / N);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " seed N" << std::endl;
+		return 1;
+	}
+	// Init random generator
+	auto seed = strtoull(argv[1], NULL, 16);
+	srand(seed);
+	int N = atoi(argv[2]);
+
+	// Random tree, each vertex is connected to one with lower number
+	vertices.push_back(std::pair<int,int>(0,0));
+	for (int i = 1; i < N; i++) vertices.push_back(std::pair<int,int>(rand() % i, rand() % MAX_WEIGHT));
+
+	auto st_heap = run(new MaxEdge::STTopTree(), false, N);
+	auto st_arena = run(new MaxEdge::STTopTree(), true, N);
+	auto topology_heap = run(new MaxEdge::TopologyTopTree(), false, N);
+	auto topology_arena = run(new MaxEdge::TopologyTopTree(), true, N);
+
+	// Bytes per vertex: base tree (heap, arena), whole ST top tree (heap, arena), whole topology top tree (heap, arena)
+	std::cout << st_heap.first << " " << st_arena.first << " " << st_heap.second << " " << st_arena.second << " " << topology_heap.second << " " << topology_arena.second << std::endl;
+}
@@ -0,0 +1,328 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+
+#include "examples/maximum_edge_weight.hpp"
+#include "LatencyHistogram.hpp"
+#include "TraceRecorder.hpp"
+
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
+
+#define TopTree SplayTopTree
+#include "../top-trees/include/add_weight_cluster.hpp"
+#undef TopTree
+
+using SplayMaxPath = MaxPathTopTree;
+using SplayMaxEdge = Edge<AddWeightCluster,int,None>;
+
+// Replay of a trace recorded by TopTree::TraceRecorder (for example by experiment_benchmark --record) on all three
+// implementations (self-adjusting top trees, topology top trees and splay top trees from the top-trees library) with
+// the user functions of the maximum edge weight problem (values of edges are their weights). The trace is memory
+// mapped and records are read in place. Calls which failed when recorded did not change the tree, so they are skipped.
+// Each call is timed separately (steady_clock) into the histogram of its type and percentiles are printed as JSON or
+// CSV (the same as experiment_benchmark).
+
+const char *op_names[TopTree::TRACE_OPS] = {"edge", "init", "link", "cut", "expose", "query_path", "restore"};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Trace
+
+struct initial_edge {
+	int v;
+	int w;
+	int value;
+};
+
+const TopTree::TraceRecord *records = NULL;
+size_t records_count = 0;
+size_t first_operation = 0; // the record after INIT
+int vertices = 0; // vertices of the underlying tree (and all vertices used by the calls)
+std::vector<initial_edge> initial_edges;
+
+void map_trace(const char *filename) {
+	// 1. Map the whole file
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "ERROR: Cannot open trace file " << filename << std::endl;
+		exit(1);
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(TopTree::TraceHeader)) {
+		std::cerr << "ERROR: Trace file " << filename << " is too short" << std::endl;
+		exit(1);
+	}
+	size_t size = file_stat.st_size;
+	void *memory = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		std::cerr << "ERROR: Cannot map trace file " << filename << std::endl;
+		exit(1);
+	}
+	madvise(memory, size, MADV_SEQUENTIAL);
+
+	// 2. Check the header
+	auto header = (const TopTree::TraceHeader *) memory;
+	if (strncmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION
+		|| header->record_size != sizeof(TopTree::TraceRecord) || (size - sizeof(*header)) % sizeof(TopTree::TraceRecord) != 0) {
+		std::cerr << "ERROR: " << filename << " is not a trace of version " << TRACE_VERSION << " (or it is truncated)" << std::endl;
+		exit(1);
+	}
+	records = (const TopTree::TraceRecord *) ((const char *) memory + sizeof(*header));
+	records_count = (size - sizeof(*header)) / sizeof(TopTree::TraceRecord);
+
+	// 3. Initial tree is given by the records before INIT
+	for (first_operation = 0; first_operation < records_count && records[first_operation].op == TopTree::TRACE_EDGE; first_operation++) {
+		auto &r = records[first_operation];
+		initial_edges.push_back(initial_edge{r.v, r.w, r.value});
+	}
+	if (first_operation == records_count || records[first_operation].op != TopTree::TRACE_INIT) {
+		std::cerr << "ERROR: Trace " << filename << " does not start with the initialization of the tree" << std::endl;
+		exit(1);
+	}
+	vertices = records[first_operation].v;
+	first_operation++;
+
+	// 4. Vertices may be added to the underlying tree after the initialization
+	for (size_t i = 0; i < records_count; i++) {
+		auto &r = records[i];
+		if (r.op >= TopTree::TRACE_OPS || (i >= first_operation && (r.op == TopTree::TRACE_EDGE || r.op == TopTree::TRACE_INIT))) {
+			std::cerr << "ERROR: Unexpected record " << (int) r.op << " at position " << i << " of the trace" << std::endl;
+			exit(1);
+		}
+		if (r.op != TopTree::TRACE_INIT && r.op != TopTree::TRACE_RESTORE) vertices = std::max(vertices, std::max(r.v, r.w) + 1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Implementations
+
+// Latencies of calls in nanoseconds (init is measured per vertex)
+struct samples {
+	TopTree::LatencyHistogram op[TopTree::TRACE_OPS];
+};
+
+class Implementation {
+public:
+	virtual ~Implementation() {}
+	virtual const char *name() const = 0;
+
+	virtual void init() = 0;
+	virtual void link(int v, int w, int value) = 0;
+	virtual void cut(int v, int w) = 0;
+	virtual void expose(int v, int w) = 0;
+	virtual void query_path(int v, int w) = 0;
+	virtual void restore() = 0;
+	virtual void clear() = 0;
+
+	// Replays the trace on a new tree, latencies are added to the samples (when given)
+	void run(samples *result) {
+		auto begin = std::chrono::steady_clock::now();
+		init();
+		auto end = std::chrono::steady_clock::now();
+		if (result != NULL) result->op[TopTree::TRACE_INIT].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / std::max(vertices, 1));
+
+		for (size_t i = first_operation; i < records_count; i++) {
+			auto &r = records[i];
+			if (r.failed) continue;
+
+			begin = std::chrono::steady_clock::now();
+			switch (r.op) {
+			case TopTree::TRACE_LINK: link(r.v, r.w, r.value); break;
+			case TopTree::TRACE_CUT: cut(r.v, r.w); break;
+			case TopTree::TRACE_EXPOSE: expose(r.v, r.w); break;
+			case TopTree::TRACE_QUERY_PATH: query_path(r.v, r.w); break;
+			case TopTree::TRACE_RESTORE: restore(); break;
+			default: break;
+			}
+			end = std::chrono::steady_clock::now();
+			if (result != NULL) result->op[r.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+		}
+
+		clear();
+	}
+};
+
+// STTopTree or TopologyTopTree (constructed from the whole initial tree), calls of the trace are made directly
+template<class T>
+class TopTreeImplementation: public Implementation {
+public:
+	TopTreeImplementation(const char *label): label{label} {}
+	const char *name() const { return label; }
+
+	void init() {
+		base_tree = std::make_shared<TopTree::BaseTree>();
+		for (int i = 0; i < vertices; i++) base_tree->AddVertex();
+		edges = 0;
+		for (auto &e: initial_edges) base_tree->AddEdge(e.v, e.w, std::make_shared<MaxEdge::MyEdgeData>(edges++, e.value, ""));
+		top_tree = new T();
+		top_tree->InitFromBaseTree(base_tree);
+	}
+	void link(int v, int w, int value) {
+		if (top_tree->Link(v, w, std::make_shared<MaxEdge::MyEdgeData>(edges++, value, "")) == NULL) {
+			std::cerr << "ERROR: Link " << v << "-" << w << " failed in " << label << " (the trace does not match)" << std::endl;
+			exit(1);
+		}
+	}
+	void cut(int v, int w) {
+		if (std::get<2>(top_tree->Cut(v, w)) == NULL) {
+			std::cerr << "ERROR: Cut " << v << "-" << w << " failed in " << label << " (the trace does not match)" << std::endl;
+			exit(1);
+		}
+	}
+	void expose(int v, int w) { top_tree->Expose(v, w); }
+	void query_path(int v, int w) { top_tree->QueryPath(v, w); }
+	void restore() { top_tree->Restore(); }
+	void clear() {
+		delete top_tree;
+		top_tree = NULL;
+		base_tree = NULL;
+	}
+private:
+	const char *label;
+	T *top_tree = NULL;
+	std::shared_ptr<TopTree::BaseTree> base_tree;
+	int edges = 0; // index of the next edge
+};
+
+// Splay top trees from the top-trees library (initial tree is linked edge by edge, edges are found by endpoints)
+class SplayImplementation: public Implementation {
+public:
+	const char *name() const { return "splay"; }
+
+	void init() {
+		tree = new SplayMaxPath(vertices);
+		edges.clear();
+		for (auto &e: initial_edges) edges[key(e.v, e.w)] = tree->link_ptr(e.v, e.w, e.value);
+	}
+	void link(int v, int w, int value) { edges[key(v, w)] = tree->link_ptr(v, w, value); }
+	void cut(int v, int w) {
+		auto edge = edges.find(key(v, w));
+		if (edge == edges.end()) {
+			std::cerr << "ERROR: Cut " << v << "-" << w << " of an edge which is not in the tree (the trace does not match)" << std::endl;
+			exit(1);
+		}
+		tree->cut_ptr(edge->second);
+		edges.erase(edge);
+	}
+	void expose(int v, int w) {
+		tree->expose(v);
+		tree->expose(w);
+		tree->deexpose(v);
+		tree->deexpose(w);
+	}
+	void query_path(int v, int w) { expose(v, w); }
+	void restore() {}
+	void clear() {
+		delete tree;
+		tree = NULL;
+	}
+private:
+	SplayMaxPath *tree = NULL;
+	std::unordered_map<unsigned long long, SplayMaxEdge*> edges;
+
+	static unsigned long long key(int v, int w) {
+		if (v > w) std::swap(v, w);
+		return ((unsigned long long) v << 32) | (unsigned int) w;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Output
+
+enum outputFormat { JSON, CSV };
+
+void print_result(outputFormat format, bool first, const char *implementation, const char *trace, int repetitions, samples &result) {
+	if (format == JSON) {
+		if (!first) std::cout << "," << std::endl;
+		std::cout << "  {\"implementation\": \"" << implementation << "\", \"trace\": \"" << trace << "\", \"vertices\": " << vertices
+			<< ", \"repetitions\": " << repetitions << ", \"ops\": {";
+	}
+	bool first_op = true;
+	for (int i = 0; i < TopTree::TRACE_OPS; i++) {
+		auto &h = result.op[i];
+		if (h.count() == 0) continue;
+		double mean = h.mean() / 1000.0, p50 = h.percentile(0.5) / 1000.0, p90 = h.percentile(0.9) / 1000.0;
+		double p99 = h.percentile(0.99) / 1000.0, p999 = h.percentile(0.999) / 1000.0, max = h.max() / 1000.0;
+		if (format == CSV) {
+			std::cout << implementation << "," << trace << "," << vertices << "," << repetitions << "," << op_names[i] << ","
+				<< h.count() << "," << mean << "," << p50 << "," << p90 << "," << p99 << "," << p999 << "," << max << std::endl;
+		} else {
+			std::cout << (first_op ? "" : ",") << std::endl << "    \"" << op_names[i] << "\": {\"count\": " << h.count() << ", \"mean_us\": " << mean
+				<< ", \"p50_us\": " << p50 << ", \"p90_us\": " << p90 << ", \"p99_us\": " << p99 << ", \"p999_us\": " << p999 << ", \"max_us\": " << max << "}";
+		}
+		first_op = false;
+	}
+	if (format == JSON) std::cout << std::endl << "  }}";
+}
+
+void usage(const char *program) {
+	std::cerr << "Usage: " << program << " trace [options]" << std::endl
+		<< "  --warmup W          not measured runs of each implementation (default 1)" << std::endl
+		<< "  --repetitions R     measured runs of each implementation (default 3)" << std::endl
+		<< "  --implementation I  implementation, can be repeated (default all): top topology splay" << std::endl
+		<< "  --format F          output format: json (default) or csv" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int W = 1;
+	int R = 3;
+	std::vector<std::string> selected_implementations;
+	outputFormat format = JSON;
+
+	// 1. Parse arguments
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	const char *trace = argv[1];
+	for (int i = 2; i < argc; i++) {
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		if (!strcmp(argv[i - 1], "--warmup")) W = atoi(value);
+		else if (!strcmp(argv[i - 1], "--repetitions")) R = atoi(value);
+		else if (!strcmp(argv[i - 1], "--implementation")) selected_implementations.push_back(value);
+		else if (!strcmp(argv[i - 1], "--format") && !strcmp(value, "json")) format = JSON;
+		else if (!strcmp(argv[i - 1], "--format") && !strcmp(value, "csv")) format = CSV;
+		else {
+			std::cerr << "Unknown argument " << argv[i - 1] << " " << value << std::endl;
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	map_trace(trace);
+
+	// 2. Prepare implementations
+	std::vector<Implementation*> implementations;
+	auto selected = [&selected_implementations](const char *name) {
+		return selected_implementations.empty() || std::find(selected_implementations.begin(), selected_implementations.end(), name) != selected_implementations.end();
+	};
+	if (selected("top")) implementations.push_back(new TopTreeImplementation<MaxEdge::STTopTree>("top"));
+	if (selected("topology")) implementations.push_back(new TopTreeImplementation<MaxEdge::TopologyTopTree>("topology"));
+	if (selected("splay")) implementations.push_back(new SplayImplementation());
+
+	// 3. Replay the trace
+	bool first = true;
+	if (format == JSON) std::cout << "[" << std::endl;
+	else std::cout << "implementation,trace,vertices,repetitions,op,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us" << std::endl;
+	for (auto implementation: implementations) {
+		samples result;
+		for (int i = 0; i < W; i++) implementation->run(NULL);
+		for (int i = 0; i < R; i++) implementation->run(&result);
+		print_result(format, first, implementation->name(), trace, R, result);
+		first = false;
+	}
+	if (format == JSON) std::cout << std::endl << "]" << std::endl;
+
+	for (auto implementation: implementations) delete implementation;
+}
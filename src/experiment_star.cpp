@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <iostream>
+#include <chrono>
+
+#include "examples/maximum_edge_weight.hpp"
+
+#include "STTopTree.hpp"
+#include "TopologyTopTree.hpp"
+
+#define MAX_WEIGHT 10000
+
+// Star-like trees: few hubs connected into a path, all other vertices are leaves of random hubs
+// (so hubs have very high degree). Operations move a leaf to another hub or query a path between leaves.
+
+enum opType { MOVE_LEAF, GET_WEIGHT };
+struct operation {
+	opType op;
+	int vertex_a;
+	int vertex_b;
+	int param; // used as weight
+};
+
+std::vector<std::pair<int, int>> vertices; // pair(edge to, edge weight)
+std::vector<struct operation> operations;
+
+std::vector<std::pair<std::string, long long>> st_statistics; // of the last measured STTopTree
+
+// Value of the counter from GetStatistics (zero when the counters are not compiled in)
+long long get_counter(const std::vector<std::pair<std::string, long long>> &statistics, const std::string &name) {
+	for (auto &counter: statistics) if (counter.first == name) return counter.second;
+	return 0;
+}
+
+std::pair<double, double> run(MaximumEdgeWeight *worker, int N, TopTree::STTopTree *st_tree = NULL) {
+	std::vector<int> hub(vertices.size()); // current hub of each leaf
+
+	// Init tree (all edges are in the BaseTree before initialization, so the construction is measured)
+	auto begin = std::chrono::steady_clock::now();
+	for (uint i = 0; i < vertices.size(); i++) worker->add_vertex(std::to_string(i));
+	for (uint i = 1; i < vertices.size(); i++) {
+		worker->add_edge(i, vertices[i].first, vertices[i].second);
+		hub[i] = vertices[i].first;
+	}
+	worker->initialize();
+	auto end = std::chrono::steady_clock::now();
+	auto init_time = end - begin;
+
+	// Start measure time and perform all operations
+	begin = std::chrono::steady_clock::now();
+	for (auto op: operations) {
+		switch (op.op) {
+		case MOVE_LEAF: {
+			if (hub[op.vertex_a] == op.vertex_b) continue;
+			if (!worker->remove_edge(op.vertex_a, hub[op.vertex_a])) {
+				std::cerr << "ERROR: Problem during removing edge " << op.vertex_a << "-" << hub[op.vertex_a] << std::endl;
+			}
+			worker->add_edge(op.vertex_a, op.vertex_b, op.param % MAX_WEIGHT);
+			hub[op.vertex_a] = op.vertex_b;
+		break;}
+		case GET_WEIGHT: {
+			worker->get_max_weight_on_path(op.vertex_a, op.vertex_b);
+		break;}
+		}
+	}
+	end = std::chrono::steady_clock::now();
+	if (st_tree != NULL) st_statistics = st_tree->GetStatistics();
+
+	// Cleaning
+	delete(worker);
+
+	auto execution_time = end - begin;
+	return std::make_pair(
+		((long double) std::chrono::duration_cast<std::chrono::microseconds>(init_time).count()) / N,
+		((long double) std::chrono::duration_cast<std::chrono::microseconds>(execution_time).count()) / operations.size());
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 6) {
+		std::cerr << "Usage: " << argv[0] << " seed N hubs K warmups" << std::endl;
+		return 1;
+	}
+	// Init random generator
+	auto seed = strtoull(argv[1], NULL, 16);
+	srand(seed);
+	// Get size of tree, number of hubs, number of operations and number of warmups
+	int N = atoi(argv[2]);
+	int H = atoi(argv[3]);
+	int K = atoi(argv[4]);
+	int W = atoi(argv[5]);
+	if (H < 1 || H >= N) {
+		std::cerr << "Number of hubs must be between 1 and N-1" << std::endl;
+		return 1;
+	}
+
+	// Generate tree and list of operations
+	// a) hubs 0..H-1 form a path, other vertices are connected to a random hub
+	vertices.push_back(std::pair<int,int>(0,0));
+	for (int i = 1; i < H; i++) vertices.push_back(std::pair<int,int>(i - 1, rand() % MAX_WEIGHT));
+	for (int i = H; i < N; i++) vertices.push_back(std::pair<int,int>(rand() % H, rand() % MAX_WEIGHT));
+	// b) operations: move leaf to random hub or query path between two leaves
+	for (int i = 0; i < K; i++) {
+		int leaf = H + rand() % (N - H);
+		if (rand() % 2 == 0) operations.push_back(operation{MOVE_LEAF, leaf, rand() % H, rand()});
+		else operations.push_back(operation{GET_WEIGHT, leaf, H + rand() % (N - H), 0});
+	}
+
+	// Run implementations
+	for (int i = 0; i < W; i++) {
+		run(new MaximumEdgeWeight(new MaxEdge::STTopTree()), N);
+	}
+	auto st_tree = new MaxEdge::STTopTree();
+	auto time_top_tree = run(new MaximumEdgeWeight(st_tree), N, st_tree);
+
+	for (int i = 0; i < W; i++) {
+		run(new MaximumEdgeWeight(new MaxEdge::TopologyTopTree()), N);
+	}
+	auto time_topology_top_tree = run(new MaximumEdgeWeight(new MaxEdge::TopologyTopTree()), N);
+
+	// Microseconds per vertex (initialization) and per operation for both top trees,
+	// handle lookups of STTopTree per operation, part of them found directly, climb steps per lookup and climb steps
+	// saved by the direct ones per lookup (zeros without the statistics, see make STATISTICS=1)
+	long long lookups = get_counter(st_statistics, "handle_lookups");
+	std::cout << time_top_tree.first << " " << time_top_tree.second << " " << time_topology_top_tree.first << " " << time_topology_top_tree.second << " "
+		<< ((double) lookups) / K << " "
+		<< (lookups == 0 ? 0 : ((double) get_counter(st_statistics, "direct_handles")) / lookups) << " "
+		<< (lookups == 0 ? 0 : ((double) get_counter(st_statistics, "handle_climb_steps")) / lookups) << " "
+		<< (lookups == 0 ? 0 : ((double) get_counter(st_statistics, "saved_climb_steps")) / lookups) << std::endl;
+}
@@ -1,12 +1,33 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <thread>
 
 #include "STTopTree.hpp"
 #include "TopologyTopTree.hpp"
+#include "examples/maximum_edge_weight.hpp"
 
 //#define DEBUG
 
+// Number of allocations by the global operator new (tests compare it before and after some operations, atomic as the
+// parallel construction allocates from more threads)
+std::atomic<long long> allocations{0};
+void *operator new(std::size_t size) {
+	allocations++;
+	void *pointer = std::malloc(size == 0 ? 1 : size);
+	if (pointer == NULL) throw std::bad_alloc();
+	return pointer;
+}
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+
 struct MyClusterData: public TopTree::ClusterData {
 	int weight;
 	int total_weight;
@@ -37,7 +58,7 @@ public:
 	}
 };
 
-void TopTree::Join(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent) {
+void TopTree::Join(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent) {
 	auto left_data = std::dynamic_pointer_cast<MyClusterData>(leftChild->data);
 	auto right_data = std::dynamic_pointer_cast<MyClusterData>(rightChild->data);
 	auto parent_data = std::dynamic_pointer_cast<MyClusterData>(parent->data);
@@ -60,12 +81,12 @@ void TopTree::Join(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster
 		std::cerr << "Joining " << left_data->total_weight << "(" << left_data->label << "/" << left_data->total_label << ") + " << right_data->total_weight << "(" << right_data->label << "/" << right_data->total_label << ")" << std::endl;
 	#endif
 }
-void TopTree::Split(std::shared_ptr<ICluster> leftChild, std::shared_ptr<ICluster> rightChild, std::shared_ptr<ICluster> parent) {
+void TopTree::Split(const std::shared_ptr<ICluster> &leftChild, const std::shared_ptr<ICluster> &rightChild, const std::shared_ptr<ICluster> &parent) {
 	// Nothing
 }
 
 // Creating and destroying Base clusters:
-void TopTree::Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
+void TopTree::Create(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge) {
 	auto data = std::dynamic_pointer_cast<MyClusterData>(cluster->data);
 	auto edge_data = std::dynamic_pointer_cast<MyEdgeData>(edge);
 	data->weight = 10;
@@ -73,11 +94,11 @@ void TopTree::Create(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData
 	data->label = edge_data->label;
 	data->total_label = edge_data->label;
 }
-void TopTree::Destroy(std::shared_ptr<ICluster> cluster, std::shared_ptr<EdgeData> edge) {
+void TopTree::Destroy(const std::shared_ptr<ICluster> &cluster, const std::shared_ptr<EdgeData> &edge) {
 	// Nothing
 }
 
-void TopTree::CopyClusterData(std::shared_ptr<ICluster> from, std::shared_ptr<ICluster> to) {
+void TopTree::CopyClusterData(const std::shared_ptr<ICluster> &from, const std::shared_ptr<ICluster> &to) {
 	auto fromData = std::dynamic_pointer_cast<MyClusterData>(from->data);
 	auto toData = std::dynamic_pointer_cast<MyClusterData>(to->data);
 
@@ -98,6 +119,454 @@ void print_node(std::shared_ptr<TopTree::ICluster> node) {
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Tests on random forests with weighted edges (maximum edge weight policy), top trees are checked against a naive
+// walk of the same forest. Each test prints the reason of the failure and returns false.
+
+struct NaiveForest {
+	std::vector<std::map<int, int>> weights; // weights[v][w] is the weight of the edge v-w
+
+	NaiveForest(int N): weights(N) {}
+
+	void link(int v, int w, int weight) { weights[v][w] = weights[w][v] = weight; }
+	void cut(int v, int w) { weights[v].erase(w); weights[w].erase(v); }
+	// Edges of the path from v to w (as pairs of endpoints), false when there is no such path
+	bool path(int v, int w, std::vector<std::pair<int, int>> &edges) const {
+		std::vector<int> parent(weights.size(), -1);
+		std::vector<int> stack{v};
+		parent[v] = v;
+		while (!stack.empty()) {
+			int x = stack.back();
+			stack.pop_back();
+			for (auto &neighbour: weights[x]) if (parent[neighbour.first] == -1) {
+				parent[neighbour.first] = x;
+				stack.push_back(neighbour.first);
+			}
+		}
+		if (parent[w] == -1) return false;
+		for (int x = w; x != v; x = parent[x]) edges.push_back(std::make_pair(x, parent[x]));
+		return true;
+	}
+	// Maximum weight on the path from v to w, -1 when there is no such path
+	int max_weight(int v, int w) const {
+		std::vector<std::pair<int, int>> edges;
+		if (!path(v, w, edges)) return -1;
+		int result = -1;
+		for (auto &e: edges) result = std::max(result, weights[e.first].at(e.second));
+		return result;
+	}
+};
+
+// Random forest of N vertices with random weights (about one fifth of the vertices are roots), with hub half of the
+// edges go to the vertex 0 (so it is splitted into many subvertices by TopologyTopTree)
+struct RandomForest {
+	std::mt19937 random;
+	NaiveForest naive;
+	std::vector<std::pair<int, int>> edges;
+
+	RandomForest(int N, unsigned seed, bool hub = false): random(seed), naive(N) {
+		for (int i = 1; i < N; i++) if (random() % 5) {
+			int parent = (hub && random() % 2 ? 0 : random() % i);
+			naive.link(i, parent, random() % 1000);
+			edges.push_back(std::make_pair(i, parent));
+		}
+	}
+
+	// New underlying tree of the forest (each top tree needs its own one, vertices are splitted there)
+	std::shared_ptr<TopTree::BaseTree> base_tree() const {
+		auto base_tree = std::make_shared<TopTree::BaseTree>();
+		for (uint i = 0; i < naive.weights.size(); i++) base_tree->AddVertex(std::make_shared<MaxEdge::MyVertexData>(std::to_string(i)));
+		for (auto &e: edges) base_tree->AddEdge(e.first, e.second, std::make_shared<MaxEdge::MyEdgeData>(0, naive.weights[e.first].at(e.second), ""));
+		return base_tree;
+	}
+};
+
+// Path maxima of all pairs of vertices (by Expose with Restore after each one, or by read-only QueryPath) are the same
+// as in the naive forest
+bool check_maxima(TopTree::ITopTree *top_tree, const NaiveForest &naive, const std::string &name, bool query_path = false) {
+	int N = naive.weights.size();
+	for (int v = 0; v < N; v++) for (int w = v + 1; w < N; w++) {
+		auto cluster = (query_path ? top_tree->QueryPath(v, w) : top_tree->Expose(v, w));
+		int found = (cluster == NULL ? -1 : MaxEdge::STTopTree::GetData(cluster)->w_max);
+		if (!query_path) top_tree->Restore();
+		if (found != naive.max_weight(v, w)) {
+			std::cerr << name << ": maximum " << v << "-" << w << (query_path ? " by QueryPath" : "") << " is " << found
+				<< " instead of " << naive.max_weight(v, w) << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Batches of random cuts and links by ApplyBatch give the same forest as the same single Cuts and Links, a batch with
+// an invalid cut is rejected without any change
+bool test_batches() {
+	for (unsigned seed = 1; seed <= 40; seed++) {
+		int N = 10 + seed % 30;
+		RandomForest forest(N, seed, seed % 2);
+		auto &random = forest.random;
+		MaxEdge::TopologyTopTree batch_tree(forest.base_tree()), single_tree(forest.base_tree());
+		std::string name = "ApplyBatch (seed " + std::to_string(seed) + ")";
+
+		for (int b = 0; b < 20; b++) {
+			// 1. Random distinct edges to cut and random links (some of them fail as in the same tree)
+			std::vector<std::pair<int, int>> cuts;
+			int B = 1 + random() % 4;
+			for (int i = 0; i < B && !forest.edges.empty(); i++) {
+				int e = random() % forest.edges.size();
+				cuts.push_back(forest.edges[e]);
+				forest.edges[e] = forest.edges.back();
+				forest.edges.pop_back();
+			}
+			std::vector<TopTree::TopologyTopTree::LinkRequest> links;
+			std::vector<int> weights;
+			for (int i = 0; i < B; i++) {
+				int v = random() % N, w = (v + 1 + random() % (N - 1)) % N, weight = random() % 1000;
+				links.push_back(TopTree::TopologyTopTree::LinkRequest{v, w, std::make_shared<MaxEdge::MyEdgeData>(0, weight, "")});
+				weights.push_back(weight);
+			}
+
+			// 2. Invalid cut (edge cut twice) rejects the whole batch
+			auto invalid_cuts = cuts;
+			if (!cuts.empty()) invalid_cuts.push_back(std::make_pair(cuts[0].second, cuts[0].first));
+			else invalid_cuts.push_back(std::make_pair(0, 0));
+			if (batch_tree.ApplyBatch(links, invalid_cuts) != -1) {
+				std::cerr << name << ": batch with invalid cut was not rejected" << std::endl;
+				return false;
+			}
+
+			// 3. The same changes by single operations and by the batch
+			int done = 0;
+			for (auto c: cuts) {
+				if (std::get<2>(single_tree.Cut(c.first, c.second)) != NULL) done++;
+				forest.naive.cut(c.first, c.second);
+			}
+			for (uint i = 0; i < links.size(); i++) {
+				if (single_tree.Link(links[i].v, links[i].w, std::make_shared<MaxEdge::MyEdgeData>(0, weights[i], "")) == NULL) continue;
+				done++;
+				forest.naive.link(links[i].v, links[i].w, weights[i]);
+				forest.edges.push_back(std::make_pair(links[i].v, links[i].w));
+			}
+			int batch_done = batch_tree.ApplyBatch(links, cuts);
+			if (batch_done != done) {
+				std::cerr << name << ": " << batch_done << " operations succeeded instead of " << done << std::endl;
+				return false;
+			}
+
+			// 4. Compare path maxima
+			if (!check_maxima(&batch_tree, forest.naive, name + " after batch")) return false;
+			if (!check_maxima(&single_tree, forest.naive, name + " after single operations")) return false;
+		}
+	}
+	return true;
+}
+
+// Random links, cuts, additions of weights on paths and path maxima (by Expose and by QueryPath) on a random forest of
+// N vertices, at the end path maxima of all pairs are checked by QueryPath and then by Expose (so QueryPaths did not
+// change the tree)
+bool test_path_maxima(TopTree::ITopTree *top_tree, const std::string &name, int N, unsigned seed, bool hub = false) {
+	RandomForest forest(N, seed, hub);
+	auto &random = forest.random;
+	top_tree->InitFromBaseTree(forest.base_tree());
+
+	for (int op = 0; op < 500; op++) {
+		int v = (hub && random() % 2 ? 0 : random() % N);
+		int w = random() % N;
+		int type = random() % 5;
+		if (v == w) continue;
+		int expected = forest.naive.max_weight(v, w);
+
+		if (type == 0) {
+			int weight = random() % 1000;
+			bool linked = (top_tree->Link(v, w, std::make_shared<MaxEdge::MyEdgeData>(0, weight, "")) != NULL);
+			if (linked != (expected == -1)) {
+				std::cerr << name << ": Link " << v << "-" << w << " returned " << linked << " at operation " << op << std::endl;
+				return false;
+			}
+			if (linked) {
+				forest.naive.link(v, w, weight);
+				forest.edges.push_back(std::make_pair(v, w));
+			}
+		} else if (type == 1) {
+			if (forest.edges.empty()) continue;
+			int i = random() % forest.edges.size();
+			auto e = forest.edges[i];
+			if (std::get<2>(top_tree->Cut(e.first, e.second)) == NULL) {
+				std::cerr << name << ": Cut " << e.first << "-" << e.second << " failed at operation " << op << std::endl;
+				return false;
+			}
+			forest.naive.cut(e.first, e.second);
+			forest.edges[i] = forest.edges.back();
+			forest.edges.pop_back();
+		} else {
+			// Additions of weights and half of maxima by Expose, the other half of maxima by QueryPath (of restored tree)
+			if (type == 4) top_tree->Restore();
+			auto cluster = (type == 4 ? top_tree->QueryPath(v, w) : top_tree->Expose(v, w));
+			if ((cluster != NULL) != (expected != -1)) {
+				std::cerr << name << ": " << (type == 4 ? "QueryPath " : "Expose ") << v << "-" << w << " returned wrong cluster at operation " << op << std::endl;
+				return false;
+			}
+			if (cluster == NULL) continue;
+			auto data = MaxEdge::STTopTree::GetData(cluster);
+			if (type == 2) {
+				int extra_weight = random() % 50;
+				data->w_extra += extra_weight;
+				data->w_max += extra_weight;
+				std::vector<std::pair<int, int>> path;
+				forest.naive.path(v, w, path);
+				for (auto &e: path) forest.naive.link(e.first, e.second, forest.naive.weights[e.first][e.second] + extra_weight);
+			} else if (data->w_max != expected) {
+				std::cerr << name << ": " << (type == 4 ? "QueryPath " : "Expose ") << v << "-" << w << " gives maximum " << data->w_max
+					<< " instead of " << expected << " at operation " << op << std::endl;
+				return false;
+			}
+		}
+	}
+	top_tree->Restore();
+	return check_maxima(top_tree, forest.naive, name, true) && check_maxima(top_tree, forest.naive, name);
+}
+
+// QueryPath gives the same maxima as Expose and it does not change the tree
+bool test_query_path() {
+	for (unsigned seed = 1; seed <= 20; seed++) {
+		int N = 10 + seed % 30;
+		MaxEdge::STTopTree st;
+		MaxEdge::TopologyTopTree topology;
+		if (!test_path_maxima(&st, "STTopTree (seed " + std::to_string(seed) + ")", N, seed)) return false;
+		if (!test_path_maxima(&topology, "TopologyTopTree (seed " + std::to_string(seed) + ")", N, seed)) return false;
+	}
+	return true;
+}
+
+// Both top trees with deferred joins give the same maxima as the naive forest (as with eager joins)
+bool test_deferred_joins() {
+	for (unsigned seed = 1; seed <= 60; seed++) {
+		int N = 5 + seed % 40;
+		MaxEdge::STTopTree st;
+		MaxEdge::TopologyTopTree topology;
+		st.SetDeferredJoins(true);
+		topology.SetDeferredJoins(true);
+		if (!test_path_maxima(&st, "STTopTree with deferred joins (seed " + std::to_string(seed) + ")", N, seed)) return false;
+		if (!test_path_maxima(&topology, "TopologyTopTree with deferred joins (seed " + std::to_string(seed) + ")", N, seed)) return false;
+	}
+	return true;
+}
+
+// Maximum edge weight policy that remembers parents of its Join callbacks (to compare them with the restore hook)
+std::vector<const TopTree::ICluster*> joined_parents;
+struct CountingPolicy: public MaxEdge::Policy {
+	static void Join(const std::shared_ptr<TopTree::ICluster> &leftChild, const std::shared_ptr<TopTree::ICluster> &rightChild, const std::shared_ptr<TopTree::ICluster> &parent,
+		MaxEdge::MyClusterData *left_data, MaxEdge::MyClusterData *right_data, MaxEdge::MyClusterData *parent_data) {
+		joined_parents.push_back(parent.get());
+		MaxEdge::Policy::Join(leftChild, rightChild, parent, left_data, right_data, parent_data);
+	}
+};
+
+// Restore hook: number of calls, calls that did not match the Join callbacks made since the start of the operation
+int hook_calls = 0;
+int hook_mismatches = 0;
+void check_restore_hook(int joins) {
+	hook_calls++;
+	std::vector<const TopTree::ICluster*> parents(joined_parents);
+	std::sort(parents.begin(), parents.end());
+	bool once = (std::unique(parents.begin(), parents.end()) == parents.end());
+	if (joins != (int) joined_parents.size() || !once) hook_mismatches++;
+}
+
+// Restore hook is called once by each Restore of an exposed path (also the implicit one by the next Expose, Link or
+// Cut) and its number of joins is the number of Join callbacks of that Restore, every cluster is joined only once
+bool test_restore_hook() {
+	for (unsigned seed = 1; seed <= 20; seed++) for (int deferred = 0; deferred < 2; deferred++) {
+		int N = 20 + seed % 30;
+		RandomForest forest(N, seed, seed % 2);
+		auto &random = forest.random;
+		TopTree::PolicyTopTree<CountingPolicy, TopTree::TopologyTopTree> top_tree(forest.base_tree());
+		top_tree.SetDeferredJoins(deferred);
+		top_tree.SetRestoreHook(check_restore_hook);
+		std::string name = "Restore hook" + std::string(deferred ? " with deferred joins" : "") + " (seed " + std::to_string(seed) + ")";
+		hook_calls = hook_mismatches = 0;
+
+		int expected_calls = 0;
+		bool exposed = false; // unrestored Expose of some path
+		int last_v = -1, last_w = -1;
+		for (int op = 0; op < 300; op++) {
+			int v = random() % N;
+			int w = random() % N;
+			int type = random() % 4;
+			if (v == w) continue;
+			joined_parents.clear(); // every operation restores the previous Expose before the other callbacks
+
+			if (type == 0 && !forest.edges.empty()) {
+				// Cut and Link of the same edge
+				auto e = forest.edges[random() % forest.edges.size()];
+				expected_calls += exposed;
+				top_tree.Cut(e.first, e.second);
+				joined_parents.clear();
+				top_tree.Link(e.first, e.second, std::make_shared<MaxEdge::MyEdgeData>(0, forest.naive.weights[e.first][e.second], ""));
+				exposed = false;
+			} else if (type == 1) {
+				expected_calls += exposed;
+				top_tree.Restore();
+				exposed = false;
+			} else {
+				// Eager joins restore the previous Expose here (unless it is the same path), deferred ones only by Restore
+				if (exposed && v == last_v && w == last_w) continue;
+				bool found = (top_tree.Expose(v, w) != NULL);
+				if (!deferred) {
+					expected_calls += exposed;
+					exposed = false;
+				}
+				exposed |= found;
+				last_v = v;
+				last_w = w;
+			}
+			if (hook_calls != expected_calls) {
+				std::cerr << name << ": hook called " << hook_calls << " times instead of " << expected_calls << " at operation " << op << std::endl;
+				return false;
+			}
+		}
+		joined_parents.clear();
+		top_tree.Restore();
+		top_tree.Restore(); // nothing to restore, no call
+		if (hook_calls != expected_calls + exposed) {
+			std::cerr << name << ": hook called " << hook_calls << " times instead of " << expected_calls + exposed << " at the end" << std::endl;
+			return false;
+		}
+		if (hook_mismatches > 0) {
+			std::cerr << name << ": " << hook_mismatches << " of " << hook_calls << " hook calls do not match the Join callbacks" << std::endl;
+			return false;
+		}
+		if (!check_maxima(&top_tree, forest.naive, name)) return false;
+	}
+	return true;
+}
+
+// Repeated Exposes of a fixed path (twice in a row and then Restore) do not allocate anything after the first one
+bool test_expose_allocations() {
+	int N = 200;
+	RandomForest forest(N, 1);
+	MaxEdge::TopologyTopTree top_tree(forest.base_tree());
+
+	// The longest path from the last vertex
+	int v = N - 1, w = v;
+	uint length = 0;
+	for (int x = 0; x < N; x++) {
+		std::vector<std::pair<int, int>> path;
+		if (forest.naive.path(v, x, path) && path.size() > length) {
+			w = x;
+			length = path.size();
+		}
+	}
+	int expected = forest.naive.max_weight(v, w);
+
+	top_tree.Expose(v, w);
+	top_tree.Restore();
+	long long before = allocations;
+	for (int i = 0; i < 100; i++) {
+		int first = MaxEdge::STTopTree::GetData(top_tree.Expose(v, w))->w_max;
+		int second = MaxEdge::STTopTree::GetData(top_tree.Expose(v, w))->w_max;
+		top_tree.Restore();
+		if (first != expected || second != expected) {
+			std::cerr << "Expose: maximum " << v << "-" << w << " is " << first << " and " << second << " instead of " << expected << std::endl;
+			return false;
+		}
+	}
+	if (allocations != before) {
+		std::cerr << "Expose: 200 Exposes of the same path (" << length << " edges) allocated " << allocations - before << " times" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// More threads query one tree at once by QueryPath and get the same maxima as the naive forest, QueryPath does not
+// read a tree with unrestored Expose
+bool test_concurrent_queries() {
+	int N = 3000;
+	RandomForest forest(N, 3, true);
+	MaxEdge::TopologyTopTree top_tree(forest.base_tree());
+
+	std::vector<std::pair<int, int>> pairs;
+	std::vector<int> expected;
+	while (pairs.size() < 300) {
+		int v = forest.random() % N;
+		int w = forest.random() % N;
+		if (v == w) continue;
+		pairs.push_back(std::make_pair(v, w));
+		expected.push_back(forest.naive.max_weight(v, w));
+	}
+
+	top_tree.Expose(pairs[0].first, pairs[0].second);
+	if (top_tree.QueryPath(pairs[0].first, pairs[0].second) != NULL) {
+		std::cerr << "QueryPath: tree with unrestored Expose was queried" << std::endl;
+		return false;
+	}
+	top_tree.Restore();
+
+	std::atomic<int> wrong{0};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) threads.emplace_back([&, t]() {
+		for (int round = 0; round < 5; round++) for (size_t i = 0; i < pairs.size(); i++) {
+			size_t j = (i + t * pairs.size() / 4) % pairs.size(); // every thread starts elsewhere
+			auto cluster = top_tree.QueryPath(pairs[j].first, pairs[j].second);
+			int found = (cluster == NULL ? -1 : MaxEdge::STTopTree::GetData(cluster)->w_max);
+			if (found != expected[j]) wrong++;
+		}
+	});
+	for (auto &thread: threads) thread.join();
+	if (wrong > 0) {
+		std::cerr << "QueryPath: " << wrong << " wrong maxima by 4 threads at once" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Construction by more threads gives the same trees as the serial one (forest is large enough to be divided between
+// threads, see PARALLEL_CONSTRUCTION_GRAIN), path maxima of random pairs are compared (some also with the naive forest)
+bool test_parallel_construction() {
+	int N = 300000;
+	RandomForest forest(N, 2);
+	MaxEdge::STTopTree st_serial, st_parallel;
+	MaxEdge::TopologyTopTree topology_serial, topology_parallel;
+	st_serial.InitFromBaseTree(forest.base_tree(), 1);
+	st_parallel.InitFromBaseTree(forest.base_tree(), 4);
+	topology_serial.InitFromBaseTree(forest.base_tree(), 1);
+	topology_parallel.InitFromBaseTree(forest.base_tree(), 4);
+
+	std::pair<TopTree::ITopTree*, TopTree::ITopTree*> trees[2] = {{&st_serial, &st_parallel}, {&topology_serial, &topology_parallel}};
+	const char *names[2] = {"STTopTree", "TopologyTopTree"};
+	for (int i = 0; i < 2; i++) for (int q = 0; q < 2000; q++) {
+		int v = forest.random() % N;
+		int w = forest.random() % N;
+		if (v == w) continue;
+		int found[2];
+		for (int j = 0; j < 2; j++) {
+			auto top_tree = (j == 0 ? trees[i].first : trees[i].second);
+			auto cluster = top_tree->Expose(v, w);
+			found[j] = (cluster == NULL ? -1 : MaxEdge::STTopTree::GetData(cluster)->w_max);
+			top_tree->Restore();
+		}
+		int expected = (q % 40 == 0 ? forest.naive.max_weight(v, w) : found[0]);
+		if (found[0] != expected || found[1] != expected) {
+			std::cerr << names[i] << ": maximum " << v << "-" << w << " is " << found[1] << " by the parallel construction and "
+				<< found[0] << " by the serial one instead of " << expected << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Path maxima through a vertex of high degree (links and cuts at it move its subvertices)
+bool test_hubs() {
+	for (unsigned seed = 1; seed <= 100; seed++) {
+		int N = 10 + seed % 40;
+		MaxEdge::STTopTree st;
+		MaxEdge::TopologyTopTree topology;
+		if (!test_path_maxima(&st, "STTopTree with hub (seed " + std::to_string(seed) + ")", N, seed, true)) return false;
+		if (!test_path_maxima(&topology, "TopologyTopTree with hub (seed " + std::to_string(seed) + ")", N, seed, true)) return false;
+	}
+	return true;
+}
+
 int main(int argc, char const *argv[]) {
 	auto baseTree = std::make_shared<TopTree::BaseTree>();
 
@@ -184,5 +653,16 @@ int main(int argc, char const *argv[]) {
 	for (auto root : T->GetTopTrees()) T->PrintGraphviz(root, "After Link");
 	*/
 
-	return 0;
+	// Tests
+	bool passed = true;
+	passed &= test_batches();
+	passed &= test_query_path();
+	passed &= test_deferred_joins();
+	passed &= test_restore_hook();
+	passed &= test_expose_allocations();
+	passed &= test_hubs();
+	passed &= test_parallel_construction();
+	passed &= test_concurrent_queries();
+	std::cerr << (passed ? "All tests passed" : "TESTS FAILED") << std::endl;
+	return passed ? 0 : 1;
 }